@@ -0,0 +1,569 @@
+#include "../src/sha256.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BKH_BENCH_X86
+#endif
+
+#if defined(BKH_BENCH_OPENSSL)
+#include <openssl/evp.h>
+#endif
+
+using namespace bkh;
+using byte       = sha256::byte;
+using clock_type = std::chrono::steady_clock;
+
+/* Settings */
+
+/**
+ * The options given on the command line.
+ */
+struct settings
+{
+    u64         min_size   = 0;
+    u64         max_size   = u64{ 1 } << 30;
+    u64         step       = 4;
+    double      min_time   = 0.1;
+    bool        aligned    = true;
+    bool        unaligned  = true;
+    bool        hot        = true;
+    bool        cold       = true;
+    std::string apis       = "compute_hash,context,batch,openssl";
+    std::string format     = "table";
+    std::string output;
+};
+
+/**
+ * A single measurement.
+ */
+struct result
+{
+    std::string api;
+    std::string backend;
+    u64         size;
+    u64         messages;    //Messages hashed per operation
+    bool        aligned;
+    bool        cold;
+    u64         samples;
+    double      ns_per_op;   //Median
+    double      cycles_per_op;
+};
+
+/* Cycle counting */
+
+/**
+ * Counts the cycles of the core through perf where allowed, and
+ * falls back to the time-stamp counter, which ticks at a fixed
+ * rate regardless of the actual clock speed.
+ */
+struct cycle_counter
+{
+    int         fd     = -1;
+    char const* source = "none";
+
+    void init()
+    {
+        perf_event_attr attr{};
+        attr.type           = PERF_TYPE_HARDWARE;
+        attr.size           = sizeof(attr);
+        attr.config         = PERF_COUNT_HW_CPU_CYCLES;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+
+        this->fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+        if (this->fd >= 0)
+        {
+            ioctl(this->fd, PERF_EVENT_IOC_ENABLE, 0);
+            this->source = "perf";
+            return;
+        }
+
+#if defined(BKH_BENCH_X86)
+        this->source = "tsc";
+#endif
+    }
+
+    u64 read() const
+    {
+        if (this->fd >= 0)
+        {
+            u64 value = 0;
+            if (::read(this->fd, &value, sizeof(value)) != sizeof(value)) return 0;
+            return value;
+        }
+
+#if defined(BKH_BENCH_X86)
+        return __rdtsc();
+#else
+        return 0;
+#endif
+    }
+};
+
+static cycle_counter cycles;
+
+/* Cache control */
+
+/**
+ * Evicts the buffer from every level of the cache.
+ */
+static void evict(byte const* data, u64 length)
+{
+#if defined(BKH_BENCH_X86)
+    for (u64 i = 0; i < length; i += 64) _mm_clflush(data + i);
+    if (length > 0) _mm_clflush(data + length - 1);
+    _mm_mfence();
+#else
+    //Stream through a buffer larger than any last level cache
+    static std::vector<byte> scratch(256u << 20);
+    for (u64 i = 0; i < scratch.size(); i += 64) scratch[i]++;
+    static_cast<void>(data);
+    static_cast<void>(length);
+#endif
+}
+
+/* Measurement */
+
+/**
+ * Keeps the compiler from discarding the digests.
+ */
+volatile byte sink;
+
+static void consume(byte const* digest)
+{
+    sink = digest[0];
+}
+
+/**
+ * Runs the operation until the minimum time has passed, and
+ * returns the median time and cycle count of a run. With a hot
+ * cache the runs are grouped into rounds long enough to hide the
+ * cost of reading the clock, with a cold cache every run is timed
+ * on its own right after the data has been evicted.
+ */
+template<typename Op>
+static void measure(settings const& s, bool cold, byte const* data, u64 length, Op&& op, result& r)
+{
+    std::vector<double> ns;
+    std::vector<double> cy;
+
+    //Warm up, and estimate how many runs make up a round
+    u64 per_round = 1;
+    if (!cold)
+    {
+        op();
+        auto const start = clock_type::now();
+        op();
+        double const once = std::chrono::duration<double, std::nano>(clock_type::now() - start).count();
+        per_round = (once < 10000.0) ? static_cast<u64>(10000.0 / (once + 1.0)) + 1 : 1;
+    }
+
+    double total = 0;
+    while ((total < s.min_time * 1e9 || ns.size() < 3) && ns.size() < 10000)
+    {
+        if (cold) evict(data, length);
+
+        u64  const c0    = cycles.read();
+        auto const start = clock_type::now();
+        for (u64 i = 0; i < per_round; i++) op();
+        auto const end   = clock_type::now();
+        u64  const c1    = cycles.read();
+
+        double const elapsed = std::chrono::duration<double, std::nano>(end - start).count();
+        ns.push_back(elapsed / per_round);
+        cy.push_back(static_cast<double>(c1 - c0) / per_round);
+        total += elapsed;
+
+        //A single run of a huge message is enough
+        if (elapsed > s.min_time * 1e9) break;
+    }
+
+    std::sort(ns.begin(), ns.end());
+    std::sort(cy.begin(), cy.end());
+    r.samples       = ns.size();
+    r.ns_per_op     = ns[ns.size() / 2];
+    r.cycles_per_op = cy[cy.size() / 2];
+}
+
+/* Output */
+
+static double gbps(result const& r)
+{
+    return (r.ns_per_op > 0) ? static_cast<double>(r.size * r.messages) / r.ns_per_op : 0.0;
+}
+
+static double cycles_per_byte(result const& r)
+{
+    return (r.size > 0) ? r.cycles_per_op / static_cast<double>(r.size * r.messages) : 0.0;
+}
+
+static std::string cpu_model()
+{
+    FILE* f = std::fopen("/proc/cpuinfo", "r");
+    if (!f) return "unknown";
+
+    char line[512];
+    std::string model = "unknown";
+    while (std::fgets(line, sizeof(line), f))
+    {
+        if (std::strncmp(line, "model name", 10) != 0) continue;
+
+        char const* colon = std::strchr(line, ':');
+        if (colon)
+        {
+            model = colon + 2;
+            while (!model.empty() && (model.back() == '\n' || model.back() == ' ')) model.pop_back();
+        }
+        break;
+    }
+
+    std::fclose(f);
+    return model;
+}
+
+static std::string json_escape(std::string const& str)
+{
+    std::string out;
+    for (char c : str)
+    {
+        if (c == '"' || c == '\\') out += '\\';
+        if (static_cast<unsigned char>(c) >= 0x20) out += c;
+    }
+
+    return out;
+}
+
+static void print_table(FILE* out, std::vector<result> const& results)
+{
+    std::fprintf(out, "%-13s %-8s %12s %5s %-9s %-5s %14s %10s %12s\n",
+                 "api", "backend", "size", "msgs", "alignment", "cache", "ns/op", "GB/s", "cycles/byte");
+    for (auto const& r : results)
+    {
+        std::fprintf(out, "%-13s %-8s %12llu %5llu %-9s %-5s %14.1f %10.3f %12.2f\n",
+                     r.api.c_str(), r.backend.c_str(),
+                     static_cast<unsigned long long>(r.size), static_cast<unsigned long long>(r.messages),
+                     r.aligned ? "aligned" : "unaligned", r.cold ? "cold" : "hot",
+                     r.ns_per_op, gbps(r), cycles_per_byte(r));
+    }
+}
+
+static void print_csv(FILE* out, std::vector<result> const& results)
+{
+    std::fprintf(out, "api,backend,size,messages,aligned,cache,samples,ns_per_op,gb_per_s,cycles_per_op,cycles_per_byte,cycle_source\n");
+    for (auto const& r : results)
+    {
+        std::fprintf(out, "%s,%s,%llu,%llu,%d,%s,%llu,%.3f,%.6f,%.1f,%.4f,%s\n",
+                     r.api.c_str(), r.backend.c_str(),
+                     static_cast<unsigned long long>(r.size), static_cast<unsigned long long>(r.messages),
+                     r.aligned ? 1 : 0, r.cold ? "cold" : "hot", static_cast<unsigned long long>(r.samples),
+                     r.ns_per_op, gbps(r), r.cycles_per_op, cycles_per_byte(r), cycles.source);
+    }
+}
+
+static void print_json(FILE* out, std::vector<result> const& results)
+{
+    char date[32];
+    std::time_t const now = std::time(nullptr);
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%SZ", std::gmtime(&now));
+
+    std::fprintf(out, "{\n");
+    std::fprintf(out, "  \"date\": \"%s\",\n", date);
+    std::fprintf(out, "  \"cpu\": \"%s\",\n", json_escape(cpu_model()).c_str());
+    std::fprintf(out, "  \"compiler\": \"%s\",\n", json_escape(__VERSION__).c_str());
+    std::fprintf(out, "  \"cycle_source\": \"%s\",\n", cycles.source);
+    std::fprintf(out, "  \"results\": [\n");
+    for (std::size_t i = 0; i < results.size(); i++)
+    {
+        auto const& r = results[i];
+        std::fprintf(out,
+                     "    {\"api\": \"%s\", \"backend\": \"%s\", \"size\": %llu, \"messages\": %llu, "
+                     "\"aligned\": %s, \"cache\": \"%s\", \"samples\": %llu, \"ns_per_op\": %.3f, "
+                     "\"gb_per_s\": %.6f, \"cycles_per_op\": %.1f, \"cycles_per_byte\": %.4f}%s\n",
+                     r.api.c_str(), r.backend.c_str(),
+                     static_cast<unsigned long long>(r.size), static_cast<unsigned long long>(r.messages),
+                     r.aligned ? "true" : "false", r.cold ? "cold" : "hot", static_cast<unsigned long long>(r.samples),
+                     r.ns_per_op, gbps(r), r.cycles_per_op, cycles_per_byte(r),
+                     (i + 1 < results.size()) ? "," : "");
+    }
+    std::fprintf(out, "  ]\n}\n");
+}
+
+/* Benchmarks */
+
+struct backend_info
+{
+    char const*     name;
+    sha256::backend value;
+};
+
+static backend_info const backends[] = {
+    { "scalar", sha256::backend::scalar },
+    { "ssse3",  sha256::backend::ssse3  },
+    { "avx2",   sha256::backend::avx2   },
+    { "shani",  sha256::backend::shani  },
+};
+
+struct batch_backend_info
+{
+    char const*           name;
+    sha256::batch_backend value;
+};
+
+static batch_backend_info const batch_backends[] = {
+    { "serial", sha256::batch_backend::serial },
+    { "avx2",   sha256::batch_backend::avx2   },
+    { "avx512", sha256::batch_backend::avx512 },
+};
+
+/**
+ * The number of messages per batch, enough to fill 16 lanes
+ * several times over.
+ */
+static constexpr u64 const batch_count = 64;
+
+/**
+ * The largest message size the batch is measured with, beyond
+ * which it is the same as hashing the messages one by one.
+ */
+static constexpr u64 const batch_max_size = u64{ 1 } << 20;
+
+static bool wants(settings const& s, char const* api)
+{
+    std::string const list = "," + s.apis + ",";
+    return list.find(std::string(",") + api + ",") != std::string::npos;
+}
+
+/**
+ * Hashes a message with the lower level API, the way the example
+ * in sha256.h does.
+ */
+static void context_loop(byte const* data, u64 length, byte* digest)
+{
+    sha256::context ctx;
+    ctx.init();
+
+    u64 const full = length / sha256::block_length;
+    for (u64 i = 0; i < full; i++) ctx.transform_block(data + i * sha256::block_length);
+
+    byte buf[sha256::block_length];
+    bool const done = sha256::context::pad_block(data + full * sha256::block_length, length % sha256::block_length, length, buf);
+    ctx.transform_block(buf);
+    if (!done)
+    {
+        sha256::context::pad_block(nullptr, 0, length, buf);
+        ctx.transform_block(buf);
+    }
+
+    ctx.get_digest(digest);
+}
+
+static void run_size(settings const& s, byte* memory, u64 size, std::vector<result>& results)
+{
+    byte digest[sha256::digest_length];
+
+    for (int a = 0; a < 2; a++)
+    {
+        bool const aligned = (a == 0);
+        if (aligned ? !s.aligned : !s.unaligned) continue;
+
+        //The buffer is 64 byte aligned, so offset it by one byte for the unaligned case
+        byte const* data = memory + (aligned ? 0 : 1);
+
+        for (int c = 0; c < 2; c++)
+        {
+            bool const cold = (c == 1);
+            if (cold ? !s.cold : !s.hot) continue;
+
+            auto add = [&](char const* api, char const* backend, u64 messages, auto&& op)
+            {
+                result r{ api, backend, size, messages, aligned, cold, 0, 0, 0 };
+                measure(s, cold, data, size * messages + 1, op, r);
+                results.push_back(r);
+
+                //Show the progress on a terminal
+                if (isatty(STDERR_FILENO)) std::fprintf(stderr, "\r%-13s %-8s %12llu %-9s %-4s", api, backend,
+                             static_cast<unsigned long long>(size), aligned ? "aligned" : "unaligned", cold ? "cold" : "hot");
+            };
+
+            //The simple API and the lower level one, on every backend
+            for (auto const& b : backends)
+            {
+                if (!sha256::set_backend(b.value)) continue;
+
+                if (wants(s, "compute_hash"))
+                {
+                    add("compute_hash", b.name, 1, [&] { sha256::compute_hash(data, size, digest); consume(digest); });
+                }
+                if (wants(s, "context"))
+                {
+                    add("context", b.name, 1, [&] { context_loop(data, size, digest); consume(digest); });
+                }
+            }
+            sha256::set_backend(sha256::backend::automatic);
+
+            //Many independent messages of this size, on every batch backend
+            if (wants(s, "batch") && size <= batch_max_size)
+            {
+                byte             digests[batch_count][sha256::digest_length];
+                sha256::message  messages[batch_count];
+                for (u64 i = 0; i < batch_count; i++) messages[i] = { data + i * size, size, digests[i] };
+
+                for (auto const& b : batch_backends)
+                {
+                    if (!sha256::set_batch_backend(b.value)) continue;
+                    add("batch", b.name, batch_count, [&] { sha256::compute_hash_batch(messages, batch_count); consume(digests[0]); });
+                }
+                sha256::set_batch_backend(sha256::batch_backend::automatic);
+            }
+
+#if defined(BKH_BENCH_OPENSSL)
+            if (wants(s, "openssl"))
+            {
+                add("openssl", "evp", 1, [&] { EVP_Digest(data, size, digest, nullptr, EVP_sha256(), nullptr); consume(digest); });
+            }
+#endif
+        }
+    }
+}
+
+/* Entry point */
+
+static void usage(FILE* out)
+{
+    std::fputs(
+        "Usage: benchmark [OPTION]...\n"
+        "Measures the throughput of the SHA-256 implementation.\n"
+        "\n"
+        "  --min=BYTES        smallest message size, default 0\n"
+        "  --max=BYTES        largest message size, default 1G\n"
+        "  --step=N           factor between message sizes, default 4\n"
+        "  --time=SECONDS     minimum time per measurement, default 0.1\n"
+        "  --apis=LIST        comma separated, from compute_hash, context, batch\n"
+        "                     and openssl, default all of them\n"
+        "  --alignment=WHICH  aligned, unaligned or both, default both\n"
+        "  --cache=WHICH      hot, cold or both, default both\n"
+        "  --format=FORMAT    table, csv or json, default table\n"
+        "  --output=FILE      write the results to FILE instead of standard output\n"
+        "  -h, --help         display this help and exit\n",
+        out
+    );
+}
+
+static bool parse_size(char const* str, u64* result)
+{
+    char*              end   = nullptr;
+    unsigned long long value = std::strtoull(str, &end, 10);
+    if (end == str) return false;
+
+    switch (*end)
+    {
+        case 'K': case 'k': value <<= 10; end++; break;
+        case 'M': case 'm': value <<= 20; end++; break;
+        case 'G': case 'g': value <<= 30; end++; break;
+        default: break;
+    }
+
+    *result = value;
+    return *end == '\0';
+}
+
+static bool parse_both(char const* str, char const* first, char const* second, bool* a, bool* b)
+{
+    *a = !std::strcmp(str, first)  || !std::strcmp(str, "both");
+    *b = !std::strcmp(str, second) || !std::strcmp(str, "both");
+    return *a || *b;
+}
+
+int main(int argc, char** argv)
+{
+    settings s;
+    for (int i = 1; i < argc; i++)
+    {
+        char const* arg = argv[i];
+        bool        ok  = true;
+
+        if      (!std::strncmp(arg, "--min=", 6))       ok = parse_size(arg + 6, &s.min_size);
+        else if (!std::strncmp(arg, "--max=", 6))       ok = parse_size(arg + 6, &s.max_size);
+        else if (!std::strncmp(arg, "--step=", 7))      ok = parse_size(arg + 7, &s.step) && s.step >= 2;
+        else if (!std::strncmp(arg, "--time=", 7))      ok = (s.min_time = std::atof(arg + 7)) > 0;
+        else if (!std::strncmp(arg, "--apis=", 7))      s.apis = arg + 7;
+        else if (!std::strncmp(arg, "--alignment=", 12)) ok = parse_both(arg + 12, "aligned", "unaligned", &s.aligned, &s.unaligned);
+        else if (!std::strncmp(arg, "--cache=", 8))     ok = parse_both(arg + 8, "hot", "cold", &s.hot, &s.cold);
+        else if (!std::strncmp(arg, "--format=", 9))    s.format = arg + 9;
+        else if (!std::strncmp(arg, "--output=", 9))    s.output = arg + 9;
+        else if (!std::strcmp(arg, "-h") || !std::strcmp(arg, "--help"))
+        {
+            usage(stdout);
+            return EXIT_SUCCESS;
+        }
+        else ok = false;
+
+        if (!ok || (s.format != "table" && s.format != "csv" && s.format != "json"))
+        {
+            std::fprintf(stderr, "benchmark: invalid option '%s'\n", arg);
+            usage(stderr);
+            return EXIT_FAILURE;
+        }
+    }
+
+#if !defined(BKH_BENCH_OPENSSL)
+    if (wants(s, "openssl")) std::fprintf(stderr, "benchmark: built without OpenSSL, skipping it\n");
+#endif
+
+    //The sizes to measure, including the empty message
+    std::vector<u64> sizes;
+    if (s.min_size == 0) sizes.push_back(0);
+    for (u64 size = (s.min_size > 0) ? s.min_size : 1; size <= s.max_size; size *= s.step) sizes.push_back(size);
+
+    //Room for the largest message, or the largest batch, plus the unaligned offset
+    u64 const largest = sizes.empty() ? 0 : sizes.back();
+    u64 const batch   = std::min(largest, batch_max_size) * batch_count;
+    u64 const length  = std::max(largest, batch) + 64;
+
+    void* memory = nullptr;
+    if (posix_memalign(&memory, 64, length) != 0)
+    {
+        std::fprintf(stderr, "benchmark: could not allocate %llu bytes\n", static_cast<unsigned long long>(length));
+        return EXIT_FAILURE;
+    }
+
+    //Fill it with something other than zero pages
+    byte* const data = static_cast<byte*>(memory);
+    for (u64 i = 0; i < length; i++) data[i] = static_cast<byte>(i * 131 + 7);
+
+    cycles.init();
+
+    std::vector<result> results;
+    for (u64 size : sizes) run_size(s, data, size, results);
+    if (isatty(STDERR_FILENO)) std::fprintf(stderr, "\r%80s\r", "");
+
+    FILE* out = s.output.empty() ? stdout : std::fopen(s.output.c_str(), "w");
+    if (!out)
+    {
+        std::fprintf(stderr, "benchmark: %s: %s\n", s.output.c_str(), std::strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    if      (s.format == "csv")  print_csv(out, results);
+    else if (s.format == "json") print_json(out, results);
+    else                         print_table(out, results);
+
+    if (out != stdout) std::fclose(out);
+    std::free(memory);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,21 @@
+#!/bin/sh
+
+# Builds the benchmark with GCC or Clang. Set CXX to pick the
+# compiler, it defaults to c++. When the OpenSSL development files
+# are installed it is included in the comparison.
+
+set -e
+
+cd "$(dirname "$0")"
+mkdir -p build
+
+CXX=${CXX:-c++}
+COMPILER_FLAGS="-std=c++17 -O2 -Wall -Wextra"
+LIBRARIES=""
+
+if echo '#include <openssl/evp.h>' | $CXX -x c++ -E - >/dev/null 2>&1; then
+    COMPILER_FLAGS="$COMPILER_FLAGS -DBKH_BENCH_OPENSSL"
+    LIBRARIES="-lcrypto"
+fi
+
+$CXX $COMPILER_FLAGS ../src/sha256.cpp benchmark.cpp -o build/benchmark $LIBRARIES
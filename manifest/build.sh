@@ -0,0 +1,14 @@
+#!/bin/sh
+
+# Builds the manifest tool with GCC or Clang. Set CXX to pick the
+# compiler, it defaults to c++.
+
+set -e
+
+cd "$(dirname "$0")"
+mkdir -p build
+
+CXX=${CXX:-c++}
+COMPILER_FLAGS="-std=c++17 -O2 -Wall -Wextra -pthread"
+
+$CXX $COMPILER_FLAGS ../src/sha256.cpp ../src/sha256_file.cpp ../src/sha256_manifest.cpp manifest.cpp -o build/manifest
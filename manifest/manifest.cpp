@@ -0,0 +1,165 @@
+#include "../src/sha256_manifest.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+using namespace bkh;
+
+/**
+ * The options given on the command line.
+ */
+struct settings
+{
+    sha256_manifest::options opts;
+    char const*              check       = nullptr;
+    bool                     quiet       = false;
+    bool                     tree_digest = false;
+};
+
+static void usage(FILE* out)
+{
+    std::fputs(
+        "Usage: manifest [OPTION]... DIR\n"
+        "Print the SHA256 manifest of every file below DIR, or check DIR against one.\n"
+        "\n"
+        "      --check=FILE      check the files of the manifest FILE, - for standard input\n"
+        "      --fail-fast       stop checking at the first file that fails\n"
+        "      --quiet           don't print OK for each successfully verified file\n"
+        "      --tree-digest     print the digest of the manifest to standard error\n"
+        "      --follow          follow symbolic links rather than skipping them\n"
+        "      --threads=N       number of threads, one per core by default\n"
+        "  -h, --help            display this help and exit\n",
+        out
+    );
+}
+
+/**
+ * Reads the whole file, or standard input for "-".
+ */
+static bool read_all(char const* path, std::string& contents)
+{
+    bool const use_stdin = std::strcmp(path, "-") == 0;
+    FILE* f = use_stdin ? stdin : std::fopen(path, "rb");
+    if (!f) return false;
+
+    char   buffer[64 * 1024];
+    size_t n;
+    while ((n = std::fread(buffer, 1, sizeof(buffer), f)) > 0) contents.append(buffer, n);
+
+    bool const ok = !std::ferror(f);
+    if (!use_stdin) std::fclose(f);
+    return ok;
+}
+
+static void print_line(void*, char const* line, u64 length)
+{
+    std::fwrite(line, 1, length, stdout);
+}
+
+static void print_result(void* user, char const* path, sha256_manifest::status result)
+{
+    bool const quiet = *static_cast<bool*>(user);
+    switch (result)
+    {
+        case sha256_manifest::status::ok:
+            if (!quiet) std::printf("%s: OK\n", path);
+            break;
+        case sha256_manifest::status::mismatch:
+            std::printf("%s: FAILED\n", path);
+            break;
+        case sha256_manifest::status::missing:
+        case sha256_manifest::status::unreadable:
+            std::printf("%s: FAILED open or read\n", path);
+            break;
+    }
+}
+
+int main(int argc, char** argv)
+{
+    settings s;
+    s.opts = sha256_manifest::default_options();
+
+    char const* root = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        char const* arg = argv[i];
+        if (arg[0] != '-')
+        {
+            if (root)
+            {
+                std::fprintf(stderr, "manifest: extra operand '%s'\n", arg);
+                return EXIT_FAILURE;
+            }
+            root = arg;
+        }
+        else if (!std::strcmp(arg, "--fail-fast"))     s.opts.stop_on_mismatch = true;
+        else if (!std::strcmp(arg, "--quiet"))         s.quiet = true;
+        else if (!std::strcmp(arg, "--tree-digest"))   s.tree_digest = true;
+        else if (!std::strcmp(arg, "--follow"))        s.opts.follow_symlinks = true;
+        else if (!std::strncmp(arg, "--check=", 8))    s.check = arg + 8;
+        else if (!std::strncmp(arg, "--threads=", 10)) s.opts.threads = static_cast<unsigned>(std::strtoul(arg + 10, nullptr, 10));
+        else if (!std::strcmp(arg, "-h") || !std::strcmp(arg, "--help"))
+        {
+            usage(stdout);
+            return EXIT_SUCCESS;
+        }
+        else
+        {
+            std::fprintf(stderr, "manifest: unrecognized option '%s'\n", arg);
+            usage(stderr);
+            return EXIT_FAILURE;
+        }
+    }
+    if (!root)
+    {
+        usage(stderr);
+        return EXIT_FAILURE;
+    }
+
+    //Check the tree against the manifest
+    if (s.check)
+    {
+        std::string contents;
+        if (!read_all(s.check, contents))
+        {
+            std::fprintf(stderr, "manifest: %s: %s\n", s.check, std::strerror(errno));
+            return EXIT_FAILURE;
+        }
+
+        errno = 0;
+        bool const ok = sha256_manifest::verify_tree(root, contents.data(), contents.size(), print_result, &s.quiet, s.opts);
+        if (!ok && errno == EINVAL)
+        {
+            std::fprintf(stderr, "manifest: %s: improperly formatted line\n", s.check);
+            return EXIT_FAILURE;
+        }
+
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    //Print the manifest
+    sha256::byte digest[sha256::digest_length];
+    if (!sha256_manifest::hash_tree(root, print_line, nullptr, digest, s.opts))
+    {
+        std::fprintf(stderr, "manifest: %s: %s\n", root, std::strerror(errno));
+        return EXIT_FAILURE;
+    }
+
+    if (s.tree_digest)
+    {
+        static char const digits[] = "0123456789abcdef";
+        char hex[2 * sha256::digest_length + 1];
+        for (int i = 0; i < sha256::digest_length; i++)
+        {
+            hex[2 * i + 0] = digits[digest[i] >> 4];
+            hex[2 * i + 1] = digits[digest[i] & 15];
+        }
+        hex[2 * sha256::digest_length] = '\0';
+        std::fprintf(stderr, "%s\n", hex);
+    }
+
+    return EXIT_SUCCESS;
+}
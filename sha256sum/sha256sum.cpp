@@ -0,0 +1,362 @@
+#include "../src/sha256_file.h"
+#include "../src/sha256_stream.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace bkh;
+
+/**
+ * The options given on the command line.
+ */
+struct settings
+{
+    sha256_file::options io;
+    bool                 check  = false;
+    bool                 quiet  = false;
+    bool                 status = false;
+    bool                 stats  = false;
+};
+
+/**
+ * Totals for --stats.
+ */
+struct statistics
+{
+    u64    bytes   = 0;
+    double seconds = 0;
+};
+
+static void usage(FILE* out)
+{
+    std::fputs(
+        "Usage: sha256sum [OPTION]... [FILE]...\n"
+        "Print or check SHA256 (256-bit) checksums.\n"
+        "With no FILE, or when FILE is -, read standard input.\n"
+        "\n"
+        "  -b, --binary          accepted for compatibility, there is no text mode\n"
+        "  -t, --text            accepted for compatibility, there is no text mode\n"
+        "  -c, --check           read checksums from the FILEs and check them\n"
+        "      --quiet           don't print OK for each successfully verified file\n"
+        "      --status          don't output anything, status code shows success\n"
+        "      --mode=MODE       how to read files: auto, read, mmap or direct\n"
+        "      --buffer=BYTES    buffer size for the read and direct modes\n"
+        "      --drop-cache      evict the files from the page cache once hashed\n"
+        "      --stats           print the throughput to standard error\n"
+        "  -h, --help            display this help and exit\n",
+        out
+    );
+}
+
+/**
+ * Parses a size with an optional K, M or G suffix.
+ */
+static bool parse_size(char const* str, u64* result)
+{
+    //strtoull would quietly negate a minus sign
+    if (*str < '0' || *str > '9') return false;
+
+    char*              end   = nullptr;
+    errno                    = 0;
+    unsigned long long value = std::strtoull(str, &end, 10);
+    if (end == str || errno == ERANGE) return false;
+
+    int shift = 0;
+    switch (*end)
+    {
+        case 'K': case 'k': shift = 10; end++; break;
+        case 'M': case 'm': shift = 20; end++; break;
+        case 'G': case 'g': shift = 30; end++; break;
+        default: break;
+    }
+
+    //Refuse sizes that do not fit rather than wrapping around
+    if (value > (~0ull >> shift)) return false;
+    value <<= shift;
+
+    *result = value;
+    return *end == '\0' && value > 0;
+}
+
+/**
+ * Hashes a file, or standard input for "-".
+ */
+static bool hash(char const* name, settings const& s, statistics& st, sha256::byte* digest)
+{
+    auto const start = std::chrono::steady_clock::now();
+
+    bool ok;
+    u64  size = 0;
+    if (std::strcmp(name, "-") == 0)
+    {
+        //Pipes and sockets are read on a separate thread, such that waiting for them overlaps with hashing
+        struct stat info;
+        if (fstat(STDIN_FILENO, &info) == 0 && !S_ISREG(info.st_mode))
+        {
+            auto opts        = sha256_stream::default_options();
+            opts.buffer_size = s.io.buffer_size;
+            ok = sha256_stream::hash_descriptor(STDIN_FILENO, digest, opts, &size);
+        }
+        else
+        {
+            ok = sha256_file::hash_descriptor(STDIN_FILENO, digest, s.io, &size);
+        }
+    }
+    else
+    {
+        struct stat info;
+        if (stat(name, &info) == 0 && S_ISDIR(info.st_mode))
+        {
+            errno = EISDIR;
+            ok    = false;
+        }
+        else
+        {
+            ok = sha256_file::hash_file(name, digest, s.io, &size);
+        }
+    }
+
+    st.seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    st.bytes   += ok ? size : 0;
+    return ok;
+}
+
+/**
+ * Formats the digest as lowercase hex.
+ */
+static void to_hex(sha256::byte const* digest, char* hex)
+{
+    static char const digits[] = "0123456789abcdef";
+    for (int i = 0; i < sha256::digest_length; i++)
+    {
+        hex[2 * i + 0] = digits[digest[i] >> 4];
+        hex[2 * i + 1] = digits[digest[i] & 15];
+    }
+    hex[2 * sha256::digest_length] = '\0';
+}
+
+/**
+ * Prints a checksum line the way coreutils does, escaping file
+ * names that contain a backslash or a newline.
+ */
+static void print_line(char const* hex, char const* name)
+{
+    bool const escape = std::strpbrk(name, "\\\n") != nullptr;
+    if (escape) std::putchar('\\');
+
+    std::fputs(hex, stdout);
+    std::fputs("  ", stdout);
+    for (char const* p = name; *p; p++)
+    {
+        if      (escape && *p == '\\') std::fputs("\\\\", stdout);
+        else if (escape && *p == '\n') std::fputs("\\n",  stdout);
+        else                           std::putchar(*p);
+    }
+    std::putchar('\n');
+}
+
+/**
+ * Undoes the escaping of print_line.
+ */
+static std::string unescape(std::string const& name)
+{
+    std::string result;
+    for (std::size_t i = 0; i < name.size(); i++)
+    {
+        if (name[i] == '\\' && i + 1 < name.size())
+        {
+            char const c = name[++i];
+            result += (c == 'n') ? '\n' : c;
+        }
+        else
+        {
+            result += name[i];
+        }
+    }
+
+    return result;
+}
+
+/**
+ * Verifies every checksum line of a file, returning false if any
+ * of them failed.
+ */
+static bool check_file(char const* list, settings const& s, statistics& st)
+{
+    bool const use_stdin = std::strcmp(list, "-") == 0;
+    FILE* f = use_stdin ? stdin : std::fopen(list, "r");
+    if (!f)
+    {
+        std::fprintf(stderr, "sha256sum: %s: %s\n", list, std::strerror(errno));
+        return false;
+    }
+
+    u64 mismatched = 0, unreadable = 0, malformed = 0, verified = 0;
+    std::string line;
+    for (int c; ; )
+    {
+        //Read the next line
+        line.clear();
+        while ((c = std::fgetc(f)) != EOF && c != '\n') line += static_cast<char>(c);
+        if (c == EOF && line.empty()) break;
+        if (!line.empty() && line.back() == '\r') line.pop_back();
+
+        //Parse "[\]HEX  NAME" or "[\]HEX *NAME"
+        bool const escaped = !line.empty() && line[0] == '\\';
+        std::size_t const h = escaped ? 1 : 0;
+        constexpr std::size_t hex_length = 2 * sha256::digest_length;
+        if (line.size() < h + hex_length + 2 || line.find_first_not_of("0123456789abcdefABCDEF", h) != h + hex_length
+            || line[h + hex_length] != ' ' || (line[h + hex_length + 1] != ' ' && line[h + hex_length + 1] != '*'))
+        {
+            malformed++;
+            continue;
+        }
+
+        std::string expected = line.substr(h, hex_length);
+        std::string name     = line.substr(h + hex_length + 2);
+        if (escaped) name = unescape(name);
+        for (auto& ch : expected) ch = static_cast<char>((ch >= 'A' && ch <= 'F') ? ch - 'A' + 'a' : ch);
+
+        //Hash and compare
+        sha256::byte digest[sha256::digest_length];
+        char         hex[2 * sha256::digest_length + 1];
+        if (!hash(name.c_str(), s, st, digest))
+        {
+            if (!s.status) std::fprintf(stderr, "sha256sum: %s: %s\n", name.c_str(), std::strerror(errno));
+            if (!s.status) std::printf("%s: FAILED open or read\n", name.c_str());
+            unreadable++;
+            continue;
+        }
+        to_hex(digest, hex);
+
+        verified++;
+        if (expected != hex)
+        {
+            mismatched++;
+            if (!s.status) std::printf("%s: FAILED\n", name.c_str());
+        }
+        else if (!s.quiet && !s.status)
+        {
+            std::printf("%s: OK\n", name.c_str());
+        }
+    }
+
+    if (!use_stdin) std::fclose(f);
+
+    //Summarize like coreutils
+    if (!s.status)
+    {
+        if (malformed)  std::fprintf(stderr, "sha256sum: WARNING: %llu line%s improperly formatted\n", static_cast<unsigned long long>(malformed), malformed == 1 ? " is" : "s are");
+        if (unreadable) std::fprintf(stderr, "sha256sum: WARNING: %llu listed file%s could not be read\n", static_cast<unsigned long long>(unreadable), unreadable == 1 ? "" : "s");
+        if (mismatched) std::fprintf(stderr, "sha256sum: WARNING: %llu computed checksum%s did NOT match\n", static_cast<unsigned long long>(mismatched), mismatched == 1 ? "" : "s");
+    }
+    if (verified == 0 && unreadable == 0)
+    {
+        std::fprintf(stderr, "sha256sum: %s: no properly formatted checksum lines found\n", list);
+        return false;
+    }
+
+    return mismatched == 0 && unreadable == 0;
+}
+
+int main(int argc, char** argv)
+{
+    settings s;
+    s.io = sha256_file::default_options();
+
+    //Parse the options, leaving the files in argv
+    int  files      = 0;
+    bool no_options = false;
+    for (int i = 1; i < argc; i++)
+    {
+        char const* arg = argv[i];
+        if (no_options || arg[0] != '-' || arg[1] == '\0')
+        {
+            argv[1 + files++] = argv[i];
+            continue;
+        }
+
+        if      (!std::strcmp(arg, "--"))                                    no_options = true;
+        else if (!std::strcmp(arg, "-c") || !std::strcmp(arg, "--check"))   s.check = true;
+        else if (!std::strcmp(arg, "-b") || !std::strcmp(arg, "--binary"))  continue;
+        else if (!std::strcmp(arg, "-t") || !std::strcmp(arg, "--text"))    continue;
+        else if (!std::strcmp(arg, "--quiet"))                               s.quiet = true;
+        else if (!std::strcmp(arg, "--status"))                              s.status = true;
+        else if (!std::strcmp(arg, "--drop-cache"))                          s.io.drop_cache = true;
+        else if (!std::strcmp(arg, "--stats"))                               s.stats = true;
+        else if (!std::strcmp(arg, "-h") || !std::strcmp(arg, "--help"))
+        {
+            usage(stdout);
+            return EXIT_SUCCESS;
+        }
+        else if (!std::strncmp(arg, "--mode=", 7))
+        {
+            char const* m = arg + 7;
+            if      (!std::strcmp(m, "auto"))   s.io.io_mode = sha256_file::mode::automatic;
+            else if (!std::strcmp(m, "read"))   s.io.io_mode = sha256_file::mode::read;
+            else if (!std::strcmp(m, "mmap"))   s.io.io_mode = sha256_file::mode::mmap;
+            else if (!std::strcmp(m, "direct")) s.io.io_mode = sha256_file::mode::direct;
+            else
+            {
+                std::fprintf(stderr, "sha256sum: invalid mode '%s'\n", m);
+                return EXIT_FAILURE;
+            }
+        }
+        else if (!std::strncmp(arg, "--buffer=", 9))
+        {
+            if (!parse_size(arg + 9, &s.io.buffer_size))
+            {
+                std::fprintf(stderr, "sha256sum: invalid buffer size '%s'\n", arg + 9);
+                return EXIT_FAILURE;
+            }
+        }
+        else
+        {
+            std::fprintf(stderr, "sha256sum: unrecognized option '%s'\n", arg);
+            usage(stderr);
+            return EXIT_FAILURE;
+        }
+    }
+
+    //Default to standard input
+    static char dash[] = "-";
+    if (files == 0) argv[1 + files++] = dash;
+
+    bool       ok = true;
+    statistics st;
+    for (int i = 1; i <= files; i++)
+    {
+        if (s.check)
+        {
+            ok = check_file(argv[i], s, st) && ok;
+            continue;
+        }
+
+        sha256::byte digest[sha256::digest_length];
+        if (!hash(argv[i], s, st, digest))
+        {
+            std::fprintf(stderr, "sha256sum: %s: %s\n", argv[i], std::strerror(errno));
+            ok = false;
+            continue;
+        }
+
+        char hex[2 * sha256::digest_length + 1];
+        to_hex(digest, hex);
+        print_line(hex, argv[i]);
+    }
+
+    if (s.stats)
+    {
+        double const gb = static_cast<double>(st.bytes) / 1e9;
+        std::fprintf(stderr, "sha256sum: %.3f GB in %.3f s, %.3f GB/s\n", gb, st.seconds, st.seconds > 0 ? gb / st.seconds : 0.0);
+    }
+
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
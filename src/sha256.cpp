@@ -27,18 +27,19 @@
 
 #if !defined(BKH_SHA256_NO_CASSERT) && (defined(DEBUG) || defined(_DEBUG) || defined(DBG))
 #    include <cassert>
+#    define BKH_ASSERT(x) assert(x)
 #else
-#    define assert(x) static_cast<void>(!!(x))
+#    define BKH_ASSERT(x) static_cast<void>(!!(x))
 #endif
 
-#if defined(__has_attribute)
-#    if __has_attribute(const)
-#        define BKH_PURE __attribute__((const))
-#    endif
-#endif
-
-#if !defined(BKH_PURE)
-#    define BKH_PURE
+#if defined(BKH_SHA256_HEADER_ONLY)
+#    define BKH_INTERNAL        inline
+#    define BKH_INTERNAL_INLINE inline
+#    define BKH_SHA256_INLINE   inline
+#else
+#    define BKH_INTERNAL        static
+#    define BKH_INTERNAL_INLINE static inline
+#    define BKH_SHA256_INLINE
 #endif
 
 #define BKH_RESTRICT __restrict
@@ -51,401 +52,1912 @@
 #    endif
 #endif
 
+//Remember which of these are ours, so header-only mode can remove them again
 #if !defined(LITTLE_ENDIAN)
 #    define LITTLE_ENDIAN 1234
+#    define BKH_SHA256_DEFINED_LITTLE_ENDIAN
 #endif
 
 #if !defined(BIG_ENDIAN)
 #    define BIG_ENDIAN 4321
+#    define BKH_SHA256_DEFINED_BIG_ENDIAN
 #endif
 
 #if defined(WIN32) || defined(_WIN32) || defined(__WIN32)
 #    if !defined(BYTE_ORDER)
 #        define BYTE_ORDER LITTLE_ENDIAN
+#        define BKH_SHA256_DEFINED_BYTE_ORDER
 #    endif
 #endif
 
 #if !defined(BYTE_ORDER)
-#    pragma message("Warning: Byte order is not defined! Assuming little-endian")
+#    if !defined(BKH_SHA256_HEADER_ONLY)
+#        pragma message("Warning: Byte order is not defined! Assuming little-endian")
+#    endif
 #    define BYTE_ORDER LITTLE_ENDIAN
+#    define BKH_SHA256_DEFINED_BYTE_ORDER
+#endif
+
+#if !defined(BKH_SHA256_NO_INTRINSICS)
+#    if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#        define BKH_SHA256_X86 1
+#    endif
+#endif
+
+#if defined(BKH_SHA256_X86)
+#    if defined(_MSC_VER) && !defined(__clang__)
+#        include <intrin.h>
+#        define BKH_TARGET(x)
+#    else
+#        include <immintrin.h>
+#        include <cpuid.h>
+#        define BKH_TARGET(x) __attribute__((target(x)))
+#    endif
+#endif
+
+#if defined(BKH_SHA256_INSTRUMENT) && defined(_MSC_VER) && !defined(__clang__)
+#    include <intrin.h>
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#    define BKH_ALWAYS_INLINE __attribute__((always_inline))
+#else
+#    define BKH_ALWAYS_INLINE
 #endif
 
-/* Types defined for SHA-256 */
+#if defined(__GNUC__) || defined(__clang__)
+#    define BKH_PREFETCH(p) __builtin_prefetch(p)
+#elif defined(BKH_SHA256_X86)
+#    define BKH_PREFETCH(p) _mm_prefetch(reinterpret_cast<char const*>(p), _MM_HINT_T0)
+#else
+#    define BKH_PREFETCH(p) static_cast<void>(p)
+#endif
+
+/**
+ * The internals share the namespace of the constexpr building
+ * blocks in sha256.h. In header-only mode they have inline rather
+ * than internal linkage, such that every translation unit shares
+ * the same backend selection.
+ */
+namespace bkh::sha256_detail
+{
+
+/* Constants defined for SHA-256 */
+
+/**
+ * These 64 constant words are used in the transform
+ * and represent the first 32 bits of the fractional
+ * parts of the cube roots of the first 64 prime
+ * numbers. They live in the header, where they are
+ * needed by the constexpr hashing.
+ */
+BKH_INTERNAL constexpr auto const& sha256_hash_constants = sha256::round_constants;
+
+/**
+ * These 8 constant words are the initial hash value
+ * used in SHA-256 and were obtained by taking the
+ * first 32 bits of the fractional parts of the
+ * square roots of the first eight prime numbers.
+ * Like the above they live in the header.
+ */
+BKH_INTERNAL constexpr auto const& sha256_initial_hash_value = sha256::initial_hash_value;
+
+/* Helpers */
 
-using byte = bkh::sha256::byte;
-using word = bkh::sha256::word;
+using bkh::u64;
 
-/* Operations defined for SHA-256 */
+/**
+ * Performs an unchecked copy of data from one buffer
+ * to another. Buffers may not overlap.
+ */
+BKH_INTERNAL void unsafe_copy(byte* BKH_RESTRICT dst, byte const* BKH_RESTRICT src, u64 count) noexcept
+{
+    for (u64 i = 0; i < count; i++)
+    {
+        dst[i] = src[i];
+    }
+}
 
 /**
- * Discards the right-most n bits of the word and pads the result
- * with n zero bits on the left.
+ * Writes an unsigned 64-bit value into an array as a
+ * sequence of bytes in big-endian byte order.
  */
-BKH_PURE static constexpr word right_shift(word x, byte n) noexcept
+BKH_INTERNAL void write_be_u64(byte* ptr, u64 value) noexcept
 {
-    constexpr byte const w = sizeof(word) * 8;
+#if (BYTE_ORDER == LITTLE_ENDIAN)
+    *reinterpret_cast<u64*>(ptr) = 
+        ((value & 0x00000000000000FFull) << 56u) |
+        ((value & 0x000000000000FF00ull) << 40u) |
+        ((value & 0x0000000000FF0000ull) << 24u) |
+        ((value & 0x00000000FF000000ull) <<  8u) |
+        ((value & 0x000000FF00000000ull) >>  8u) |
+        ((value & 0x0000FF0000000000ull) >> 24u) |
+        ((value & 0x00FF000000000000ull) >> 40u) |
+        ((value & 0xFF00000000000000ull) >> 56u);
+#else
+    *reinterpret_cast<u64*>(ptr) = value;
+#endif
+}
 
-    assert(n < w);
+/**
+ * Writes the intermediate hash value to the buffer as a
+ * message digest, inserting the words in big-endian order.
+ */
+BKH_INTERNAL void store_digest(word const* state, byte* result_buffer) noexcept
+{
+    //Iterate over the words
+    for (int i = 0; i < 8; i++)
+    {
+        //Read the word
+        word const &w = state[i];
 
-    return static_cast<word>(x >> n);
+        //Insert the bytes in big-endian order
+        result_buffer[i * 4 + 0] = static_cast<byte>((w & 0xFF000000u) >> 24u);
+        result_buffer[i * 4 + 1] = static_cast<byte>((w & 0x00FF0000u) >> 16u);
+        result_buffer[i * 4 + 2] = static_cast<byte>((w & 0x0000FF00u) >>  8u);
+        result_buffer[i * 4 + 3] = static_cast<byte>((w & 0x000000FFu) >>  0u);
+    }
 }
 
 /**
- * Discards the left-most n bits of the word and pads the result
- * with n zero bits on the right.
+ * The version of the checkpoint format written by the hasher,
+ * and how many bytes of its digest protect it.
+ */
+BKH_INTERNAL constexpr byte const checkpoint_version      = 1;
+BKH_INTERNAL constexpr int const  checkpoint_check_length = 8;
+
+/**
+ * How many bytes ahead of the current block the transform
+ * requests data when processing a run of blocks.
+ */
+BKH_INTERNAL constexpr int const prefetch_distance = 4 * bkh::sha256::block_length;
+
+/* Backends */
+
+/**
+ * Performs a single round of the transform, where `wk` is the
+ * sum of the message schedule word and the round constant. Only
+ * the two variables that change are written, so consecutive
+ * rounds are expressed by rotating the roles of the variables
+ * instead of shifting their values.
  */
-BKH_PURE static constexpr word left_shift(word x, byte n) noexcept
+BKH_INTERNAL_INLINE void round_wk(word a, word b, word c, word& d, word e, word f, word g, word& h, word wk) noexcept
 {
-    constexpr byte const w = sizeof(word) * 8;
+    word const T1 = h + F3(e) + F0(e, f, g) + wk;
+    word const T2 = F2(a) + F1(a, b, c);
 
-    assert(n < w);
+    d += T1;
+    h  = T1 + T2;
+}
 
-    return static_cast<word>(x << n);
+/**
+ * Performs four consecutive rounds of the transform, where the
+ * variables are passed in their current roles. Calling it again
+ * with the roles (e, f, g, h, a, b, c, d) performs the next four
+ * rounds, after which the roles are back where they started.
+ */
+BKH_INTERNAL_INLINE void rounds_wk4(word& a, word& b, word& c, word& d, word& e, word& f, word& g, word& h, word const* wk) noexcept
+{
+    round_wk(a, b, c, d, e, f, g, h, wk[0]);
+    round_wk(h, a, b, c, d, e, f, g, wk[1]);
+    round_wk(g, h, a, b, c, d, e, f, wk[2]);
+    round_wk(f, g, h, a, b, c, d, e, wk[3]);
 }
 
 /**
- * Performs the bitwise-and operation, where each bit in the result
- * is 1 if both words have a 1 in the same location, otherwise it
- * is 0.
+ * Reads a word of the message in big-endian byte order.
  */
-BKH_PURE static constexpr word bitwise_and(word lhs, word rhs) noexcept
+BKH_INTERNAL_INLINE word load_be_word(word const* p) noexcept
 {
-    return lhs & rhs;
+#if (BYTE_ORDER == LITTLE_ENDIAN)
+    return ((*p & 0x000000FFu) << 24u) |
+           ((*p & 0x0000FF00u) <<  8u) |
+           ((*p & 0x00FF0000u) >>  8u) |
+           ((*p & 0xFF000000u) >> 24u);
+#else
+    return *p;
+#endif
 }
 
+#if !defined(BKH_SHA256_COMPACT)
+
 /**
- * Performs the bitwise-or ("inclusive-or") operation, where each
- * bit in the result is 1 if either word has a 1 in the same
- * location, otherwise it is 0.
+ * Performs round t of the transform. The working variables are
+ * kept in `v`, where the variable in the role of a in round t is
+ * v[-t mod 8], such that the roles rotate rather than the values.
+ * The message schedule is kept in a window of the last sixteen
+ * words in `W`, where word t replaces word t - 16, and the round
+ * constant is folded in at compile time. With t known at compile
+ * time every index is a constant, which lets the compiler keep
+ * both arrays in registers, provided every round is inlined.
  */
-BKH_PURE static constexpr word bitwise_or(word lhs, word rhs) noexcept
+template <int t>
+BKH_ALWAYS_INLINE BKH_INTERNAL_INLINE void scalar_round(word* v, word* W, word const* M) noexcept
 {
-    return lhs | rhs;
+    //Read or expand the message schedule word
+    word w;
+    if constexpr (t < 16)
+    {
+        w = W[t] = load_be_word(M + t);
+    }
+    else
+    {
+        w = W[t & 15] += F5(W[(t - 2) & 15]) + W[(t - 7) & 15] + F4(W[(t - 15) & 15]);
+    }
+
+    constexpr word k = sha256_hash_constants[t];
+    round_wk(v[(0 - t) & 7], v[(1 - t) & 7], v[(2 - t) & 7], v[(3 - t) & 7],
+             v[(4 - t) & 7], v[(5 - t) & 7], v[(6 - t) & 7], v[(7 - t) & 7], w + k);
 }
 
 /**
- * Performs the bitwise-xor ("exclusive-or") operation, where each
- * bit in the result is 1 if only one word has a 1 in the same
- * location, otherwise it is 0.
+ * Performs rounds t through 63 of the transform, fully unrolled.
  */
-BKH_PURE static constexpr word bitwise_xor(word lhs, word rhs) noexcept
+template <int t>
+BKH_ALWAYS_INLINE BKH_INTERNAL_INLINE void scalar_rounds(word* v, word* W, word const* M) noexcept
 {
-    return lhs ^ rhs;
+    scalar_round<t>(v, W, M);
+    if constexpr (t < 63) scalar_rounds<t + 1>(v, W, M);
 }
 
+#endif
+
 /**
- * Performs the bitwise-complement operation, where each bit in
- * the result is the opposite of what is in the input.
+ * The portable implementation of the SHA-256 transform, which
+ * processes `count` consecutive blocks and updates the
+ * intermediate hash value in `state`. Always available.
+ * The 64 rounds are unrolled, which makes it several times
+ * larger, so defining BKH_SHA256_COMPACT keeps them in a loop
+ * for targets where code size matters more.
  */
-BKH_PURE static constexpr word bitwise_complement(word x) noexcept
+BKH_INTERNAL void transform_scalar(word* BKH_RESTRICT state, byte const* BKH_RESTRICT data, u64 count) noexcept
 {
-    return ~x;
+    //Keep the intermediate hash value in locals across the blocks
+    word s0 = state[0],
+         s1 = state[1],
+         s2 = state[2],
+         s3 = state[3],
+         s4 = state[4],
+         s5 = state[5],
+         s6 = state[6],
+         s7 = state[7];
+
+    //Iterate over the blocks
+    for (byte const* end = data + count * bkh::sha256::block_length; data != end; data += bkh::sha256::block_length)
+    {
+        //Request the upcoming data early
+        BKH_PREFETCH(data + prefetch_distance);
+
+        //Treat the input as words
+        word const* M = reinterpret_cast<word const*>(data);
+
+#if !defined(BKH_SHA256_COMPACT)
+        //Initialize our eight working variables with previous state
+        word v[8] = { s0, s1, s2, s3, s4, s5, s6, s7 };
+        word W[16];
+
+        //Perform the main transformation, after 64 rounds the roles are back where they started
+        scalar_rounds<0>(v, W, M);
+
+        //Calculate the intermediate hash value
+        s0 += v[0];
+        s1 += v[1];
+        s2 += v[2];
+        s3 += v[3];
+        s4 += v[4];
+        s5 += v[5];
+        s6 += v[6];
+        s7 += v[7];
+#else
+        //Initialize our eight working variables with previous state
+        word a = s0,
+             b = s1,
+             c = s2,
+             d = s3,
+             e = s4,
+             f = s5,
+             g = s6,
+             h = s7;
+
+        //Prepare the message schedule W
+        word W[64];
+        for (int t = 0; t < 16; t++)
+        {
+            W[t] = load_be_word(M + t);
+        }
+        for (int t = 16; t < 64; t++)
+        {
+            W[t] = F5(W[t - 2]) + W[t - 7] + F4(W[t - 15]) + W[t - 16];
+        }
+
+        //Perform the main transformation
+        for (int t = 0; t < 64; t++)
+        {
+            word T1 = h + F3(e) + F0(e, f, g) + sha256_hash_constants[t] + W[t];
+            word T2 = F2(a) + F1(a, b, c);
+
+            h = g;
+            g = f;
+            f = e;
+            e = d + T1;
+            d = c;
+            c = b;
+            b = a;
+            a = T1 + T2;
+        }
+
+        //Calculate the intermediate hash value
+        s0 += a;
+        s1 += b;
+        s2 += c;
+        s3 += d;
+        s4 += e;
+        s5 += f;
+        s6 += g;
+        s7 += h;
+#endif
+    }
+
+    //Write back the result
+    state[0] = s0;
+    state[1] = s1;
+    state[2] = s2;
+    state[3] = s3;
+    state[4] = s4;
+    state[5] = s5;
+    state[6] = s6;
+    state[7] = s7;
 }
 
+#if defined(BKH_SHA256_X86)
+
 /**
- * Performs the rotate right (circular right shift) operation,
- * which is defined as: right_rotate(x, n) := 
- *     bitwise_or(right_shift(x, n), left_shift(x, w - n))
- * where w is the number of bits in a word.
- * The operation is thus equivalent to a circular shift
- * of x by n positions to the right.
+ * Performs four rounds of the transform using the SHA extensions,
+ * where `wk` holds the next four words of the message schedule
+ * with the round constants added. The state is split across two
+ * registers as required by the SHA256RNDS2 instruction, holding
+ * ABEF and CDGH respectively.
  */
-BKH_PURE static constexpr word right_rotate(word x, byte n) noexcept
+BKH_TARGET("sha,sse4.1")
+BKH_INTERNAL_INLINE void shani_rounds_wk(__m128i& abef, __m128i& cdgh, __m128i wk) noexcept
 {
-    constexpr byte const w = sizeof(word) * 8;
+    //Each instruction performs two rounds
+    cdgh = _mm_sha256rnds2_epu32(cdgh, abef, wk);
+    wk   = _mm_shuffle_epi32(wk, 0x0E);
+    abef = _mm_sha256rnds2_epu32(abef, cdgh, wk);
+}
 
-    word const rs = right_shift(x, n);
-    word const ls = left_shift (x, w - n);
+/**
+ * Same as shani_rounds_wk, but takes the message schedule words
+ * of rounds t through t + 3 without the round constants.
+ */
+BKH_TARGET("sha,sse4.1")
+BKH_INTERNAL_INLINE void shani_rounds(__m128i& abef, __m128i& cdgh, __m128i msg, int t) noexcept
+{
+    //Add the round constants
+    __m128i const k = _mm_loadu_si128(reinterpret_cast<__m128i const*>(sha256_hash_constants + t));
 
-    return bitwise_or(rs, ls);
+    shani_rounds_wk(abef, cdgh, _mm_add_epi32(msg, k));
 }
 
-/* Functions defined for SHA-256 */
+/**
+ * Computes the next four words of the message schedule from the
+ * previous sixteen words, which are held in w0 through w3 with
+ * w0 being the oldest.
+ */
+BKH_TARGET("sha,sse4.1")
+BKH_INTERNAL_INLINE __m128i shani_schedule(__m128i w0, __m128i w1, __m128i w2, __m128i w3) noexcept
+{
+    __m128i const t0 = _mm_sha256msg1_epu32(w0, w1);
+    __m128i const t1 = _mm_add_epi32(t0, _mm_alignr_epi8(w3, w2, 4));
+
+    return _mm_sha256msg2_epu32(t1, w3);
+}
 
 /**
- * The first of six logical functions defined for SHA-256.
- * Referred to as "Ch" in the specification.
+ * An implementation of the SHA-256 transform using the Intel SHA
+ * extensions (SHA256RNDS2, SHA256MSG1 and SHA256MSG2), which
+ * processes `count` consecutive blocks. Requires SSE4.1 for the
+ * shuffling of the state.
  */
-BKH_PURE static constexpr word F0(word x, word y, word z) noexcept
+BKH_TARGET("sha,sse4.1")
+BKH_INTERNAL void transform_shani(word* BKH_RESTRICT state, byte const* BKH_RESTRICT data, u64 count) noexcept
 {
-    word const l = bitwise_and(x, y);
-    word const r = bitwise_and(bitwise_complement(x), z);
+    //Used to convert the big-endian message words
+    __m128i const bswap = _mm_set_epi64x(0x0C0D0E0F08090A0Bll, 0x0405060700010203ll);
+
+    //Load the state and rearrange it into ABEF and CDGH
+    __m128i       abcd = _mm_loadu_si128(reinterpret_cast<__m128i const*>(state + 0));
+    __m128i       efgh = _mm_loadu_si128(reinterpret_cast<__m128i const*>(state + 4));
+    __m128i const cdab = _mm_shuffle_epi32(abcd, 0xB1);
+    __m128i const hgfe = _mm_shuffle_epi32(efgh, 0x1B);
+    __m128i       abef = _mm_alignr_epi8(cdab, hgfe, 8);
+    __m128i       cdgh = _mm_blend_epi16(hgfe, cdab, 0xF0);
+
+    //Iterate over the blocks
+    for (byte const* end = data + count * bkh::sha256::block_length; data != end; data += bkh::sha256::block_length)
+    {
+        //Request the upcoming data early
+        BKH_PREFETCH(data + prefetch_distance);
+
+        //Save the previous state
+        __m128i const abef_prev = abef;
+        __m128i const cdgh_prev = cdgh;
+
+        //Load the message
+        auto const* M = reinterpret_cast<__m128i const*>(data);
+        __m128i w0 = _mm_shuffle_epi8(_mm_loadu_si128(M + 0), bswap);
+        __m128i w1 = _mm_shuffle_epi8(_mm_loadu_si128(M + 1), bswap);
+        __m128i w2 = _mm_shuffle_epi8(_mm_loadu_si128(M + 2), bswap);
+        __m128i w3 = _mm_shuffle_epi8(_mm_loadu_si128(M + 3), bswap);
+
+        //Perform the main transformation, scheduling four words ahead
+        shani_rounds(abef, cdgh, w0,  0); w0 = shani_schedule(w0, w1, w2, w3);
+        shani_rounds(abef, cdgh, w1,  4); w1 = shani_schedule(w1, w2, w3, w0);
+        shani_rounds(abef, cdgh, w2,  8); w2 = shani_schedule(w2, w3, w0, w1);
+        shani_rounds(abef, cdgh, w3, 12); w3 = shani_schedule(w3, w0, w1, w2);
+        shani_rounds(abef, cdgh, w0, 16); w0 = shani_schedule(w0, w1, w2, w3);
+        shani_rounds(abef, cdgh, w1, 20); w1 = shani_schedule(w1, w2, w3, w0);
+        shani_rounds(abef, cdgh, w2, 24); w2 = shani_schedule(w2, w3, w0, w1);
+        shani_rounds(abef, cdgh, w3, 28); w3 = shani_schedule(w3, w0, w1, w2);
+        shani_rounds(abef, cdgh, w0, 32); w0 = shani_schedule(w0, w1, w2, w3);
+        shani_rounds(abef, cdgh, w1, 36); w1 = shani_schedule(w1, w2, w3, w0);
+        shani_rounds(abef, cdgh, w2, 40); w2 = shani_schedule(w2, w3, w0, w1);
+        shani_rounds(abef, cdgh, w3, 44); w3 = shani_schedule(w3, w0, w1, w2);
+        shani_rounds(abef, cdgh, w0, 48);
+        shani_rounds(abef, cdgh, w1, 52);
+        shani_rounds(abef, cdgh, w2, 56);
+        shani_rounds(abef, cdgh, w3, 60);
+
+        //Calculate the intermediate hash value
+        abef = _mm_add_epi32(abef, abef_prev);
+        cdgh = _mm_add_epi32(cdgh, cdgh_prev);
+    }
 
-    return bitwise_xor(l, r);
+    //Rearrange back into ABCD and EFGH and store it
+    __m128i const feba = _mm_shuffle_epi32(abef, 0x1B);
+    __m128i const dchg = _mm_shuffle_epi32(cdgh, 0xB1);
+    abcd = _mm_blend_epi16(feba, dchg, 0xF0);
+    efgh = _mm_alignr_epi8(dchg, feba, 8);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 0), abcd);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), efgh);
 }
 
 /**
- * The second of six logical functions defined for SHA-256.
- * Referred to as "Maj" in the specification.
+ * Performs the transform of a prepared block using the SHA
+ * extensions, where `wk` holds the whole message schedule with
+ * the round constants added.
  */
-BKH_PURE static constexpr word F1(word x, word y, word z) noexcept
+BKH_TARGET("sha,sse4.1")
+BKH_INTERNAL void transform_shani_prepared(word* BKH_RESTRICT state, word const* BKH_RESTRICT wk) noexcept
 {
-    word const t0 = bitwise_and(x, y);
-    word const t1 = bitwise_and(x, z);
-    word const t2 = bitwise_and(y, z);
+    //Load the state and rearrange it into ABEF and CDGH
+    __m128i       abcd = _mm_loadu_si128(reinterpret_cast<__m128i const*>(state + 0));
+    __m128i       efgh = _mm_loadu_si128(reinterpret_cast<__m128i const*>(state + 4));
+    __m128i const cdab = _mm_shuffle_epi32(abcd, 0xB1);
+    __m128i const hgfe = _mm_shuffle_epi32(efgh, 0x1B);
+    __m128i       abef = _mm_alignr_epi8(cdab, hgfe, 8);
+    __m128i       cdgh = _mm_blend_epi16(hgfe, cdab, 0xF0);
+
+    //Save the previous state
+    __m128i const abef_prev = abef;
+    __m128i const cdgh_prev = cdgh;
+
+    //Perform the rounds
+    for (int t = 0; t < 64; t += 4)
+    {
+        shani_rounds_wk(abef, cdgh, _mm_loadu_si128(reinterpret_cast<__m128i const*>(wk + t)));
+    }
 
-    return bitwise_xor
-    (
-        bitwise_xor(t0, t1),
-        t2
-    );
+    //Calculate the intermediate hash value
+    abef = _mm_add_epi32(abef, abef_prev);
+    cdgh = _mm_add_epi32(cdgh, cdgh_prev);
+
+    //Rearrange back into ABCD and EFGH and store it
+    __m128i const feba = _mm_shuffle_epi32(abef, 0x1B);
+    __m128i const dchg = _mm_shuffle_epi32(cdgh, 0xB1);
+    abcd = _mm_blend_epi16(feba, dchg, 0xF0);
+    efgh = _mm_alignr_epi8(dchg, feba, 8);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 0), abcd);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), efgh);
+}
+
+#endif
+
+/**
+ * The portable implementation of the transform of a prepared
+ * block, where `wk` holds the whole message schedule with the
+ * round constants added.
+ */
+BKH_INTERNAL void transform_prepared_scalar(word* BKH_RESTRICT state, word const* BKH_RESTRICT wk) noexcept
+{
+    //Initialize our eight working variables with previous state
+    word a = state[0],
+         b = state[1],
+         c = state[2],
+         d = state[3],
+         e = state[4],
+         f = state[5],
+         g = state[6],
+         h = state[7];
+
+    //Perform the rounds
+    for (int t = 0; t < 64; t += 8)
+    {
+        rounds_wk4(a, b, c, d, e, f, g, h, wk + t);
+        rounds_wk4(e, f, g, h, a, b, c, d, wk + t + 4);
+    }
+
+    //Calculate the intermediate hash value
+    state[0] += a;
+    state[1] += b;
+    state[2] += c;
+    state[3] += d;
+    state[4] += e;
+    state[5] += f;
+    state[6] += g;
+    state[7] += h;
 }
 
+#if defined(BKH_SHA256_X86)
+
 /**
- * The third of six logical functions defined for SHA-256.
- * Referred to as "Sigma0" in the specification.
+ * Rotates each word of the vector right by n bits.
  */
-BKH_PURE static constexpr word F2(word x) noexcept
+template <int n>
+BKH_TARGET("ssse3")
+BKH_INTERNAL_INLINE __m128i sse_rotate(__m128i x) noexcept
 {
-    word const t0 = right_rotate(x,  2);
-    word const t1 = right_rotate(x, 13);
-    word const t2 = right_rotate(x, 22);
+    return _mm_or_si128(_mm_srli_epi32(x, n), _mm_slli_epi32(x, 32 - n));
+}
 
-    return bitwise_xor
+/**
+ * Adds sigma1 of each word of w2 to the words of v. Lanes of w2
+ * which are zero add nothing, since sigma1 of zero is zero.
+ */
+BKH_TARGET("ssse3")
+BKH_INTERNAL_INLINE __m128i sse_add_sigma1(__m128i v, __m128i w2) noexcept
+{
+    __m128i const s1 = _mm_xor_si128
     (
-        bitwise_xor(t0, t1),
-        t2
+        _mm_xor_si128(sse_rotate<17>(w2), sse_rotate<19>(w2)),
+        _mm_srli_epi32(w2, 10)
     );
+
+    return _mm_add_epi32(v, s1);
 }
 
 /**
- * The fourth of six logical functions defined for SHA-256.
- * Referred to as "Sigma1" in the specification.
+ * Computes the next four words of the message schedule from the
+ * previous sixteen words, which are held in x0 through x3 with
+ * x0 being the oldest. The sigma1 terms of the last two words
+ * depend on the first two, so those are computed in two steps.
  */
-BKH_PURE static constexpr word F3(word x) noexcept
+BKH_TARGET("ssse3")
+BKH_INTERNAL_INLINE __m128i sse_schedule(__m128i x0, __m128i x1, __m128i x2, __m128i x3) noexcept
 {
-    word const t0 = right_rotate(x,  6);
-    word const t1 = right_rotate(x, 11);
-    word const t2 = right_rotate(x, 25);
+    //W[t - 15] and W[t - 7]
+    __m128i const w15 = _mm_alignr_epi8(x1, x0, 4);
+    __m128i const w7  = _mm_alignr_epi8(x3, x2, 4);
 
-    return bitwise_xor
+    //W[t - 16] + sigma0(W[t - 15]) + W[t - 7]
+    __m128i const s0 = _mm_xor_si128
     (
-        bitwise_xor(t0, t1),
-        t2
+        _mm_xor_si128(sse_rotate<7>(w15), sse_rotate<18>(w15)),
+        _mm_srli_epi32(w15, 3)
     );
+    __m128i x = _mm_add_epi32(_mm_add_epi32(x0, s0), w7);
+
+    //Complete the first two words using the last two of x3, then the last two words
+    x = sse_add_sigma1(x, _mm_srli_si128(x3, 8));
+    x = sse_add_sigma1(x, _mm_slli_si128(x,  8));
+
+    return x;
+}
+
+/**
+ * Adds the round constants to four words of the message schedule
+ * starting at word t, and stores the result in wk.
+ */
+BKH_TARGET("ssse3")
+BKH_INTERNAL_INLINE void sse_store_wk(word* wk, int t, __m128i x) noexcept
+{
+    __m128i const k = _mm_loadu_si128(reinterpret_cast<__m128i const*>(sha256_hash_constants + t));
+    _mm_store_si128(reinterpret_cast<__m128i*>(wk + t), _mm_add_epi32(x, k));
+}
+
+/**
+ * An implementation of the SHA-256 transform which computes the
+ * message schedule four words at a time using SSSE3, while the
+ * rounds themselves are performed on scalar registers. The
+ * schedule is kept sixteen words ahead of the rounds, such that
+ * the two can be interleaved by the CPU.
+ */
+BKH_TARGET("ssse3")
+BKH_INTERNAL void transform_ssse3(word* BKH_RESTRICT state, byte const* BKH_RESTRICT data, u64 count) noexcept
+{
+    //Used to convert the big-endian message words
+    __m128i const bswap = _mm_set_epi64x(0x0C0D0E0F08090A0Bll, 0x0405060700010203ll);
+
+    //The message schedule with the round constants added
+    alignas(16) word wk[64];
+
+    //Keep the intermediate hash value in locals across the blocks
+    word s0 = state[0],
+         s1 = state[1],
+         s2 = state[2],
+         s3 = state[3],
+         s4 = state[4],
+         s5 = state[5],
+         s6 = state[6],
+         s7 = state[7];
+
+    //Iterate over the blocks
+    for (byte const* end = data + count * bkh::sha256::block_length; data != end; data += bkh::sha256::block_length)
+    {
+        //Request the upcoming data early
+        BKH_PREFETCH(data + prefetch_distance);
+
+        //Load the message
+        auto const* M = reinterpret_cast<__m128i const*>(data);
+        __m128i x0 = _mm_shuffle_epi8(_mm_loadu_si128(M + 0), bswap);
+        __m128i x1 = _mm_shuffle_epi8(_mm_loadu_si128(M + 1), bswap);
+        __m128i x2 = _mm_shuffle_epi8(_mm_loadu_si128(M + 2), bswap);
+        __m128i x3 = _mm_shuffle_epi8(_mm_loadu_si128(M + 3), bswap);
+        sse_store_wk(wk,  0, x0);
+        sse_store_wk(wk,  4, x1);
+        sse_store_wk(wk,  8, x2);
+        sse_store_wk(wk, 12, x3);
+
+        //Initialize our eight working variables with previous state
+        word a = s0,
+             b = s1,
+             c = s2,
+             d = s3,
+             e = s4,
+             f = s5,
+             g = s6,
+             h = s7;
+
+        //Perform the rounds while extending the schedule
+        for (int t = 0; t < 48; t += 8)
+        {
+            x0 = sse_schedule(x0, x1, x2, x3);
+            sse_store_wk(wk, t + 16, x0);
+            rounds_wk4(a, b, c, d, e, f, g, h, wk + t);
+
+            x1 = sse_schedule(x1, x2, x3, x0);
+            sse_store_wk(wk, t + 20, x1);
+            rounds_wk4(e, f, g, h, a, b, c, d, wk + t + 4);
+
+            //Restore the order of the schedule
+            __m128i const y0 = x0, y1 = x1;
+            x0 = x2;
+            x1 = x3;
+            x2 = y0;
+            x3 = y1;
+        }
+
+        //Perform the remaining rounds
+        for (int t = 48; t < 64; t += 8)
+        {
+            rounds_wk4(a, b, c, d, e, f, g, h, wk + t);
+            rounds_wk4(e, f, g, h, a, b, c, d, wk + t + 4);
+        }
+
+        //Calculate the intermediate hash value
+        s0 += a;
+        s1 += b;
+        s2 += c;
+        s3 += d;
+        s4 += e;
+        s5 += f;
+        s6 += g;
+        s7 += h;
+    }
+
+    //Write back the result
+    state[0] = s0;
+    state[1] = s1;
+    state[2] = s2;
+    state[3] = s3;
+    state[4] = s4;
+    state[5] = s5;
+    state[6] = s6;
+    state[7] = s7;
 }
 
 /**
- * The fifth of six logical functions defined for SHA-256.
- * Referred to as "sigma0" in the specification.
+ * Rotates each word of the vector right by n bits.
  */
-BKH_PURE static constexpr word F4(word x) noexcept
+template <int n>
+BKH_TARGET("avx2")
+BKH_INTERNAL_INLINE __m256i avx2_rotate(__m256i x) noexcept
 {
-    word const t0 = right_rotate(x,  7);
-    word const t1 = right_rotate(x, 18);
-    word const t2 = right_shift (x,  3);
+    return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+}
 
-    return bitwise_xor
+/**
+ * Same as sse_add_sigma1, but for both halves of the vectors.
+ */
+BKH_TARGET("avx2")
+BKH_INTERNAL_INLINE __m256i avx2_add_sigma1(__m256i v, __m256i w2) noexcept
+{
+    __m256i const s1 = _mm256_xor_si256
     (
-        bitwise_xor(t0, t1),
-        t2
+        _mm256_xor_si256(avx2_rotate<17>(w2), avx2_rotate<19>(w2)),
+        _mm256_srli_epi32(w2, 10)
     );
+
+    return _mm256_add_epi32(v, s1);
 }
 
 /**
- * The last of six logical functions defined for SHA-256.
- * Referred to as "sigma1" in the specification.
+ * Same as sse_schedule, except it computes the schedule of two
+ * blocks at once, one in each 128-bit half of the vectors.
  */
-BKH_PURE static constexpr word F5(word x) noexcept
+BKH_TARGET("avx2")
+BKH_INTERNAL_INLINE __m256i avx2_schedule(__m256i x0, __m256i x1, __m256i x2, __m256i x3) noexcept
 {
-    word const t0 = right_rotate(x, 17);
-    word const t1 = right_rotate(x, 19);
-    word const t2 = right_shift (x, 10);
+    //W[t - 15] and W[t - 7]
+    __m256i const w15 = _mm256_alignr_epi8(x1, x0, 4);
+    __m256i const w7  = _mm256_alignr_epi8(x3, x2, 4);
 
-    return bitwise_xor
+    //W[t - 16] + sigma0(W[t - 15]) + W[t - 7]
+    __m256i const s0 = _mm256_xor_si256
     (
-        bitwise_xor(t0, t1),
-        t2
+        _mm256_xor_si256(avx2_rotate<7>(w15), avx2_rotate<18>(w15)),
+        _mm256_srli_epi32(w15, 3)
     );
-}
+    __m256i x = _mm256_add_epi32(_mm256_add_epi32(x0, s0), w7);
 
-/* Constants defined for SHA-256 */
+    //Complete the first two words using the last two of x3, then the last two words
+    x = avx2_add_sigma1(x, _mm256_bsrli_epi128(x3, 8));
+    x = avx2_add_sigma1(x, _mm256_bslli_epi128(x,  8));
 
-/**
- * These 64 constant words are used in the transform
- * and represent the first 32 bits of the fractional
- * parts of the cube roots of the first 64 prime
- * numbers.
- */
-static constexpr word const sha256_hash_constants[64]
-{
-    0x428A2F98u, 0x71374491u, 0xB5C0FBCFu, 0xE9B5DBA5u,
-    0x3956C25Bu, 0x59F111F1u, 0x923F82A4u, 0xAB1C5ED5u,
-    0xD807AA98u, 0x12835B01u, 0x243185BEu, 0x550C7DC3u,
-    0x72BE5D74u, 0x80DEB1FEu, 0x9BDC06A7u, 0xC19BF174u,
-    0xE49B69C1u, 0xEFBE4786u, 0x0FC19DC6u, 0x240CA1CCu,
-    0x2DE92C6Fu, 0x4A7484AAu, 0x5CB0A9DCu, 0x76F988DAu,
-    0x983E5152u, 0xA831C66Du, 0xB00327C8u, 0xBF597FC7u,
-    0xC6E00BF3u, 0xD5A79147u, 0x06CA6351u, 0x14292967u,
-    0x27B70A85u, 0x2E1B2138u, 0x4D2C6DFCu, 0x53380D13u,
-    0x650A7354u, 0x766A0ABBu, 0x81C2C92Eu, 0x92722C85u,
-    0xA2BFE8A1u, 0xA81A664Bu, 0xC24B8B70u, 0xC76C51A3u,
-    0xD192E819u, 0xD6990624u, 0xF40E3585u, 0x106AA070u,
-    0x19A4C116u, 0x1E376C08u, 0x2748774Cu, 0x34B0BCB5u,
-    0x391C0CB3u, 0x4ED8AA4Au, 0x5B9CCA4Fu, 0x682E6FF3u,
-    0x748F82EEu, 0x78A5636Fu, 0x84C87814u, 0x8CC70208u,
-    0x90BEFFFAu, 0xA4506CEBu, 0xBEF9A3F7u, 0xC67178F2u
-};
+    return x;
+}
 
 /**
- * These 8 constant words are the initial hash value
- * used in SHA-256 and were obtained by taking the
- * first 32 bits of the fractional parts of the
- * square roots of the first eight prime numbers.
+ * Loads the i-th group of four words from two blocks into the
+ * halves of a vector, converting them to host byte order.
  */
-static constexpr word const sha256_initial_hash_value[8]
+BKH_TARGET("avx2")
+BKH_INTERNAL_INLINE __m256i avx2_load_pair(byte const* lo, byte const* hi, int i) noexcept
 {
-    0x6A09E667u, 0xBB67AE85u, 0x3C6EF372u, 0xA54FF53Au,
-    0x510E527Fu, 0x9B05688Cu, 0x1F83D9ABu, 0x5BE0CD19u
-};
+    __m256i const bswap = _mm256_set_epi64x
+    (
+        0x0C0D0E0F08090A0Bll, 0x0405060700010203ll,
+        0x0C0D0E0F08090A0Bll, 0x0405060700010203ll
+    );
 
-/* Helpers */
+    __m128i const l = _mm_loadu_si128(reinterpret_cast<__m128i const*>(lo) + i);
+    __m128i const h = _mm_loadu_si128(reinterpret_cast<__m128i const*>(hi) + i);
 
-using bkh::u64;
+    return _mm256_shuffle_epi8(_mm256_inserti128_si256(_mm256_castsi128_si256(l), h, 1), bswap);
+}
 
 /**
- * Performs an unchecked copy of data from one buffer
- * to another. Buffers may not overlap.
+ * Adds the round constants to four words of the message schedule
+ * of both blocks starting at word t, and stores the result in wk
+ * such that the words of the two blocks are interleaved in
+ * groups of four.
  */
-static void unsafe_copy(byte* BKH_RESTRICT dst, byte const* BKH_RESTRICT src, u64 count) noexcept
+BKH_TARGET("avx2")
+BKH_INTERNAL_INLINE void avx2_store_wk(word* wk, int t, __m256i x) noexcept
 {
-    for (u64 i = 0; i < count; i++)
-    {
-        dst[i] = src[i];
-    }
+    __m128i const k = _mm_loadu_si128(reinterpret_cast<__m128i const*>(sha256_hash_constants + t));
+    _mm256_store_si256(reinterpret_cast<__m256i*>(wk + 2 * t), _mm256_add_epi32(x, _mm256_broadcastsi128_si256(k)));
 }
 
 /**
- * Writes an unsigned 64-bit value into an array as a
- * sequence of bytes in big-endian byte order.
+ * An implementation of the SHA-256 transform which computes the
+ * message schedule of two blocks at once using AVX2, one block
+ * in each 128-bit half of the vectors. The schedule of the
+ * second block is thus ready by the time its rounds start, and
+ * the rounds use the BMI2 rotate instructions.
  */
-static void write_be_u64(byte* ptr, u64 value) noexcept
+BKH_TARGET("avx2,bmi2")
+BKH_INTERNAL void transform_avx2(word* BKH_RESTRICT state, byte const* BKH_RESTRICT data, u64 count) noexcept
 {
-#if (BYTE_ORDER == LITTLE_ENDIAN)
-    *reinterpret_cast<u64*>(ptr) = 
-        ((value & 0x00000000000000FFull) << 56u) |
-        ((value & 0x000000000000FF00ull) << 40u) |
-        ((value & 0x0000000000FF0000ull) << 24u) |
-        ((value & 0x00000000FF000000ull) <<  8u) |
-        ((value & 0x000000FF00000000ull) >>  8u) |
-        ((value & 0x0000FF0000000000ull) >> 24u) |
-        ((value & 0x00FF000000000000ull) >> 40u) |
-        ((value & 0xFF00000000000000ull) >> 56u);
-#else
-    *reinterpret_cast<u64*>(ptr) = value;
-#endif
+    //The message schedule of both blocks with the round constants added
+    alignas(32) word wk[2 * 64];
+
+    //Keep the intermediate hash value in locals across the blocks
+    word s0 = state[0],
+         s1 = state[1],
+         s2 = state[2],
+         s3 = state[3],
+         s4 = state[4],
+         s5 = state[5],
+         s6 = state[6],
+         s7 = state[7];
+
+    //Iterate over the blocks two at a time
+    byte const* const end = data + count * bkh::sha256::block_length;
+    while (data != end)
+    {
+        //Pair the block with the next one, or itself if it's the last
+        byte const* const next  = data + bkh::sha256::block_length;
+        bool const        pair  = (next != end);
+        byte const* const other = pair ? next : data;
+
+        //Request the upcoming data early
+        BKH_PREFETCH(data + prefetch_distance);
+        BKH_PREFETCH(next + prefetch_distance);
+
+        //Load the messages
+        __m256i x0 = avx2_load_pair(data, other, 0);
+        __m256i x1 = avx2_load_pair(data, other, 1);
+        __m256i x2 = avx2_load_pair(data, other, 2);
+        __m256i x3 = avx2_load_pair(data, other, 3);
+        avx2_store_wk(wk,  0, x0);
+        avx2_store_wk(wk,  4, x1);
+        avx2_store_wk(wk,  8, x2);
+        avx2_store_wk(wk, 12, x3);
+
+        //Initialize our eight working variables with previous state
+        word a = s0,
+             b = s1,
+             c = s2,
+             d = s3,
+             e = s4,
+             f = s5,
+             g = s6,
+             h = s7;
+
+        //Perform the rounds of the first block while extending the schedule
+        for (int t = 0; t < 48; t += 8)
+        {
+            x0 = avx2_schedule(x0, x1, x2, x3);
+            avx2_store_wk(wk, t + 16, x0);
+            rounds_wk4(a, b, c, d, e, f, g, h, wk + 2 * t);
+
+            x1 = avx2_schedule(x1, x2, x3, x0);
+            avx2_store_wk(wk, t + 20, x1);
+            rounds_wk4(e, f, g, h, a, b, c, d, wk + 2 * t + 8);
+
+            //Restore the order of the schedule
+            __m256i const y0 = x0, y1 = x1;
+            x0 = x2;
+            x1 = x3;
+            x2 = y0;
+            x3 = y1;
+        }
+        for (int t = 48; t < 64; t += 8)
+        {
+            rounds_wk4(a, b, c, d, e, f, g, h, wk + 2 * t);
+            rounds_wk4(e, f, g, h, a, b, c, d, wk + 2 * t + 8);
+        }
+
+        //Calculate the intermediate hash value
+        s0 += a;
+        s1 += b;
+        s2 += c;
+        s3 += d;
+        s4 += e;
+        s5 += f;
+        s6 += g;
+        s7 += h;
+
+        //Perform the rounds of the second block using its finished schedule
+        if (pair)
+        {
+            a = s0;
+            b = s1;
+            c = s2;
+            d = s3;
+            e = s4;
+            f = s5;
+            g = s6;
+            h = s7;
+
+            for (int t = 0; t < 64; t += 8)
+            {
+                rounds_wk4(a, b, c, d, e, f, g, h, wk + 2 * t + 4);
+                rounds_wk4(e, f, g, h, a, b, c, d, wk + 2 * t + 12);
+            }
+
+            s0 += a;
+            s1 += b;
+            s2 += c;
+            s3 += d;
+            s4 += e;
+            s5 += f;
+            s6 += g;
+            s7 += h;
+        }
+
+        //Advance past the block(s)
+        data = pair ? next + bkh::sha256::block_length : next;
+    }
+
+    //Write back the result
+    state[0] = s0;
+    state[1] = s1;
+    state[2] = s2;
+    state[3] = s3;
+    state[4] = s4;
+    state[5] = s5;
+    state[6] = s6;
+    state[7] = s7;
 }
 
-/* Implementation */
+#endif
+
+#if defined(BKH_SHA256_X86)
 
-void bkh::sha256::sha256_context::init() noexcept
+/**
+ * Transposes an 8x8 matrix of words held in eight vectors,
+ * turning the words of one message into one word of each of
+ * the messages.
+ */
+BKH_TARGET("avx2")
+BKH_INTERNAL_INLINE void avx2_transpose(__m256i* r) noexcept
 {
-    //Sanity check
-    static_assert(sizeof(this->state) == sizeof(sha256_initial_hash_value));
+    __m256i const t0 = _mm256_unpacklo_epi32(r[0], r[1]);
+    __m256i const t1 = _mm256_unpackhi_epi32(r[0], r[1]);
+    __m256i const t2 = _mm256_unpacklo_epi32(r[2], r[3]);
+    __m256i const t3 = _mm256_unpackhi_epi32(r[2], r[3]);
+    __m256i const t4 = _mm256_unpacklo_epi32(r[4], r[5]);
+    __m256i const t5 = _mm256_unpackhi_epi32(r[4], r[5]);
+    __m256i const t6 = _mm256_unpacklo_epi32(r[6], r[7]);
+    __m256i const t7 = _mm256_unpackhi_epi32(r[6], r[7]);
+
+    __m256i const u0 = _mm256_unpacklo_epi64(t0, t2);
+    __m256i const u1 = _mm256_unpackhi_epi64(t0, t2);
+    __m256i const u2 = _mm256_unpacklo_epi64(t1, t3);
+    __m256i const u3 = _mm256_unpackhi_epi64(t1, t3);
+    __m256i const u4 = _mm256_unpacklo_epi64(t4, t6);
+    __m256i const u5 = _mm256_unpackhi_epi64(t4, t6);
+    __m256i const u6 = _mm256_unpacklo_epi64(t5, t7);
+    __m256i const u7 = _mm256_unpackhi_epi64(t5, t7);
+
+    r[0] = _mm256_permute2x128_si256(u0, u4, 0x20);
+    r[1] = _mm256_permute2x128_si256(u1, u5, 0x20);
+    r[2] = _mm256_permute2x128_si256(u2, u6, 0x20);
+    r[3] = _mm256_permute2x128_si256(u3, u7, 0x20);
+    r[4] = _mm256_permute2x128_si256(u0, u4, 0x31);
+    r[5] = _mm256_permute2x128_si256(u1, u5, 0x31);
+    r[6] = _mm256_permute2x128_si256(u2, u6, 0x31);
+    r[7] = _mm256_permute2x128_si256(u3, u7, 0x31);
+}
 
-    //Get the number of words in the state
-    constexpr int const count = sizeof(this->state) / sizeof(word);
+/**
+ * Loads one block from each of eight messages, converting the
+ * words to host byte order and transposing them such that
+ * W[t] holds word t of every message.
+ */
+BKH_TARGET("avx2")
+BKH_INTERNAL_INLINE void avx2_load_blocks(__m256i* W, byte const* const* blocks) noexcept
+{
+    __m256i const bswap = _mm256_set_epi64x
+    (
+        0x0C0D0E0F08090A0Bll, 0x0405060700010203ll,
+        0x0C0D0E0F08090A0Bll, 0x0405060700010203ll
+    );
 
-    //Copy the words into our state
-    for (int i = 0; i < count; i++)
+    for (int l = 0; l < 8; l++)
     {
-        this->state[i] = sha256_initial_hash_value[i];
+        auto const* M = reinterpret_cast<__m256i const*>(blocks[l]);
+        W[l + 0] = _mm256_shuffle_epi8(_mm256_loadu_si256(M + 0), bswap);
+        W[l + 8] = _mm256_shuffle_epi8(_mm256_loadu_si256(M + 1), bswap);
     }
+
+    avx2_transpose(W + 0);
+    avx2_transpose(W + 8);
 }
 
-void bkh::sha256::sha256_context::transform_block(byte const* data) noexcept
+/**
+ * Performs the rounds of the AVX2 multi-buffer transform, given
+ * the first sixteen words of the message schedule of each lane.
+ */
+BKH_TARGET("avx2")
+BKH_INTERNAL_INLINE void avx2_x8_compress(word* BKH_RESTRICT state, __m256i* W) noexcept
 {
     //Initialize our eight working variables with previous state
-    word a = this->state[0],
-         b = this->state[1],
-         c = this->state[2],
-         d = this->state[3],
-         e = this->state[4],
-         f = this->state[5],
-         g = this->state[6],
-         h = this->state[7];
-
-    //Treat the input as words
-    word const* M = reinterpret_cast<word const*>(data);
-
-    //Prepare the message schedule W
-    word W[64];
-    for (int t = 0; t < 16; t++)
-    {
-#if (BYTE_ORDER == LITTLE_ENDIAN)
-        W[t] = ((M[t] & 0x000000FFu) << 24u) |
-               ((M[t] & 0x0000FF00u) <<  8u) |
-               ((M[t] & 0x00FF0000u) >>  8u) |
-               ((M[t] & 0xFF000000u) >> 24u);
-#else
-        W[t] = M[t];
-#endif
-    }
-    for (int t = 16; t < 64; t++)
-    {
-        W[t] = F5(W[t - 2]) + W[t - 7] + F4(W[t - 15]) + W[t - 16];
-    }
-
-    //Perform the main transformation
+    auto* S = reinterpret_cast<__m256i*>(state);
+    __m256i a = _mm256_loadu_si256(S + 0),
+            b = _mm256_loadu_si256(S + 1),
+            c = _mm256_loadu_si256(S + 2),
+            d = _mm256_loadu_si256(S + 3),
+            e = _mm256_loadu_si256(S + 4),
+            f = _mm256_loadu_si256(S + 5),
+            g = _mm256_loadu_si256(S + 6),
+            h = _mm256_loadu_si256(S + 7);
+
+    //Perform the main transformation, extending the schedule as we go
     for (int t = 0; t < 64; t++)
     {
-        word T1 = h + F3(e) + F0(e, f, g) + sha256_hash_constants[t] + W[t];
-        word T2 = F2(a) + F1(a, b, c);
+        if (t >= 16)
+        {
+            __m256i const w2  = W[(t -  2) & 15];
+            __m256i const w15 = W[(t - 15) & 15];
+
+            __m256i const s1 = _mm256_xor_si256
+            (
+                _mm256_xor_si256(avx2_rotate<17>(w2), avx2_rotate<19>(w2)),
+                _mm256_srli_epi32(w2, 10)
+            );
+            __m256i const s0 = _mm256_xor_si256
+            (
+                _mm256_xor_si256(avx2_rotate<7>(w15), avx2_rotate<18>(w15)),
+                _mm256_srli_epi32(w15, 3)
+            );
+
+            W[t & 15] = _mm256_add_epi32
+            (
+                _mm256_add_epi32(s1, W[(t - 7) & 15]),
+                _mm256_add_epi32(s0, W[t & 15])
+            );
+        }
+
+        __m256i const S1 = _mm256_xor_si256
+        (
+            _mm256_xor_si256(avx2_rotate<6>(e), avx2_rotate<11>(e)),
+            avx2_rotate<25>(e)
+        );
+        __m256i const S0 = _mm256_xor_si256
+        (
+            _mm256_xor_si256(avx2_rotate<2>(a), avx2_rotate<13>(a)),
+            avx2_rotate<22>(a)
+        );
+        __m256i const ch  = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+        __m256i const maj = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(_mm256_or_si256(a, b), c));
+        __m256i const k   = _mm256_set1_epi32(static_cast<int>(sha256_hash_constants[t]));
+
+        __m256i const T1 = _mm256_add_epi32
+        (
+            _mm256_add_epi32(_mm256_add_epi32(h, S1), _mm256_add_epi32(ch, k)),
+            W[t & 15]
+        );
+        __m256i const T2 = _mm256_add_epi32(S0, maj);
 
         h = g;
         g = f;
         f = e;
-        e = d + T1;
+        e = _mm256_add_epi32(d, T1);
         d = c;
         c = b;
         b = a;
-        a = T1 + T2;
+        a = _mm256_add_epi32(T1, T2);
     }
 
     //Calculate the intermediate hash value
-    this->state[0] += a;
-    this->state[1] += b;
-    this->state[2] += c;
-    this->state[3] += d;
-    this->state[4] += e;
-    this->state[5] += f;
-    this->state[6] += g;
-    this->state[7] += h;
+    _mm256_storeu_si256(S + 0, _mm256_add_epi32(_mm256_loadu_si256(S + 0), a));
+    _mm256_storeu_si256(S + 1, _mm256_add_epi32(_mm256_loadu_si256(S + 1), b));
+    _mm256_storeu_si256(S + 2, _mm256_add_epi32(_mm256_loadu_si256(S + 2), c));
+    _mm256_storeu_si256(S + 3, _mm256_add_epi32(_mm256_loadu_si256(S + 3), d));
+    _mm256_storeu_si256(S + 4, _mm256_add_epi32(_mm256_loadu_si256(S + 4), e));
+    _mm256_storeu_si256(S + 5, _mm256_add_epi32(_mm256_loadu_si256(S + 5), f));
+    _mm256_storeu_si256(S + 6, _mm256_add_epi32(_mm256_loadu_si256(S + 6), g));
+    _mm256_storeu_si256(S + 7, _mm256_add_epi32(_mm256_loadu_si256(S + 7), h));
 }
 
-bool bkh::sha256::sha256_context::pad_block(byte const* data, u64 data_length, u64 message_length, byte* result_buffer) noexcept
+/**
+ * A multi-buffer implementation of the SHA-256 transform using
+ * AVX2, which processes one block from each of eight messages.
+ * The state is transposed, such that state[i * 8 + l] holds
+ * word i of the intermediate hash value of message l.
+ */
+BKH_TARGET("avx2")
+BKH_INTERNAL void transform_avx2_x8(word* BKH_RESTRICT state, byte const* const* BKH_RESTRICT blocks) noexcept
 {
-    //Check that it's not too big
-    assert(message_length < sha256::max_message_length);
+    //Prepare the first sixteen words of the message schedule
+    __m256i W[16];
+    avx2_load_blocks(W, blocks);
 
-    //Check for the case where data is null, which means just fill with zeroes and message_length
-    if (data == nullptr)
-    {
-        //A small sanity check
-        assert(data_length == 0);
+    avx2_x8_compress(state, W);
+}
 
-        //Calculate number of zeroes to write
-        constexpr auto const zeroes = sha256::block_length - sizeof(u64);
+/**
+ * Same as transform_avx2_x8, but takes blocks which have already
+ * been converted to words and transposed like the state.
+ */
+BKH_TARGET("avx2")
+BKH_INTERNAL void transform_avx2_x8_words(word* BKH_RESTRICT state, word const* BKH_RESTRICT words) noexcept
+{
+    //Load the first sixteen words of the message schedule
+    __m256i W[16];
+    auto const* M = reinterpret_cast<__m256i const*>(words);
+    for (int t = 0; t < 16; t++) W[t] = _mm256_loadu_si256(M + t);
 
-        //Write the zeroes
-        byte* p   = result_buffer;
-        byte* end = result_buffer + zeroes;
-        while (p != end) *(p++) = 0;
+    avx2_x8_compress(state, W);
+}
 
-        //Write the length
-        u64 const bit_count = message_length * 8;
-        write_be_u64(p, bit_count);
+/**
+ * Some versions of GCC warn about uninitialized variables inside
+ * their own AVX-512 intrinsics (GCC bug 105593).
+ */
+#if defined(__GNUC__) && !defined(__clang__)
+#    pragma GCC diagnostic push
+#    pragma GCC diagnostic ignored "-Wuninitialized"
+#    pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+/**
+ * Performs the rounds of the AVX-512 multi-buffer transform,
+ * given the first sixteen words of the message schedule of
+ * each lane.
+ */
+BKH_TARGET("avx2,avx512f")
+BKH_INTERNAL_INLINE void avx512_x16_compress(word* BKH_RESTRICT state, __m512i* W) noexcept
+{
+    //Initialize our eight working variables with previous state
+    auto* S = reinterpret_cast<__m512i*>(state);
+    __m512i a = _mm512_loadu_si512(S + 0),
+            b = _mm512_loadu_si512(S + 1),
+            c = _mm512_loadu_si512(S + 2),
+            d = _mm512_loadu_si512(S + 3),
+            e = _mm512_loadu_si512(S + 4),
+            f = _mm512_loadu_si512(S + 5),
+            g = _mm512_loadu_si512(S + 6),
+            h = _mm512_loadu_si512(S + 7);
+
+    //Perform the main transformation, extending the schedule as we go
+    for (int t = 0; t < 64; t++)
+    {
+        if (t >= 16)
+        {
+            __m512i const w2  = W[(t -  2) & 15];
+            __m512i const w15 = W[(t - 15) & 15];
+
+            __m512i const s1 = _mm512_ternarylogic_epi32
+            (
+                _mm512_ror_epi32(w2, 17), _mm512_ror_epi32(w2, 19), _mm512_srli_epi32(w2, 10), 0x96
+            );
+            __m512i const s0 = _mm512_ternarylogic_epi32
+            (
+                _mm512_ror_epi32(w15, 7), _mm512_ror_epi32(w15, 18), _mm512_srli_epi32(w15, 3), 0x96
+            );
+
+            W[t & 15] = _mm512_add_epi32
+            (
+                _mm512_add_epi32(s1, W[(t - 7) & 15]),
+                _mm512_add_epi32(s0, W[t & 15])
+            );
+        }
+
+        __m512i const S1 = _mm512_ternarylogic_epi32
+        (
+            _mm512_ror_epi32(e, 6), _mm512_ror_epi32(e, 11), _mm512_ror_epi32(e, 25), 0x96
+        );
+        __m512i const S0 = _mm512_ternarylogic_epi32
+        (
+            _mm512_ror_epi32(a, 2), _mm512_ror_epi32(a, 13), _mm512_ror_epi32(a, 22), 0x96
+        );
+        __m512i const ch  = _mm512_ternarylogic_epi32(e, f, g, 0xCA);
+        __m512i const maj = _mm512_ternarylogic_epi32(a, b, c, 0xE8);
+        __m512i const k   = _mm512_set1_epi32(static_cast<int>(sha256_hash_constants[t]));
+
+        __m512i const T1 = _mm512_add_epi32
+        (
+            _mm512_add_epi32(_mm512_add_epi32(h, S1), _mm512_add_epi32(ch, k)),
+            W[t & 15]
+        );
+        __m512i const T2 = _mm512_add_epi32(S0, maj);
+
+        h = g;
+        g = f;
+        f = e;
+        e = _mm512_add_epi32(d, T1);
+        d = c;
+        c = b;
+        b = a;
+        a = _mm512_add_epi32(T1, T2);
+    }
+
+    //Calculate the intermediate hash value
+    _mm512_storeu_si512(S + 0, _mm512_add_epi32(_mm512_loadu_si512(S + 0), a));
+    _mm512_storeu_si512(S + 1, _mm512_add_epi32(_mm512_loadu_si512(S + 1), b));
+    _mm512_storeu_si512(S + 2, _mm512_add_epi32(_mm512_loadu_si512(S + 2), c));
+    _mm512_storeu_si512(S + 3, _mm512_add_epi32(_mm512_loadu_si512(S + 3), d));
+    _mm512_storeu_si512(S + 4, _mm512_add_epi32(_mm512_loadu_si512(S + 4), e));
+    _mm512_storeu_si512(S + 5, _mm512_add_epi32(_mm512_loadu_si512(S + 5), f));
+    _mm512_storeu_si512(S + 6, _mm512_add_epi32(_mm512_loadu_si512(S + 6), g));
+    _mm512_storeu_si512(S + 7, _mm512_add_epi32(_mm512_loadu_si512(S + 7), h));
+}
+
+/**
+ * A multi-buffer implementation of the SHA-256 transform using
+ * AVX-512, which processes one block from each of sixteen
+ * messages. The state is transposed, such that state[i * 16 + l]
+ * holds word i of the intermediate hash value of message l.
+ */
+BKH_TARGET("avx2,avx512f")
+BKH_INTERNAL void transform_avx512_x16(word* BKH_RESTRICT state, byte const* const* BKH_RESTRICT blocks) noexcept
+{
+    //Prepare the first sixteen words of the message schedule
+    __m512i W[16];
+    {
+        __m256i lo[16], hi[16];
+        avx2_load_blocks(lo, blocks + 0);
+        avx2_load_blocks(hi, blocks + 8);
+        for (int t = 0; t < 16; t++)
+        {
+            W[t] = _mm512_inserti64x4(_mm512_castsi256_si512(lo[t]), hi[t], 1);
+        }
+    }
+
+    avx512_x16_compress(state, W);
+}
+
+/**
+ * Same as transform_avx512_x16, but takes blocks which have
+ * already been converted to words and transposed like the state.
+ */
+BKH_TARGET("avx2,avx512f")
+BKH_INTERNAL void transform_avx512_x16_words(word* BKH_RESTRICT state, word const* BKH_RESTRICT words) noexcept
+{
+    //Load the first sixteen words of the message schedule
+    __m512i W[16];
+    for (int t = 0; t < 16; t++) W[t] = _mm512_loadu_si512(words + 16 * t);
+
+    avx512_x16_compress(state, W);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#    pragma GCC diagnostic pop
+#endif
+
+#endif
+
+/* Dispatch */
+
+using backend = bkh::sha256::backend;
+
+/**
+ * Describes the instruction set extensions of the host
+ * that are relevant to the backends.
+ */
+struct cpu_features
+{
+    bool ssse3;
+    bool sse41;
+    bool sha;
+    bool avx2;
+    bool bmi2;
+    bool avx512f;
+};
+
+#if defined(BKH_SHA256_X86)
+
+/**
+ * Reads the XCR0 register, which tells which register states
+ * are saved by the OS. Requires OSXSAVE.
+ */
+BKH_TARGET("xsave")
+BKH_INTERNAL unsigned long long read_xcr0() noexcept
+{
+    return _xgetbv(0);
+}
+
+#endif
+
+/**
+ * Queries the host for the instruction set extensions it
+ * supports. Always reports none when intrinsics are disabled
+ * or the host is not x86.
+ */
+BKH_INTERNAL cpu_features detect_cpu_features() noexcept
+{
+    cpu_features features{};
+
+#if defined(BKH_SHA256_X86)
+    //Helper for executing CPUID on every compiler
+    auto const cpuid = [](unsigned leaf, unsigned subleaf, unsigned* regs)
+    {
+#    if defined(_MSC_VER) && !defined(__clang__)
+        int r[4];
+        __cpuidex(r, static_cast<int>(leaf), static_cast<int>(subleaf));
+        for (int i = 0; i < 4; i++) regs[i] = static_cast<unsigned>(r[i]);
+#    else
+        __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#    endif
+    };
+
+    //Check how many leaves are available
+    unsigned regs[4];
+    cpuid(0, 0, regs);
+    unsigned const max_leaf = regs[0];
+
+    //Check the feature flags
+    bool ymm_enabled = false;
+    bool zmm_enabled = false;
+    if (max_leaf >= 1)
+    {
+        cpuid(1, 0, regs);
+        features.ssse3 = (regs[2] & (1u <<  9)) != 0;
+        features.sse41 = (regs[2] & (1u << 19)) != 0;
+
+        //The OS has to save the vector registers for us to use them
+        bool const osxsave = (regs[2] & (1u << 27)) != 0;
+        bool const avx     = (regs[2] & (1u << 28)) != 0;
+        if (osxsave && avx)
+        {
+            auto const xcr0 = read_xcr0();
+            ymm_enabled = (xcr0 & 0x06) == 0x06;
+            zmm_enabled = (xcr0 & 0xE6) == 0xE6;
+        }
+    }
+    if (max_leaf >= 7)
+    {
+        cpuid(7, 0, regs);
+        features.sha     = (regs[1] & (1u << 29)) != 0;
+        features.avx2    = (regs[1] & (1u <<  5)) != 0 && ymm_enabled;
+        features.bmi2    = (regs[1] & (1u <<  8)) != 0;
+        features.avx512f = (regs[1] & (1u << 16)) != 0 && zmm_enabled && features.avx2;
+    }
+#endif
+
+    return features;
+}
+
+/**
+ * The signature shared by every implementation of the transform.
+ */
+using transform_function = void(*)(word* BKH_RESTRICT, byte const* BKH_RESTRICT, u64) noexcept;
+
+/**
+ * Retrieves the implementation of the given backend, or null
+ * if it was not compiled in.
+ */
+BKH_INTERNAL transform_function backend_function(backend b) noexcept
+{
+    switch (b)
+    {
+        case backend::scalar: return transform_scalar;
+#if defined(BKH_SHA256_X86)
+        case backend::ssse3:  return transform_ssse3;
+        case backend::avx2:   return transform_avx2;
+        case backend::shani:  return transform_shani;
+#endif
+        default:              return nullptr;
+    }
+}
+
+/**
+ * Checks whether the given backend was compiled in and can
+ * run on the host.
+ */
+BKH_INTERNAL bool backend_supported(backend b) noexcept
+{
+    //Check that it's available at all
+    if (backend_function(b) == nullptr) return false;
+
+    //Check the host
+    cpu_features const features = detect_cpu_features();
+    switch (b)
+    {
+        case backend::scalar: return true;
+        case backend::ssse3:  return features.ssse3;
+        case backend::avx2:   return features.avx2 && features.bmi2;
+        case backend::shani:  return features.sha && features.sse41;
+        default:              return false;
+    }
+}
+
+/**
+ * Picks the fastest backend the host supports.
+ */
+BKH_INTERNAL backend best_backend() noexcept
+{
+    if (backend_supported(backend::shani)) return backend::shani;
+    if (backend_supported(backend::avx2))  return backend::avx2;
+    if (backend_supported(backend::ssse3)) return backend::ssse3;
+
+    return backend::scalar;
+}
+
+BKH_INTERNAL void transform_resolve(word* BKH_RESTRICT state, byte const* BKH_RESTRICT data, u64 count) noexcept;
+
+/**
+ * Relaxed atomic accesses to the selected backends, which are
+ * resolved lazily by whichever threads hash first. No ordering
+ * is needed, as every value they hold is usable on its own.
+ */
+template<typename T>
+BKH_INTERNAL_INLINE T load_relaxed(T const& variable) noexcept
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    return *const_cast<T const volatile*>(&variable);
+#else
+    T value;
+    __atomic_load(&variable, &value, __ATOMIC_RELAXED);
+    return value;
+#endif
+}
+
+template<typename T>
+BKH_INTERNAL_INLINE void store_relaxed(T& variable, T value) noexcept
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    *const_cast<T volatile*>(&variable) = value;
+#else
+    __atomic_store(&variable, &value, __ATOMIC_RELAXED);
+#endif
+}
+
+/**
+ * The currently selected backend and its implementation. The
+ * transform starts out pointing at a resolver which performs
+ * the feature detection on first use, such that the detection
+ * does not depend on static initialization. Racing threads
+ * store the same result, and both are only accessed through
+ * load_relaxed and store_relaxed.
+ */
+BKH_INTERNAL backend            sha256_backend   = backend::automatic;
+BKH_INTERNAL transform_function sha256_transform = transform_resolve;
+
+/**
+ * Makes the given backend the one used by the transform.
+ */
+BKH_INTERNAL void select_backend(backend b) noexcept
+{
+    store_relaxed(sha256_backend, b);
+    store_relaxed(sha256_transform, backend_function(b));
+}
+
+/**
+ * Calls the transform of the selected backend.
+ */
+BKH_INTERNAL_INLINE void transform_selected(word* BKH_RESTRICT state, byte const* BKH_RESTRICT data, u64 count) noexcept
+{
+    load_relaxed(sha256_transform)(state, data, count);
+}
+
+/**
+ * Selects the best backend before forwarding the blocks to it.
+ */
+BKH_INTERNAL void transform_resolve(word* BKH_RESTRICT state, byte const* BKH_RESTRICT data, u64 count) noexcept
+{
+    backend const b = best_backend();
+    select_backend(b);
+    backend_function(b)(state, data, count);
+}
+
+using batch_backend = bkh::sha256::batch_backend;
+
+/**
+ * The signature shared by every multi-buffer implementation of
+ * the transform, which takes a transposed state and one block
+ * for each lane.
+ */
+using multi_transform_function = void(*)(word* BKH_RESTRICT, byte const* const* BKH_RESTRICT) noexcept;
+
+/**
+ * Checks whether the given batch backend was compiled in and
+ * can run on the host.
+ */
+BKH_INTERNAL bool batch_backend_supported(batch_backend b) noexcept
+{
+    //The serial backend is always available
+    if (b == batch_backend::serial) return true;
+
+#if defined(BKH_SHA256_X86)
+    //Check the host
+    cpu_features const features = detect_cpu_features();
+    switch (b)
+    {
+        case batch_backend::avx2:   return features.avx2;
+        case batch_backend::avx512: return features.avx512f;
+        default:                    return false;
+    }
+#else
+    return false;
+#endif
+}
+
+/**
+ * Picks the fastest batch backend the host supports. Eight AVX2
+ * lanes do not outrun the SHA extensions, so those are preferred
+ * when available.
+ */
+BKH_INTERNAL batch_backend best_batch_backend() noexcept
+{
+    if (batch_backend_supported(batch_backend::avx512)) return batch_backend::avx512;
+    if (backend_supported(backend::shani))              return batch_backend::serial;
+    if (batch_backend_supported(batch_backend::avx2))   return batch_backend::avx2;
+
+    return batch_backend::serial;
+}
+
+/**
+ * The currently selected batch backend, which is resolved on
+ * first use. Like the single-stream backend it is only accessed
+ * through load_relaxed and store_relaxed.
+ */
+BKH_INTERNAL batch_backend sha256_batch_backend = batch_backend::automatic;
+
+/**
+ * Retrieves the selected batch backend, resolving it if needed.
+ */
+BKH_INTERNAL batch_backend selected_batch_backend() noexcept
+{
+    batch_backend const b = load_relaxed(sha256_batch_backend);
+    if (b != batch_backend::automatic) return b;
+
+    batch_backend const best = best_batch_backend();
+    store_relaxed(sha256_batch_backend, best);
+    return best;
+}
+
+/**
+ * The single lane counterpart of the word based multi-buffer
+ * transforms, which converts the words back to a block for the
+ * single-stream transform.
+ */
+BKH_INTERNAL void transform_words_serial(word* BKH_RESTRICT state, word const* BKH_RESTRICT words) noexcept
+{
+    byte block[bkh::sha256::block_length];
+    store_digest(words + 0, block + 0);
+    store_digest(words + 8, block + 32);
+
+    transform_selected(state, block, 1);
+}
+
+/* Instrumentation */
+
+#if defined(BKH_SHA256_INSTRUMENT)
+
+using operation = bkh::sha256::operation;
+
+/**
+ * The counters behind sha256::statistics, kept apart from the
+ * selected backends which are only looked up for a snapshot.
+ */
+struct counters
+{
+    bkh::sha256::operation_statistics operations[bkh::sha256::operation_count];
+    u64                               backend_blocks[bkh::sha256::backend_count];
+    u64                               batch_backend_blocks[bkh::sha256::batch_backend_count];
+};
+
+/**
+ * The statistics gathered so far and the hooks. The counters are
+ * updated with relaxed atomic additions, so hashing on several
+ * threads neither loses counts nor needs any locking.
+ */
+BKH_INTERNAL counters          sha256_counters   = {};
+BKH_INTERNAL bkh::sha256::hook sha256_begin_hook = nullptr;
+BKH_INTERNAL bkh::sha256::hook sha256_end_hook   = nullptr;
+BKH_INTERNAL void*             sha256_hook_user  = nullptr;
+
+BKH_INTERNAL_INLINE void atomic_add(u64& counter, u64 value) noexcept
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    _InterlockedExchangeAdd64(reinterpret_cast<long long volatile*>(&counter), static_cast<long long>(value));
+#else
+    __atomic_fetch_add(&counter, value, __ATOMIC_RELAXED);
+#endif
+}
+
+BKH_INTERNAL_INLINE void atomic_copy(u64* dst, u64* src, u64 count) noexcept
+{
+    for (u64 i = 0; i < count; i++)
+    {
+#if defined(_MSC_VER) && !defined(__clang__)
+        dst[i] = static_cast<u64>(_InterlockedCompareExchange64(reinterpret_cast<long long volatile*>(src + i), 0, 0));
+#else
+        dst[i] = __atomic_load_n(src + i, __ATOMIC_RELAXED);
+#endif
+    }
+}
+
+BKH_INTERNAL_INLINE void atomic_clear(u64* counters, u64 count) noexcept
+{
+    for (u64 i = 0; i < count; i++)
+    {
+#if defined(_MSC_VER) && !defined(__clang__)
+        _InterlockedExchange64(reinterpret_cast<long long volatile*>(counters + i), 0);
+#else
+        __atomic_store_n(counters + i, 0, __ATOMIC_RELAXED);
+#endif
+    }
+}
+
+/**
+ * Reads the time-stamp counter where there is one.
+ */
+BKH_INTERNAL_INLINE u64 read_ticks() noexcept
+{
+#if defined(BKH_SHA256_X86)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/**
+ * Picks the bucket of a value, see sha256::size_buckets.
+ */
+BKH_INTERNAL_INLINE int log2_bucket(u64 value, int bucket_count) noexcept
+{
+    int bucket = 0;
+    while (value != 0 && bucket < bucket_count - 1)
+    {
+        value >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+/**
+ * Observes an operation for as long as it is in scope.
+ */
+struct instrument_scope
+{
+    operation op;
+    u64       bytes;
+    u64       start;
+
+    instrument_scope(operation op, u64 bytes) noexcept
+        : op{ op }, bytes{ bytes }
+    {
+        if (sha256_begin_hook) sha256_begin_hook(sha256_hook_user, op, bytes);
+        this->start = read_ticks();
+    }
+
+    ~instrument_scope() noexcept
+    {
+        u64 const ticks = read_ticks() - this->start;
+
+        auto& s = sha256_counters.operations[static_cast<int>(this->op)];
+        atomic_add(s.calls, 1);
+        atomic_add(s.bytes, this->bytes);
+        atomic_add(s.ticks, ticks);
+        atomic_add(s.latency[log2_bucket(this->bytes, bkh::sha256::size_buckets)][log2_bucket(ticks, bkh::sha256::latency_buckets)], 1);
+
+        if (sha256_end_hook) sha256_end_hook(sha256_hook_user, this->op, this->bytes);
+    }
+};
+
+/**
+ * Counts the number of blocks a batch hashes, including padding.
+ */
+BKH_INTERNAL void count_batch(bkh::sha256::message const* messages, u64 count, u64* bytes, u64* blocks) noexcept
+{
+    *bytes  = 0;
+    *blocks = 0;
+    for (u64 i = 0; i < count; i++)
+    {
+        *bytes  += messages[i].length;
+        *blocks += (messages[i].length + 8) / bkh::sha256::block_length + 1;
+    }
+}
+
+#    define BKH_INSTRUMENT(op, bytes)               sha256_detail::instrument_scope const bkh_instrument{ bkh::sha256::operation::op, bytes }
+#    define BKH_INSTRUMENT_BLOCKS(kind, index, count) sha256_detail::atomic_add(sha256_detail::sha256_counters.kind[static_cast<int>(index)], count)
+#else
+#    define BKH_INSTRUMENT(op, bytes)               static_cast<void>(0)
+#    define BKH_INSTRUMENT_BLOCKS(kind, index, count) static_cast<void>(0)
+#endif
+
+/* Multi-buffer hashing */
+
+/**
+ * Hashes a batch of independent messages using a multi-buffer
+ * transform with L lanes. Every lane works on its own message,
+ * and is handed the next message of the batch as soon as it is
+ * done, such that messages of different lengths keep the lanes
+ * busy. Once the batch is exhausted and only a few lanes remain
+ * active, those are finished using the single-stream transform.
+ * Every message starts from the given midstate, which is the
+ * initial hash value unless the messages share a prefix.
+ */
+template <int L>
+BKH_INTERNAL void multi_buffer_hash(bkh::sha256::midstate const& prefix, bkh::sha256::message const* messages, u64 count, multi_transform_function transform, int drain_threshold) noexcept
+{
+    using bkh::sha256;
+
+    //Tracks the message being worked on in each lane
+    struct lane_info
+    {
+        sha256::message const* msg;
+        byte const*            next;
+        u64                    data_blocks;
+        int                    tail_blocks;
+        int                    tail_index;
+        byte                   tail[2 * sha256::block_length];
+    };
+
+    //Used by idle lanes, their result is discarded
+    static byte const idle_block[sha256::block_length]{};
+
+    alignas(64) word state[8 * L];
+    lane_info        lanes[L];
+    byte const*      blocks[L];
+
+    u64 next_message = 0;
+    int active       = 0;
+
+    //Helper for handing the next message to a lane
+    auto const assign = [&](int l) noexcept
+    {
+        lane_info& lane = lanes[l];
+        if (next_message == count)
+        {
+            lane.msg = nullptr;
+            return;
+        }
+
+        //Take the message
+        sha256::message const* msg = messages + next_message++;
+        lane.msg         = msg;
+        lane.next        = msg->data;
+        lane.data_blocks = msg->length / sha256::block_length;
+        lane.tail_index  = 0;
+        active++;
+
+        //Prepare the padding for the final block(s), counting the prefix
+        auto const  total     = prefix.length + msg->length;
+        auto const  remaining = msg->length % sha256::block_length;
+        byte const* rest      = (remaining > 0) ? msg->data + (msg->length - remaining) : lane.tail;
+        bool const  done      = sha256::context::pad_block(rest, remaining, total, lane.tail);
+        lane.tail_blocks = 1;
+        if (!done)
+        {
+            sha256::context::pad_block(nullptr, 0, total, lane.tail + sha256::block_length);
+            lane.tail_blocks = 2;
+        }
+
+        //Start from the midstate
+        for (int i = 0; i < 8; i++)
+        {
+            state[i * L + l] = prefix.state[i];
+        }
+    };
+
+    //Helper for retrieving the next block of a lane
+    auto const next_block = [&](lane_info& lane) noexcept -> byte const*
+    {
+        if (lane.data_blocks > 0)
+        {
+            byte const* p = lane.next;
+            lane.next += sha256::block_length;
+            lane.data_blocks--;
+            return p;
+        }
+
+        return lane.tail + sha256::block_length * lane.tail_index++;
+    };
+
+    //Fill up the lanes
+    for (int l = 0; l < L; l++) assign(l);
+
+    //Keep going while it pays off to use the lanes
+    while (active > drain_threshold || (active > 0 && next_message < count))
+    {
+        //Gather the blocks
+        for (int l = 0; l < L; l++)
+        {
+            blocks[l] = lanes[l].msg ? next_block(lanes[l]) : idle_block;
+        }
+
+        //Perform the transform
+        transform(state, blocks);
+
+        //Retire any finished messages
+        for (int l = 0; l < L; l++)
+        {
+            lane_info& lane = lanes[l];
+            if (lane.msg == nullptr || lane.tail_index != lane.tail_blocks) continue;
+
+            //Retrieve the message digest
+            word digest[8];
+            for (int i = 0; i < 8; i++) digest[i] = state[i * L + l];
+            store_digest(digest, lane.msg->result);
+
+            //Move on to the next message
+            active--;
+            assign(l);
+        }
+    }
+
+    //Finish the remaining lanes one at a time
+    for (int l = 0; l < L; l++)
+    {
+        lane_info& lane = lanes[l];
+        if (lane.msg == nullptr) continue;
+
+        word digest[8];
+        for (int i = 0; i < 8; i++) digest[i] = state[i * L + l];
+        transform_selected(digest, lane.next, lane.data_blocks);
+        transform_selected(digest, lane.tail + sha256::block_length * lane.tail_index, lane.tail_blocks - lane.tail_index);
+        store_digest(digest, lane.msg->result);
+    }
+}
+
+}
+
+/* Implementation */
+
+BKH_SHA256_INLINE void bkh::sha256::sha256_context::init() noexcept
+{
+    //Sanity check
+    static_assert(sizeof(this->state) == sizeof(sha256_detail::sha256_initial_hash_value));
+
+    //Get the number of words in the state
+    constexpr int const count = sizeof(this->state) / sizeof(word);
+
+    //Copy the words into our state
+    for (int i = 0; i < count; i++)
+    {
+        this->state[i] = sha256_detail::sha256_initial_hash_value[i];
+    }
+}
+
+BKH_SHA256_INLINE void bkh::sha256::sha256_context::transform_block(byte const* data) noexcept
+{
+    BKH_INSTRUMENT(transform, block_length);
+    BKH_INSTRUMENT_BLOCKS(backend_blocks, get_backend(), 1);
+
+    //Hand the block to the selected backend
+    sha256_detail::transform_selected(this->state, data, 1);
+}
+
+BKH_SHA256_INLINE void bkh::sha256::sha256_context::transform_blocks(byte const* data, u64 count) noexcept
+{
+    BKH_INSTRUMENT(transform, count * block_length);
+    BKH_INSTRUMENT_BLOCKS(backend_blocks, get_backend(), count);
+
+    //Hand the blocks to the selected backend
+    sha256_detail::transform_selected(this->state, data, count);
+}
+
+BKH_SHA256_INLINE void bkh::sha256::sha256_context::transform_prepared(prepared_block const& block) noexcept
+{
+    BKH_INSTRUMENT(transform, block_length);
+
+#if defined(BKH_SHA256_X86)
+    //The SHA extensions take the schedule with the constants added as is
+    if (get_backend() == backend::shani)
+    {
+        BKH_INSTRUMENT_BLOCKS(backend_blocks, backend::shani, 1);
+        sha256_detail::transform_shani_prepared(this->state, block.wk);
+        return;
+    }
+#endif
+
+    //The other backends would only vectorize the schedule, which is already done
+    BKH_INSTRUMENT_BLOCKS(backend_blocks, backend::scalar, 1);
+    sha256_detail::transform_prepared_scalar(this->state, block.wk);
+}
+
+BKH_SHA256_INLINE bool bkh::sha256::sha256_context::pad_block(byte const* data, u64 data_length, u64 message_length, byte* result_buffer) noexcept
+{
+    //Check that it's not too big
+    BKH_ASSERT(message_length < sha256::max_message_length);
+
+    //Check for the case where data is null, which means just fill with zeroes and message_length
+    if (data == nullptr)
+    {
+        //A small sanity check
+        BKH_ASSERT(data_length == 0);
+
+        //Calculate number of zeroes to write
+        constexpr auto const zeroes = sha256::block_length - sizeof(u64);
+
+        //Write the zeroes
+        byte* p   = result_buffer;
+        byte* end = result_buffer + zeroes;
+        while (p != end) *(p++) = 0;
+
+        //Write the length
+        u64 const bit_count = message_length * 8;
+        sha256_detail::write_be_u64(p, bit_count);
 
         //We're done
         return true;
     }
 
     //The user should pass full blocks to update_transform
-    assert(data_length < sha256::block_length);
+    BKH_ASSERT(data_length < sha256::block_length);
 
     //Check if we can skip the copying
     if (data != result_buffer) 
-        unsafe_copy(result_buffer, data, data_length);
+        sha256_detail::unsafe_copy(result_buffer, data, data_length);
 
     //Write the 0x80 byte
     byte* p = result_buffer + data_length;
@@ -464,7 +1976,7 @@ bool bkh::sha256::sha256_context::pad_block(byte const* data, u64 data_length, u
 
         //Write the length
         u64 const bit_count = message_length * 8;
-        write_be_u64(p, bit_count);
+        sha256_detail::write_be_u64(p, bit_count);
 
         //We're done
         return true;
@@ -481,69 +1993,293 @@ bool bkh::sha256::sha256_context::pad_block(byte const* data, u64 data_length, u
     return false;
 }
 
-void bkh::sha256::sha256_context::get_digest(byte* result_buffer) noexcept
+BKH_SHA256_INLINE void bkh::sha256::sha256_context::get_digest(byte* result_buffer) noexcept
+{
+    sha256_detail::store_digest(this->state, result_buffer);
+}
+
+BKH_SHA256_INLINE void bkh::sha256::sha256_context::clear_state() noexcept
+{
+    /**
+     * Prepare a volatile pointer which will not have its writes
+     * optimized away by the compiler.
+     */
+    auto* vptr = reinterpret_cast<char volatile*>(this->state);
+    for (int i = sizeof(this->state); i--;)
+    {
+        *(vptr++) = 0;
+    }
+}
+
+BKH_SHA256_INLINE void bkh::sha256::sha256_context::get_state(word* result_buffer) const noexcept
 {
     //Get the number of words in the state
     constexpr int const count = sizeof(this->state) / sizeof(word);
 
-    //Iterate over the words
     for (int i = 0; i < count; i++)
     {
-        //Read the word
-        word const &w = this->state[i];
+        result_buffer[i] = this->state[i];
+    }
+}
 
-        //Insert the bytes in big-endian order
-        result_buffer[i * 4 + 0] = static_cast<byte>((w & 0xFF000000u) >> 24u);
-        result_buffer[i * 4 + 1] = static_cast<byte>((w & 0x00FF0000u) >> 16u);
-        result_buffer[i * 4 + 2] = static_cast<byte>((w & 0x0000FF00u) >>  8u);
-        result_buffer[i * 4 + 3] = static_cast<byte>((w & 0x000000FFu) >>  0u);
+BKH_SHA256_INLINE void bkh::sha256::sha256_context::set_state(word const* words) noexcept
+{
+    //Get the number of words in the state
+    constexpr int const count = sizeof(this->state) / sizeof(word);
+
+    for (int i = 0; i < count; i++)
+    {
+        this->state[i] = words[i];
     }
 }
 
-void bkh::sha256::sha256_context::clear_state() noexcept
+BKH_SHA256_INLINE void bkh::sha256::sha256_hasher::init() noexcept
 {
-    /**
-     * Prepare a volatile pointer which will not have its writes
-     * optimized away by the compiler.
-     */
-    auto* vptr = reinterpret_cast<char volatile*>(this->state);
-    for (int i = sizeof(this->state); --i;)
+    this->ctx.init();
+    this->length = 0;
+}
+
+BKH_SHA256_INLINE void bkh::sha256::sha256_hasher::init(midstate const& m) noexcept
+{
+    //A midstate is always on a block boundary
+    BKH_ASSERT(m.length % block_length == 0);
+
+    this->ctx.set_state(m.state);
+    this->length = m.length;
+}
+
+BKH_SHA256_INLINE bool bkh::sha256::sha256_hasher::save_midstate(midstate* result) const noexcept
+{
+    //Only possible when nothing is buffered
+    if (this->length % block_length != 0) return false;
+
+    this->ctx.get_state(result->state);
+    result->length = this->length;
+    return true;
+}
+
+BKH_SHA256_INLINE bkh::u64 bkh::sha256::sha256_hasher::save_checkpoint(byte* result) const noexcept
+{
+    auto const buffered = static_cast<u64>(this->length % block_length);
+
+    //Write the header
+    result[0] = 'S';
+    result[1] = 'H';
+    result[2] = 'C';
+    result[3] = 'P';
+    result[4] = sha256_detail::checkpoint_version;
+    result[5] = static_cast<byte>(buffered);
+    result[6] = 0;
+    result[7] = 0;
+
+    //Write the intermediate hash value and the length in big-endian order
+    word state[8];
+    this->ctx.get_state(state);
+    sha256_detail::store_digest(state, result + 8);
+    for (int i = 0; i < 8; i++) result[40 + i] = static_cast<byte>(this->length >> (56 - 8 * i));
+
+    //Write the buffered bytes
+    sha256_detail::unsafe_copy(result + 48, this->buffer, buffered);
+
+    //Protect it with the start of its own digest
+    byte check[digest_length];
+    compute_hash(result, 48 + buffered, check);
+    sha256_detail::unsafe_copy(result + 48 + buffered, check, sha256_detail::checkpoint_check_length);
+
+    return 48 + buffered + sha256_detail::checkpoint_check_length;
+}
+
+BKH_SHA256_INLINE bool bkh::sha256::sha256_hasher::restore_checkpoint(byte const* data, u64 data_length) noexcept
+{
+    //Validate the header
+    if (data_length < 48 + sha256_detail::checkpoint_check_length) return false;
+    if (data[0] != 'S' || data[1] != 'H' || data[2] != 'C' || data[3] != 'P') return false;
+    if (data[4] != sha256_detail::checkpoint_version || data[6] != 0 || data[7] != 0) return false;
+
+    u64 const buffered = data[5];
+    if (buffered >= block_length || data_length != 48 + buffered + sha256_detail::checkpoint_check_length) return false;
+
+    //Validate the digest
+    byte check[digest_length];
+    compute_hash(data, 48 + buffered, check);
+    byte diff = 0;
+    for (int i = 0; i < sha256_detail::checkpoint_check_length; i++) diff |= static_cast<byte>(check[i] ^ data[48 + buffered + i]);
+    if (diff != 0) return false;
+
+    //Read the length, which must agree with the buffered bytes
+    u64 length = 0;
+    for (int i = 0; i < 8; i++) length = (length << 8) | data[40 + i];
+    if (length % block_length != buffered || length >= max_message_length) return false;
+
+    //Read the intermediate hash value
+    word state[8];
+    for (int i = 0; i < 8; i++)
     {
-        *(vptr++) = 0;
+        state[i] = (static_cast<word>(data[8 + 4 * i + 0]) << 24) |
+                   (static_cast<word>(data[8 + 4 * i + 1]) << 16) |
+                   (static_cast<word>(data[8 + 4 * i + 2]) <<  8) |
+                   (static_cast<word>(data[8 + 4 * i + 3]) <<  0);
     }
+
+    this->ctx.set_state(state);
+    this->length = length;
+    sha256_detail::unsafe_copy(this->buffer, data + 48, buffered);
+    return true;
 }
 
-void bkh::sha256::compute_hash(byte const* data, u64 data_length, byte* result) noexcept
+BKH_SHA256_INLINE void bkh::sha256::sha256_hasher::update(byte const* data, u64 data_length) noexcept
 {
-    constexpr u64 const mask = ~static_cast<u64>(block_length - 1);
+    BKH_INSTRUMENT(hasher_update, data_length);
+
+    //Check how much is already buffered
+    auto const buffered = static_cast<u64>(this->length % block_length);
+    this->length += data_length;
 
-    //Mask away the stuff we have to handle separately
-    auto const masked_length = data_length & mask;
+    //Try to complete the buffered block first
+    if (buffered > 0)
+    {
+        //Check if it's still incomplete
+        auto const missing = block_length - buffered;
+        if (data_length < missing)
+        {
+            sha256_detail::unsafe_copy(this->buffer + buffered, data, data_length);
+            return;
+        }
+
+        //Complete it and perform the transform
+        sha256_detail::unsafe_copy(this->buffer + buffered, data, missing);
+        this->ctx.transform_block(this->buffer);
+        data        += missing;
+        data_length -= missing;
+    }
 
-    //Prepare our pointers
-    byte const*       p   = data;
-    byte const* const end = data + masked_length;
+    //Transform the full blocks straight from the input
+    auto const blocks = data_length / block_length;
+    this->ctx.transform_blocks(data, blocks);
+
+    //Buffer whatever is left
+    auto const consumed = blocks * block_length;
+    sha256_detail::unsafe_copy(this->buffer, data + consumed, data_length - consumed);
+}
+
+BKH_SHA256_INLINE bkh::u64 bkh::sha256::sha256_hasher::get_length() const noexcept
+{
+    return this->length;
+}
+
+BKH_SHA256_INLINE void bkh::sha256::sha256_hasher::finalize(byte* result_buffer) noexcept
+{
+    //Perform the padding in-place
+    auto const buffered = static_cast<u64>(this->length % block_length);
+    BKH_INSTRUMENT(hasher_finalize, buffered);
+    bool done = context::pad_block(this->buffer, buffered, this->length, this->buffer);
+
+    //Handle the final block(s)
+    this->ctx.transform_block(this->buffer);
+    if (!done)
+    {
+        context::pad_block(nullptr, 0, this->length, this->buffer);
+        this->ctx.transform_block(this->buffer);
+    }
+
+    //Retrieve the message digest
+    this->ctx.get_digest(result_buffer);
+    this->clear_state();
+}
+
+BKH_SHA256_INLINE void bkh::sha256::sha256_hasher::clear_state() noexcept
+{
+    //Clear the intermediate hash value
+    this->ctx.clear_state();
+
+    //Clear the buffer the same way
+    auto* vptr = reinterpret_cast<char volatile*>(this->buffer);
+    for (int i = sizeof(this->buffer); i--;)
+    {
+        *(vptr++) = 0;
+    }
+    this->length = 0;
+}
+
+BKH_SHA256_INLINE void bkh::sha256::compute_hash(byte const* data, u64 data_length, byte* result) noexcept
+{
+    BKH_INSTRUMENT(compute_hash, data_length);
+
+    //Split the message into full blocks and the remainder
+    auto const blocks    = data_length / block_length;
+    auto const remaining = data_length % block_length;
 
     //Setup the context
     context ctx;
     ctx.init();
 
-    //Iterate over the blocks
-    while (p != end)
+    //Perform the transform on all the full blocks at once
+    ctx.transform_blocks(data, blocks);
+
+    //Perform the padding, making sure a null `data` isn't mistaken for a padding-only block
+    byte buf[block_length];
+    byte const* rest = (remaining > 0) ? data + (data_length - remaining) : buf;
+    bool done = context::pad_block(rest, remaining, data_length, buf);
+
+    //Handle the final block(s)
+    ctx.transform_block(buf);
+    if (!done)
     {
-        //Perform the transform and advance
-        ctx.transform_block(p);
-        p += block_length;
+        context::pad_block(nullptr, 0, data_length, buf);
+        ctx.transform_block(buf);
     }
 
-    //Calculate the remaining data
-    auto const remaining = data_length - masked_length;
+    //Retrieve the message digest
+    ctx.get_digest(result);
+    ctx.clear_state();
+}
+
+BKH_SHA256_INLINE void bkh::sha256::compute_hash_segments(segment const* segments, u64 count, byte* result) noexcept
+{
+    //The length goes into the padding
+    u64 data_length = 0;
+    for (u64 i = 0; i < count; i++) data_length += segments[i].length;
 
-    //Perform the padding
-    byte buf[block_length];
-    bool done = context::pad_block(p, remaining, data_length, buf);
+    BKH_INSTRUMENT(compute_hash, data_length);
 
-    //Handle the final block(s)
+    //Setup the context
+    context ctx;
+    ctx.init();
+
+    //Pieces of blocks straddling two or more segments are gathered here, zeroed as the padding is handed it even when nothing is left over
+    byte buf[block_length]{};
+    u64  buffered = 0;
+    for (u64 i = 0; i < count; i++)
+    {
+        byte const* data   = segments[i].data;
+        u64         length = segments[i].length;
+
+        //Try to complete the buffered block first
+        if (buffered > 0)
+        {
+            auto const missing = block_length - buffered;
+            auto const take    = (length < missing) ? length : missing;
+            sha256_detail::unsafe_copy(buf + buffered, data, take);
+            buffered += take;
+            data     += take;
+            length   -= take;
+
+            if (buffered < block_length) continue;
+            ctx.transform_block(buf);
+            buffered = 0;
+        }
+
+        //Transform the full blocks in place
+        auto const blocks = length / block_length;
+        ctx.transform_blocks(data, blocks);
+
+        //Buffer whatever is left
+        buffered = length % block_length;
+        sha256_detail::unsafe_copy(buf, data + blocks * block_length, buffered);
+    }
+
+    //Perform the padding in-place and handle the final block(s)
+    bool done = context::pad_block(buf, buffered, data_length, buf);
     ctx.transform_block(buf);
     if (!done)
     {
@@ -555,3 +2291,212 @@ void bkh::sha256::compute_hash(byte const* data, u64 data_length, byte* result)
     ctx.get_digest(result);
     ctx.clear_state();
 }
+
+BKH_SHA256_INLINE bool bkh::sha256::set_backend(backend b) noexcept
+{
+    //Restore the feature detection
+    if (b == backend::automatic)
+    {
+        sha256_detail::select_backend(sha256_detail::best_backend());
+        return true;
+    }
+
+    //Refuse anything the host can't run
+    if (!sha256_detail::backend_supported(b)) return false;
+
+    //Use it from now on
+    sha256_detail::select_backend(b);
+    return true;
+}
+
+BKH_SHA256_INLINE bkh::sha256::backend bkh::sha256::get_backend() noexcept
+{
+    //Make sure the detection has been performed
+    backend const b = sha256_detail::load_relaxed(sha256_detail::sha256_backend);
+    if (b != backend::automatic) return b;
+
+    backend const best = sha256_detail::best_backend();
+    sha256_detail::select_backend(best);
+    return best;
+}
+
+BKH_SHA256_INLINE bool bkh::sha256::is_backend_supported(backend b) noexcept
+{
+    return sha256_detail::backend_supported(b);
+}
+
+BKH_SHA256_INLINE void bkh::sha256::compute_hash_batch(message const* messages, u64 count) noexcept
+{
+    //Start every message from the initial hash value
+    midstate initial;
+    for (int i = 0; i < 8; i++) initial.state[i] = sha256_detail::sha256_initial_hash_value[i];
+    initial.length = 0;
+
+    compute_hash_batch(initial, messages, count);
+}
+
+BKH_SHA256_INLINE void bkh::sha256::compute_hash_batch(midstate const& prefix, message const* messages, u64 count) noexcept
+{
+    //A midstate is always on a block boundary
+    BKH_ASSERT(prefix.length % block_length == 0);
+
+    //Make sure the backends have been resolved
+    batch_backend const selected = sha256_detail::selected_batch_backend();
+
+#if defined(BKH_SHA256_INSTRUMENT)
+    u64 bytes, blocks;
+    sha256_detail::count_batch(messages, count, &bytes, &blocks);
+    BKH_INSTRUMENT(compute_hash_batch, bytes);
+    BKH_INSTRUMENT_BLOCKS(batch_backend_blocks, selected, blocks);
+#endif
+
+    switch (selected)
+    {
+#if defined(BKH_SHA256_X86)
+        //Lanes are only worth draining early if the single-stream transform is fast
+        case batch_backend::avx512:
+            sha256_detail::multi_buffer_hash<16>(prefix, messages, count, sha256_detail::transform_avx512_x16, (get_backend() == backend::shani) ? 4 : 1);
+            break;
+        case batch_backend::avx2:
+            sha256_detail::multi_buffer_hash<8>(prefix, messages, count, sha256_detail::transform_avx2_x8, (get_backend() == backend::shani) ? 2 : 1);
+            break;
+#endif
+        default:
+            for (u64 i = 0; i < count; i++)
+            {
+                hasher h;
+                h.init(prefix);
+                h.update(messages[i].data, messages[i].length);
+                h.finalize(messages[i].result);
+            }
+            break;
+    }
+}
+
+BKH_SHA256_INLINE bool bkh::sha256::set_batch_backend(batch_backend b) noexcept
+{
+    //Restore the feature detection
+    if (b == batch_backend::automatic)
+    {
+        sha256_detail::store_relaxed(sha256_detail::sha256_batch_backend, sha256_detail::best_batch_backend());
+        return true;
+    }
+
+    //Refuse anything the host can't run
+    if (!sha256_detail::batch_backend_supported(b)) return false;
+
+    //Use it from now on
+    sha256_detail::store_relaxed(sha256_detail::sha256_batch_backend, b);
+    return true;
+}
+
+BKH_SHA256_INLINE bkh::sha256::batch_backend bkh::sha256::get_batch_backend() noexcept
+{
+    //Make sure the detection has been performed
+    return sha256_detail::selected_batch_backend();
+}
+
+BKH_SHA256_INLINE bool bkh::sha256::is_batch_backend_supported(batch_backend b) noexcept
+{
+    return sha256_detail::batch_backend_supported(b);
+}
+
+BKH_SHA256_INLINE int bkh::sha256::get_lane_count() noexcept
+{
+    switch (get_batch_backend())
+    {
+        case batch_backend::avx512: return 16;
+        case batch_backend::avx2:   return 8;
+        default:                    return 1;
+    }
+}
+
+BKH_SHA256_INLINE void bkh::sha256::transform_lanes(word* state, word const* words) noexcept
+{
+    BKH_INSTRUMENT(transform_lanes, static_cast<u64>(get_lane_count()) * block_length);
+    BKH_INSTRUMENT_BLOCKS(batch_backend_blocks, get_batch_backend(), get_lane_count());
+
+    switch (get_batch_backend())
+    {
+#if defined(BKH_SHA256_X86)
+        case batch_backend::avx512:
+            sha256_detail::transform_avx512_x16_words(state, words);
+            break;
+        case batch_backend::avx2:
+            sha256_detail::transform_avx2_x8_words(state, words);
+            break;
+#endif
+        default:
+            sha256_detail::transform_words_serial(state, words);
+            break;
+    }
+}
+
+#if defined(BKH_SHA256_INSTRUMENT)
+BKH_SHA256_INLINE void bkh::sha256::get_statistics(statistics* result) noexcept
+{
+    //Copy every counter atomically, as other threads may be updating them
+    auto& c = sha256_detail::sha256_counters;
+    for (int i = 0; i < operation_count; i++)
+    {
+        auto& src = c.operations[i];
+        auto& dst = result->operations[i];
+        sha256_detail::atomic_copy(&dst.calls, &src.calls, 1);
+        sha256_detail::atomic_copy(&dst.bytes, &src.bytes, 1);
+        sha256_detail::atomic_copy(&dst.ticks, &src.ticks, 1);
+        sha256_detail::atomic_copy(&dst.latency[0][0], &src.latency[0][0], size_buckets * latency_buckets);
+    }
+    sha256_detail::atomic_copy(result->backend_blocks,       c.backend_blocks,       backend_count);
+    sha256_detail::atomic_copy(result->batch_backend_blocks, c.batch_backend_blocks, batch_backend_count);
+
+    //Report the backends which would be used now
+    result->selected_backend       = get_backend();
+    result->selected_batch_backend = get_batch_backend();
+}
+
+BKH_SHA256_INLINE void bkh::sha256::reset_statistics() noexcept
+{
+    //The counters are nothing but u64s, so clear them as such
+    constexpr u64 const count = sizeof(sha256_detail::counters) / sizeof(u64);
+    static_assert(sizeof(sha256_detail::counters) % sizeof(u64) == 0);
+
+    sha256_detail::atomic_clear(reinterpret_cast<u64*>(&sha256_detail::sha256_counters), count);
+}
+
+BKH_SHA256_INLINE void bkh::sha256::set_hooks(hook begin, hook end, void* user) noexcept
+{
+    sha256_detail::sha256_hook_user  = user;
+    sha256_detail::sha256_begin_hook = begin;
+    sha256_detail::sha256_end_hook   = end;
+}
+#endif
+
+/**
+ * In header-only mode this file is included by sha256.h, so the
+ * macros must not leak into the including file.
+ */
+#if defined(BKH_SHA256_HEADER_ONLY)
+#    undef BKH_ASSERT
+#    undef BKH_INTERNAL
+#    undef BKH_INTERNAL_INLINE
+#    undef BKH_SHA256_INLINE
+#    undef BKH_RESTRICT
+#    undef BKH_TARGET
+#    undef BKH_PREFETCH
+#    undef BKH_ALWAYS_INLINE
+#    undef BKH_INSTRUMENT
+#    undef BKH_INSTRUMENT_BLOCKS
+#    undef BKH_SHA256_X86
+#    if defined(BKH_SHA256_DEFINED_LITTLE_ENDIAN)
+#        undef LITTLE_ENDIAN
+#        undef BKH_SHA256_DEFINED_LITTLE_ENDIAN
+#    endif
+#    if defined(BKH_SHA256_DEFINED_BIG_ENDIAN)
+#        undef BIG_ENDIAN
+#        undef BKH_SHA256_DEFINED_BIG_ENDIAN
+#    endif
+#    if defined(BKH_SHA256_DEFINED_BYTE_ORDER)
+#        undef BYTE_ORDER
+#        undef BKH_SHA256_DEFINED_BYTE_ORDER
+#    endif
+#endif
@@ -1,5 +1,5 @@
 #ifndef BKH_SHA256_H
-#define BKH_SHA256_h
+#define BKH_SHA256_H
 #pragma once
 
 /** sha256.h - Bendik Hillestad - Public Domain
@@ -17,7 +17,9 @@
  * to not rely on the C++ Standard Library nor the C runtime.
  *
  * Performance was not a goal when writing this code, however
- * it should not be slower than most implementations.
+ * it should not be slower than most implementations. The
+ * benchmark directory measures it across message sizes and
+ * backends.
  *
  * Using the API:
  * For convenience, a high-level API is provided for computing
@@ -33,10 +35,32 @@
     byte result[sha256::digest_length];
     sha256::compute_hash(vec.data(), vec.size(), result);
 
- * For more advanced cases, such as when computing the digest
- * of an unknown-length stream of data, a lower level API is
- * provided. Note that this API does not track the length of
- * the message for you, any bookkeeping is left to the user.
+ * When the message arrives in pieces, such as when reading
+ * from a stream, the hasher takes care of the buffering.
+ * Example:
+
+    using byte = unsigned char;
+
+    //Prepare the hasher
+    sha256::hasher h;
+    h.init();
+
+    //Feed it pieces of any length
+    byte buf[4096];
+    int read;
+    while ((read = read_some_data(buf, sizeof(buf))) > 0)
+    {
+        h.update(buf, read);
+    }
+
+    //Retrieve the message digest
+    byte digest[sha256::digest_length];
+    h.finalize(digest);
+
+ * For more advanced cases, where the blocks are managed by
+ * the user, a lower level API is provided. Note that this API
+ * does not track the length of the message for you, any
+ * bookkeeping is left to the user.
  * Example:
 
     using byte = unsigned char;
@@ -146,6 +170,195 @@ static_assert(sizeof(bkh::u64) == 8);
 
 namespace bkh
 {
+    /**
+     * The building blocks of SHA-256, which are constexpr such
+     * that digests can also be computed at compile time. Not
+     * meant to be used directly.
+     */
+    namespace sha256_detail
+    {
+        /* Types defined for SHA-256 */
+
+        using byte = u8;
+        using word = u32;
+
+        /* Operations defined for SHA-256 */
+
+        /**
+         * Discards the right-most n bits of the word and pads the result
+         * with n zero bits on the left.
+         */
+        constexpr word right_shift(word x, byte n) noexcept
+        {
+            return static_cast<word>(x >> n);
+        }
+
+        /**
+         * Discards the left-most n bits of the word and pads the result
+         * with n zero bits on the right.
+         */
+        constexpr word left_shift(word x, byte n) noexcept
+        {
+            return static_cast<word>(x << n);
+        }
+
+        /**
+         * Performs the bitwise-and operation, where each bit in the result
+         * is 1 if both words have a 1 in the same location, otherwise it
+         * is 0.
+         */
+        constexpr word bitwise_and(word lhs, word rhs) noexcept
+        {
+            return lhs & rhs;
+        }
+
+        /**
+         * Performs the bitwise-or ("inclusive-or") operation, where each
+         * bit in the result is 1 if either word has a 1 in the same
+         * location, otherwise it is 0.
+         */
+        constexpr word bitwise_or(word lhs, word rhs) noexcept
+        {
+            return lhs | rhs;
+        }
+
+        /**
+         * Performs the bitwise-xor ("exclusive-or") operation, where each
+         * bit in the result is 1 if only one word has a 1 in the same
+         * location, otherwise it is 0.
+         */
+        constexpr word bitwise_xor(word lhs, word rhs) noexcept
+        {
+            return lhs ^ rhs;
+        }
+
+        /**
+         * Performs the bitwise-complement operation, where each bit in
+         * the result is the opposite of what is in the input.
+         */
+        constexpr word bitwise_complement(word x) noexcept
+        {
+            return ~x;
+        }
+
+        /**
+         * Performs the rotate right (circular right shift) operation,
+         * which is defined as: right_rotate(x, n) := 
+         *     bitwise_or(right_shift(x, n), left_shift(x, w - n))
+         * where w is the number of bits in a word.
+         * The operation is thus equivalent to a circular shift
+         * of x by n positions to the right.
+         */
+        constexpr word right_rotate(word x, byte n) noexcept
+        {
+            constexpr byte const w = sizeof(word) * 8;
+
+            word const rs = right_shift(x, n);
+            word const ls = left_shift (x, w - n);
+
+            return bitwise_or(rs, ls);
+        }
+
+        /* Functions defined for SHA-256 */
+
+        /**
+         * The first of six logical functions defined for SHA-256.
+         * Referred to as "Ch" in the specification.
+         */
+        constexpr word F0(word x, word y, word z) noexcept
+        {
+            word const l = bitwise_and(x, y);
+            word const r = bitwise_and(bitwise_complement(x), z);
+
+            return bitwise_xor(l, r);
+        }
+
+        /**
+         * The second of six logical functions defined for SHA-256.
+         * Referred to as "Maj" in the specification.
+         */
+        constexpr word F1(word x, word y, word z) noexcept
+        {
+            word const t0 = bitwise_and(x, y);
+            word const t1 = bitwise_and(x, z);
+            word const t2 = bitwise_and(y, z);
+
+            return bitwise_xor
+            (
+                bitwise_xor(t0, t1),
+                t2
+            );
+        }
+
+        /**
+         * The third of six logical functions defined for SHA-256.
+         * Referred to as "Sigma0" in the specification.
+         */
+        constexpr word F2(word x) noexcept
+        {
+            word const t0 = right_rotate(x,  2);
+            word const t1 = right_rotate(x, 13);
+            word const t2 = right_rotate(x, 22);
+
+            return bitwise_xor
+            (
+                bitwise_xor(t0, t1),
+                t2
+            );
+        }
+
+        /**
+         * The fourth of six logical functions defined for SHA-256.
+         * Referred to as "Sigma1" in the specification.
+         */
+        constexpr word F3(word x) noexcept
+        {
+            word const t0 = right_rotate(x,  6);
+            word const t1 = right_rotate(x, 11);
+            word const t2 = right_rotate(x, 25);
+
+            return bitwise_xor
+            (
+                bitwise_xor(t0, t1),
+                t2
+            );
+        }
+
+        /**
+         * The fifth of six logical functions defined for SHA-256.
+         * Referred to as "sigma0" in the specification.
+         */
+        constexpr word F4(word x) noexcept
+        {
+            word const t0 = right_rotate(x,  7);
+            word const t1 = right_rotate(x, 18);
+            word const t2 = right_shift (x,  3);
+
+            return bitwise_xor
+            (
+                bitwise_xor(t0, t1),
+                t2
+            );
+        }
+
+        /**
+         * The last of six logical functions defined for SHA-256.
+         * Referred to as "sigma1" in the specification.
+         */
+        constexpr word F5(word x) noexcept
+        {
+            word const t0 = right_rotate(x, 17);
+            word const t1 = right_rotate(x, 19);
+            word const t2 = right_shift (x, 10);
+
+            return bitwise_xor
+            (
+                bitwise_xor(t0, t1),
+                t2
+            );
+        }
+    };
+
     struct sha256
     {
         static constexpr int const block_length       = 512 / 8;
@@ -155,6 +368,106 @@ namespace bkh
         using byte = u8;
         using word = u32;
 
+        /**
+         * The 64 round constants of the transform, the first
+         * 32 bits of the fractional parts of the cube roots of
+         * the first 64 prime numbers.
+         */
+        static constexpr word const round_constants[64]
+        {
+            0x428A2F98u, 0x71374491u, 0xB5C0FBCFu, 0xE9B5DBA5u,
+            0x3956C25Bu, 0x59F111F1u, 0x923F82A4u, 0xAB1C5ED5u,
+            0xD807AA98u, 0x12835B01u, 0x243185BEu, 0x550C7DC3u,
+            0x72BE5D74u, 0x80DEB1FEu, 0x9BDC06A7u, 0xC19BF174u,
+            0xE49B69C1u, 0xEFBE4786u, 0x0FC19DC6u, 0x240CA1CCu,
+            0x2DE92C6Fu, 0x4A7484AAu, 0x5CB0A9DCu, 0x76F988DAu,
+            0x983E5152u, 0xA831C66Du, 0xB00327C8u, 0xBF597FC7u,
+            0xC6E00BF3u, 0xD5A79147u, 0x06CA6351u, 0x14292967u,
+            0x27B70A85u, 0x2E1B2138u, 0x4D2C6DFCu, 0x53380D13u,
+            0x650A7354u, 0x766A0ABBu, 0x81C2C92Eu, 0x92722C85u,
+            0xA2BFE8A1u, 0xA81A664Bu, 0xC24B8B70u, 0xC76C51A3u,
+            0xD192E819u, 0xD6990624u, 0xF40E3585u, 0x106AA070u,
+            0x19A4C116u, 0x1E376C08u, 0x2748774Cu, 0x34B0BCB5u,
+            0x391C0CB3u, 0x4ED8AA4Au, 0x5B9CCA4Fu, 0x682E6FF3u,
+            0x748F82EEu, 0x78A5636Fu, 0x84C87814u, 0x8CC70208u,
+            0x90BEFFFAu, 0xA4506CEBu, 0xBEF9A3F7u, 0xC67178F2u
+        };
+
+        /**
+         * The initial hash value, the first 32 bits of the
+         * fractional parts of the square roots of the first 8
+         * prime numbers.
+         */
+        static constexpr word const initial_hash_value[8]
+        {
+            0x6A09E667u, 0xBB67AE85u, 0x3C6EF372u, 0xA54FF53Au,
+            0x510E527Fu, 0x9B05688Cu, 0x1F83D9ABu, 0x5BE0CD19u
+        };
+
+        /**
+         * A message digest as a value, as returned by the
+         * constexpr hashing. It is aligned to its size, so it
+         * never straddles a cache line and loads as a single
+         * vector. Digests compare equal bytewise and order
+         * like their bytes, i.e. like memcmp, and the
+         * comparisons are written such that compilers turn
+         * them into a few wide loads. They are constexpr as
+         * well. Since the bytes of a digest are uniformly
+         * distributed any part of it is as good a hash as any,
+         * which is what prefix returns.
+         */
+        struct alignas(digest_length) digest
+        {
+            byte bytes[digest_length];
+
+            /**
+             * Retrieves the eight bytes at 8 * i as a big-endian
+             * word, where i is between 0 and 3.
+             */
+            constexpr u64 word64(int i) const noexcept
+            {
+                //Spelled out, this is a single load and byte swap
+                byte const* p = bytes + 8 * i;
+                return (static_cast<u64>(p[0]) << 56) | (static_cast<u64>(p[1]) << 48) |
+                       (static_cast<u64>(p[2]) << 40) | (static_cast<u64>(p[3]) << 32) |
+                       (static_cast<u64>(p[4]) << 24) | (static_cast<u64>(p[5]) << 16) |
+                       (static_cast<u64>(p[6]) <<  8) | (static_cast<u64>(p[7]) <<  0);
+            }
+
+            /**
+             * Retrieves the first eight bytes, for use as a hash.
+             */
+            constexpr u64 prefix() const noexcept
+            {
+                return word64(0);
+            }
+
+            friend constexpr bool operator==(digest const& lhs, digest const& rhs) noexcept
+            {
+                //Without early exits this is vectorized
+                byte diff = 0;
+                for (int i = 0; i < digest_length; i++) diff |= static_cast<byte>(lhs.bytes[i] ^ rhs.bytes[i]);
+
+                return diff == 0;
+            }
+
+            friend constexpr bool operator<(digest const& lhs, digest const& rhs) noexcept
+            {
+                //Comparing big-endian words orders like the bytes
+                for (int i = 0; i < 3; i++)
+                {
+                    if (lhs.word64(i) != rhs.word64(i)) return lhs.word64(i) < rhs.word64(i);
+                }
+
+                return lhs.word64(3) < rhs.word64(3);
+            }
+
+            friend constexpr bool operator!=(digest const& lhs, digest const& rhs) noexcept { return !(lhs == rhs); }
+            friend constexpr bool operator> (digest const& lhs, digest const& rhs) noexcept { return rhs < lhs; }
+            friend constexpr bool operator<=(digest const& lhs, digest const& rhs) noexcept { return !(rhs < lhs); }
+            friend constexpr bool operator>=(digest const& lhs, digest const& rhs) noexcept { return !(lhs < rhs); }
+        };
+
         /**
          * Computes the SHA-256 hash of an octet string. The result
          * is written to the provided `result` pointer, which is
@@ -167,6 +480,362 @@ namespace bkh
             byte*       result
         ) noexcept;
 
+        /**
+         * A piece of a message stored elsewhere, like an iovec.
+         */
+        struct segment
+        {
+            byte const* data;
+            u64         length;
+        };
+
+        /**
+         * Computes the SHA-256 hash of the message made up of
+         * the segments in order, such as a header, a body in
+         * several fragments and a trailer, without gathering
+         * them into one buffer first. Blocks that lie within a
+         * segment are transformed where they are, and only the
+         * blocks straddling the boundary between segments are
+         * pieced together on the stack. Segments may be empty.
+         */
+        static void compute_hash_segments(
+            segment const* segments,
+            u64            count,
+            byte*          result
+        ) noexcept;
+
+        /**
+         * A snapshot of a message that has been hashed up to a
+         * block boundary, such as a long constant prefix shared
+         * by many messages. Restoring it resumes the hash as if
+         * the prefix had just been hashed, so the prefix only
+         * has to be hashed once.
+         */
+        struct midstate
+        {
+            word state[sha256::digest_length / sizeof(word)];
+            u64  length; //Bytes hashed so far, a multiple of block_length
+        };
+
+        /**
+         * Computes the SHA-256 hash of an octet string at
+         * compile time, for embedding precomputed digests in
+         * the binary. It works at runtime as well, but is far
+         * slower than compute_hash there.
+         * Example:
+
+            constexpr byte data[] = { 0x61, 0x62, 0x63 };
+            constexpr auto digest = sha256::compute_hash_constexpr(data, sizeof(data));
+
+         */
+        static constexpr digest compute_hash_constexpr(byte const* data, u64 data_length) noexcept
+        {
+            return hash_constexpr(data, data_length);
+        }
+
+        /**
+         * Same as above, but for character data, such as the
+         * contents of a string_view.
+         */
+        static constexpr digest compute_hash_constexpr(char const* data, u64 data_length) noexcept
+        {
+            return hash_constexpr(data, data_length);
+        }
+
+        /**
+         * Same as above, but for a string literal, excluding
+         * its null terminator.
+         * Example:
+
+            constexpr auto id = sha256::compute_hash_constexpr("assets/logo.png");
+
+         */
+        template <u64 N>
+        static constexpr digest compute_hash_constexpr(char const (&str)[N]) noexcept
+        {
+            static_assert(N > 0);
+            return hash_constexpr(str, N - 1);
+        }
+
+        /**
+         * Computes the SHA-256 hash of a message of exactly N
+         * bytes. The padding, including the length, is known
+         * at compile time, and a block consisting of nothing
+         * but padding has its message schedule prepared at
+         * compile time too. This is considerably faster than
+         * compute_hash for short messages such as the 64 byte
+         * nodes of a Merkle tree.
+         */
+        template <u64 N>
+        static void hash_fixed(byte const* data, byte* result) noexcept;
+
+        /**
+         * Computes the double SHA-256 hash of a message of
+         * exactly N bytes, i.e. SHA-256(SHA-256(message)),
+         * as used by Bitcoin for its 80 byte block headers.
+         */
+        template <u64 N>
+        static void sha256d(byte const* data, byte* result) noexcept;
+
+        /**
+         * A block whose message schedule has been computed
+         * ahead of time, with the round constants added.
+         */
+        struct prepared_block
+        {
+            word wk[64];
+        };
+
+        /**
+         * Computes the message schedule of a block, given as
+         * sixteen words in host byte order. Being constexpr,
+         * a constant block such as the padding of a fixed
+         * length message can be prepared at compile time.
+         */
+        static constexpr prepared_block prepare_block(word const* words) noexcept
+        {
+            using namespace sha256_detail;
+
+            word W[64]{};
+            for (int t = 0; t < 16; t++) W[t] = words[t];
+            for (int t = 16; t < 64; t++)
+            {
+                W[t] = static_cast<word>(F5(W[t - 2]) + W[t - 7] + F4(W[t - 15]) + W[t - 16]);
+            }
+
+            prepared_block result{};
+            for (int t = 0; t < 64; t++) result.wk[t] = static_cast<word>(W[t] + round_constants[t]);
+
+            return result;
+        }
+
+        /**
+         * Describes a single message of a batch, along with
+         * where to store its digest.
+         */
+        struct message
+        {
+            byte const* data;
+            u64         length;
+            byte*       result;
+        };
+
+        /**
+         * Computes the SHA-256 hash of each message in the
+         * batch. The messages are independent of each other
+         * and may have any length. Where the host supports it
+         * the messages are hashed in parallel using 8 (AVX2)
+         * or 16 (AVX-512) lanes, which is significantly
+         * faster than calling compute_hash for each message
+         * when there are many short messages.
+         */
+        static void compute_hash_batch(
+            message const* messages,
+            u64            count
+        ) noexcept;
+
+        /**
+         * Computes the SHA-256 hash of each message in the
+         * batch as if it were preceded by the prefix the
+         * midstate was taken after, i.e. the digest of
+         * prefix || message. The prefix is not rehashed.
+         */
+        static void compute_hash_batch(
+            midstate const& prefix,
+            message const*  messages,
+            u64             count
+        ) noexcept;
+
+        /**
+         * The implementations used by compute_hash_batch.
+         * By default the fastest one supported by the host
+         * is picked through CPUID on first use.
+         */
+        enum class batch_backend : u8
+        {
+            automatic, //Let CPU feature detection decide
+            serial,    //One message at a time, always available
+            avx2,      //8 lanes using AVX2
+            avx512     //16 lanes using AVX-512F
+        };
+
+        /**
+         * Forces compute_hash_batch to use a specific batch
+         * backend. Passing batch_backend::automatic restores
+         * the feature detection. Returns false, leaving the
+         * selection unchanged, if the backend is not
+         * supported by the host.
+         * Like set_backend this is not synchronized with
+         * hashing performed on other threads.
+         */
+        static bool set_batch_backend(batch_backend b) noexcept;
+
+        /**
+         * Retrieves the batch backend currently used. Never
+         * returns batch_backend::automatic.
+         */
+        static batch_backend get_batch_backend() noexcept;
+
+        /**
+         * Checks whether the batch backend was compiled in
+         * and can run on the host.
+         */
+        static bool is_batch_backend_supported(batch_backend b) noexcept;
+
+        /**
+         * The largest number of lanes any batch backend has.
+         */
+        static constexpr int const max_lanes = 16;
+
+        /**
+         * Retrieves the number of lanes of the batch backend
+         * currently used, i.e. the number of independent
+         * blocks processed by transform_lanes. This is 1 for
+         * batch_backend::serial.
+         */
+        static int get_lane_count() noexcept;
+
+        /**
+         * Performs the SHA-256 transform on one block in each
+         * lane of the batch backend currently used. With L
+         * being get_lane_count(), the intermediate hash values
+         * and the blocks are interleaved such that
+         * state[i * L + l] holds word i of the hash value of
+         * lane l, and words[t * L + l] holds word t of the
+         * block of lane l.
+         * The words are in host byte order, just like the hash
+         * value, so a digest can be fed straight back in as
+         * part of the next block. This makes it suited for
+         * long chains of short, fixed-length hashes such as
+         * the iterations of PBKDF2.
+         */
+        static void transform_lanes(word* state, word const* words) noexcept;
+
+        /**
+         * The implementations of the SHA-256 transform. By
+         * default the fastest one supported by the host is
+         * picked through CPUID on first use, falling back to
+         * the portable scalar implementation.
+         */
+        enum class backend : u8
+        {
+            automatic, //Let CPU feature detection decide
+            scalar,    //Portable C++, always available
+            shani,     //Intel SHA extensions
+            ssse3,     //Message schedule vectorized with SSSE3
+            avx2       //Message schedule of two blocks at once with AVX2
+        };
+
+        /**
+         * Forces the transform to use a specific backend,
+         * which affects both compute_hash and the context.
+         * Passing backend::automatic restores the feature
+         * detection. Returns false, leaving the selection
+         * unchanged, if the backend is not supported by
+         * the host.
+         * This is not synchronized with hashing performed
+         * on other threads, so it should be called before
+         * any hashing takes place, e.g. at startup.
+         */
+        static bool set_backend(backend b) noexcept;
+
+        /**
+         * Retrieves the backend currently used by the
+         * transform. Never returns backend::automatic.
+         */
+        static backend get_backend() noexcept;
+
+        /**
+         * Checks whether the backend was compiled in and
+         * can run on the host.
+         */
+        static bool is_backend_supported(backend b) noexcept;
+
+#if defined(BKH_SHA256_INSTRUMENT)
+        /**
+         * The operations observed by the instrumentation, which
+         * is only compiled in when BKH_SHA256_INSTRUMENT is
+         * defined. Operations performed on behalf of another are
+         * observed as well, e.g. the transforms performed by
+         * compute_hash are also counted as transforms.
+         */
+        enum class operation : u8
+        {
+            transform,          //context::transform_block, transform_blocks and transform_prepared
+            transform_lanes,    //transform_lanes
+            compute_hash,       //compute_hash
+            compute_hash_batch, //Either overload of compute_hash_batch
+            hasher_update,      //hasher::update
+            hasher_finalize     //hasher::finalize
+        };
+
+        /**
+         * The dimensions of the statistics. Messages are put in
+         * buckets by the base 2 logarithm of their size and the
+         * latency by that of the number of ticks they took,
+         * where bucket 0 holds 0, bucket i holds [2^(i-1), 2^i)
+         * and the last bucket everything above.
+         */
+        static constexpr int const operation_count     = 6;
+        static constexpr int const backend_count       = 5;
+        static constexpr int const batch_backend_count = 4;
+        static constexpr int const size_buckets        = 32;
+        static constexpr int const latency_buckets     = 32;
+
+        /**
+         * The statistics of a single operation. The ticks are
+         * those of the time-stamp counter on x86, and always 0
+         * elsewhere.
+         */
+        struct operation_statistics
+        {
+            u64 calls;
+            u64 bytes;
+            u64 ticks;
+            u64 latency[size_buckets][latency_buckets];
+        };
+
+        /**
+         * Everything observed since the start of the process or
+         * the last call to reset_statistics.
+         */
+        struct statistics
+        {
+            operation_statistics operations[operation_count];              //Indexed by operation
+            u64                  backend_blocks[backend_count];             //Blocks per backend
+            u64                  batch_backend_blocks[batch_backend_count]; //Blocks per batch backend
+            backend              selected_backend;
+            batch_backend        selected_batch_backend;
+        };
+
+        /**
+         * Called before and after every operation, with the
+         * number of bytes it hashes.
+         */
+        using hook = void (*)(void* user, operation op, u64 bytes);
+
+        /**
+         * Takes a snapshot of the statistics. Every counter is
+         * read atomically, but as hashing may take place on
+         * other threads meanwhile they may be slightly out of
+         * step with each other.
+         */
+        static void get_statistics(statistics* result) noexcept;
+
+        /**
+         * Resets every counter to 0.
+         */
+        static void reset_statistics() noexcept;
+
+        /**
+         * Installs the hooks called around every operation, e.g.
+         * to emit trace events. Either may be null. Like
+         * set_backend this is not synchronized with hashing
+         * performed on other threads.
+         */
+        static void set_hooks(hook begin, hook end, void* user) noexcept;
+#endif
+
         /**
          * A low-level hashing primitive.
          */
@@ -187,6 +856,23 @@ namespace bkh
              */
             void transform_block(byte const* data) noexcept;
 
+            /**
+             * Feeds `count` consecutive blocks to the SHA-256
+             * transform. Equivalent to calling transform_block
+             * for each block, but keeps the intermediate hash
+             * value in registers for the whole run, which is
+             * considerably faster for large messages.
+             */
+            void transform_blocks(byte const* data, u64 count) noexcept;
+
+            /**
+             * Feeds a single block to the SHA-256 transform,
+             * whose message schedule was computed ahead of
+             * time by sha256::prepare_block. Only the rounds
+             * remain to be performed.
+             */
+            void transform_prepared(prepared_block const& block) noexcept;
+
             /**
              * Pads the block according to the SHA-256
              * specification and stores the result in the
@@ -221,15 +907,299 @@ namespace bkh
              */
             void clear_state() noexcept;
 
+            /**
+             * Retrieves the intermediate hash value as
+             * eight words, which together with the number
+             * of bytes transformed so far can be used to
+             * resume the hash later on.
+             */
+            void get_state(word* result_buffer) const noexcept;
+
+            /**
+             * Replaces the intermediate hash value with the
+             * eight words previously retrieved by get_state.
+             * May be used in place of init.
+             */
+            void set_state(word const* words) noexcept;
+
         private:
             word state[sha256::digest_length / sizeof(word)];
         };
 
+        /**
+         * An incremental hashing primitive, which takes care
+         * of the buffering and length bookkeeping required to
+         * hash a message that arrives in pieces of arbitrary
+         * size. At most one partial block is held internally,
+         * every full block is transformed straight from the
+         * memory passed to update.
+         */
+        using hasher = struct sha256_hasher
+        {
+        public:
+            /**
+             * Prepares or resets the hasher. Must be called
+             * before computing the hash of a new message.
+             */
+            void init() noexcept;
+
+            /**
+             * Prepares the hasher to resume from a midstate,
+             * as if the prefix it was taken after had just
+             * been passed to update. The midstate itself is
+             * left unchanged and may be reused any number of
+             * times.
+             */
+            void init(midstate const& m) noexcept;
+
+            /**
+             * Takes a snapshot of the message hashed so far,
+             * which is only possible on a block boundary, i.e.
+             * when the total length passed to update is a
+             * multiple of sha256::block_length. Returns false,
+             * leaving `result` unchanged, otherwise.
+             * To duplicate a hasher that is not on a block
+             * boundary it can simply be copied.
+             */
+            bool save_midstate(midstate* result) const noexcept;
+
+            /**
+             * The size of the largest checkpoint.
+             */
+            static constexpr int const max_checkpoint_length = 56 + block_length - 1;
+
+            /**
+             * Serializes the hasher into a checkpoint, at any
+             * point of the message, such that the hash can be
+             * resumed from it later, even on another host, with
+             * restore_checkpoint. `result` is expected to hold
+             * at least max_checkpoint_length bytes, and the
+             * length of the checkpoint is returned. Every field
+             * is stored in big-endian order:
+             *   0:      the bytes "SHCP"
+             *   4:      the version of the format, 1
+             *   5:      the number of buffered bytes n, below 64
+             *   6:      two bytes of zero
+             *   8:      the intermediate hash value, 8 words
+             *   40:     the length of the message so far, 64 bits
+             *   48:     the n buffered bytes
+             *   48 + n: the first 8 bytes of the SHA-256 digest
+             *           of the checkpoint up to this point
+             * The digest protects against corruption, such as
+             * a truncated file, but not against tampering, for
+             * which it would have to be authenticated with a
+             * key, e.g. through sha256_hmac. Note that the
+             * checkpoint holds the last bytes of the message.
+             */
+            u64 save_checkpoint(byte* result) const noexcept;
+
+            /**
+             * Resumes from a checkpoint taken by save_checkpoint,
+             * after which the rest of the message is passed to
+             * update. Returns false, leaving the hasher
+             * unchanged, if the checkpoint is malformed, of an
+             * unknown version or corrupt.
+             */
+            bool restore_checkpoint(byte const* data, u64 data_length) noexcept;
+
+            /**
+             * Appends the data to the message. May be called
+             * any number of times with any length, including
+             * zero.
+             */
+            void update(byte const* data, u64 data_length) noexcept;
+
+            /**
+             * Retrieves the length of the message so far in
+             * bytes, including any prefix of the midstate it
+             * was started from.
+             */
+            u64 get_length() const noexcept;
+
+            /**
+             * Pads the message and retrieves its digest. The
+             * provided pointer is expected to point to a
+             * buffer with capacity equal to or greater than
+             * the sha256::digest_length. The internal state
+             * is cleared afterwards, so init must be called
+             * before the hasher is used again.
+             */
+            void finalize(byte* result_buffer) noexcept;
+
+            /**
+             * Clears the internal state, including any data
+             * that is still buffered.
+             */
+            void clear_state() noexcept;
+
+        private:
+            context ctx;
+            u64     length;
+            byte    buffer[sha256::block_length];
+        };
+
         sha256() = delete;
+
+    private:
+        /**
+         * Prepares a block consisting of nothing but the padding
+         * of a message of the given length, where `marker` tells
+         * whether it begins with the 0x80 byte or whether that
+         * fit in the block before it.
+         */
+        static constexpr prepared_block prepare_padding(u64 message_length, bool marker) noexcept
+        {
+            u64 const bit_count = message_length * 8;
+
+            word words[16]{};
+            words[ 0] = marker ? 0x80000000u : 0u;
+            words[14] = static_cast<word>(bit_count >> 32);
+            words[15] = static_cast<word>(bit_count >>  0);
+
+            return prepare_block(words);
+        }
+
+        /**
+         * Performs the SHA-256 transform of a prepared block in
+         * a way that can be evaluated at compile time.
+         */
+        static constexpr void transform_constexpr(word* state, prepared_block const& block) noexcept
+        {
+            using namespace sha256_detail;
+
+            //Initialize our eight working variables with previous state
+            word a = state[0], b = state[1], c = state[2], d = state[3],
+                 e = state[4], f = state[5], g = state[6], h = state[7];
+
+            //Perform the main transformation
+            for (int t = 0; t < 64; t++)
+            {
+                word const T1 = static_cast<word>(h + F3(e) + F0(e, f, g) + block.wk[t]);
+                word const T2 = static_cast<word>(F2(a) + F1(a, b, c));
+
+                h = g;
+                g = f;
+                f = e;
+                e = static_cast<word>(d + T1);
+                d = c;
+                c = b;
+                b = a;
+                a = static_cast<word>(T1 + T2);
+            }
+
+            //Calculate the intermediate hash value
+            state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+            state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+        }
+
+        /**
+         * Computes the SHA-256 hash of the message in a way that
+         * can be evaluated at compile time. The padded message
+         * is generated a byte at a time, as nothing can be
+         * reinterpreted or copied in bulk in a constant
+         * expression.
+         */
+        template <typename T>
+        static constexpr digest hash_constexpr(T const* data, u64 data_length) noexcept
+        {
+            //The message is followed by the byte 0x80 and its length, rounded up to whole blocks
+            u64 const bit_count = data_length * 8;
+            u64 const padded    = ((data_length + sizeof(u64)) / block_length + 1) * block_length;
+
+            word state[8]{};
+            for (int i = 0; i < 8; i++) state[i] = initial_hash_value[i];
+
+            for (u64 offset = 0; offset < padded; offset += block_length)
+            {
+                //Assemble the words of the padded block
+                word words[16]{};
+                for (int i = 0; i < block_length; i++)
+                {
+                    u64 const pos = offset + i;
+
+                    word value = 0;
+                    if      (pos <  data_length)          value = static_cast<byte>(data[pos]);
+                    else if (pos == data_length)          value = 0x80;
+                    else if (pos >= padded - sizeof(u64)) value = static_cast<byte>(bit_count >> (8 * (padded - 1 - pos)));
+
+                    words[i / 4] |= value << (8 * (3 - i % 4));
+                }
+
+                transform_constexpr(state, prepare_block(words));
+            }
+
+            //Store the words in big-endian order
+            digest result{};
+            for (int i = 0; i < digest_length; i++)
+            {
+                result.bytes[i] = static_cast<byte>(state[i / 4] >> (8 * (3 - i % 4)));
+            }
+
+            return result;
+        }
     };
 
     //Sanity check
     static_assert(sizeof(sha256::context) == sha256::digest_length);
+
+    template <u64 N>
+    inline void sha256::hash_fixed(byte const* data, byte* result) noexcept
+    {
+        static_assert(N < max_message_length);
+
+        //Split the message into full blocks and the remainder
+        constexpr u64  blocks    = N / block_length;
+        constexpr u64  remaining = N % block_length;
+        constexpr bool fits      = remaining + 1 + sizeof(u64) <= block_length; //The byte 0x80 + length of message
+
+        //Setup the context
+        context ctx;
+        ctx.init();
+
+        //Perform the transform on all the full blocks at once
+        ctx.transform_blocks(data, blocks);
+
+        //Finish the remainder with padding that is known at compile time
+        if constexpr (remaining > 0)
+        {
+            byte block[block_length];
+            for (u64 i = 0; i < remaining; i++) block[i] = data[blocks * block_length + i];
+            block[remaining] = 0x80;
+            for (u64 i = remaining + 1; i < block_length; i++) block[i] = 0;
+            if constexpr (fits)
+            {
+                for (int i = 0; i < 8; i++) block[block_length - 1 - i] = static_cast<byte>((N * 8) >> (8 * i));
+            }
+            ctx.transform_block(block);
+        }
+
+        //A block of only padding is the same every time, so its schedule is precomputed
+        if constexpr (remaining == 0 || !fits)
+        {
+            static constexpr prepared_block padding = prepare_padding(N, remaining == 0);
+            ctx.transform_prepared(padding);
+        }
+
+        //Retrieve the message digest
+        ctx.get_digest(result);
+        ctx.clear_state();
+    }
+
+    template <u64 N>
+    inline void sha256::sha256d(byte const* data, byte* result) noexcept
+    {
+        byte inner[digest_length];
+        hash_fixed<N>(data, inner);
+        hash_fixed<digest_length>(inner, result);
+    }
 };
 
+/**
+ * In header-only mode the implementation is included as well,
+ * such that the compiler can inline it at the call sites.
+ */
+#if defined(BKH_SHA256_HEADER_ONLY)
+#    include "sha256.cpp"
+#endif
+
 #endif
@@ -0,0 +1,455 @@
+/** sha256_cache.cpp - Bendik Hillestad - Public Domain
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sha256_cache.h"
+
+#include <cerrno>
+#include <ctime>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Types */
+
+using byte     = bkh::sha256_cache::byte;
+using identity = bkh::sha256_cache::identity;
+using mode     = bkh::sha256_file::mode;
+
+using bkh::u8;
+using bkh::u32;
+using bkh::u64;
+using bkh::sha256;
+using bkh::sha256_cache;
+using bkh::sha256_file;
+
+/* Helpers */
+
+/**
+ * Identifies the file as a cache of this layout.
+ */
+static constexpr u64 const cache_magic   = 0x3130434853484B42ull; //"BKHSHC01"
+static constexpr u32 const cache_version = 1;
+
+/**
+ * The number of consecutive entries a file may be stored in,
+ * starting from the one its identity hashes to.
+ */
+static constexpr u64 const probe_length = 8;
+
+/**
+ * How many times a lookup retries an entry that is being written
+ * before treating it as a miss.
+ */
+static constexpr int const read_attempts = 64;
+
+/**
+ * How old a modification must be for the file to be cached.
+ */
+static constexpr u64 const settle_time_ns = 2000000000ull;
+
+/**
+ * The first 64 bytes of the file.
+ */
+struct header
+{
+    u64 magic;
+    u32 version;
+    u32 entry_size;
+    u64 capacity; //A power of two
+    u32 clean;    //Whether the last process to close it did so cleanly
+    u32 reserved[9];
+};
+
+/**
+ * An entry of the table. The sequence number is odd while the
+ * entry is being written, and the checksum covers the rest.
+ */
+struct entry
+{
+    u32 sequence;
+    u8  valid;
+    u8  mode;
+    u8  reserved0[2];
+    u64 device;
+    u64 inode;
+    u64 size;
+    u64 mtime_ns;
+    u64 ctime_ns;
+    u64 digest[sha256::digest_length / 8];
+    u64 checksum;
+    u64 reserved1;
+};
+
+static_assert(sizeof(header) == 64);
+static_assert(sizeof(entry)  == 96);
+
+/**
+ * Mixes a word, the finalizer of SplitMix64.
+ */
+static u64 mix(u64 z) noexcept
+{
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+/**
+ * Picks the entry a file hashes to.
+ */
+static u64 home_slot(identity const& id) noexcept
+{
+    return mix(id.device * 0x9E3779B97F4A7C15ull + id.inode);
+}
+
+/**
+ * Computes the checksum of the contents of an entry.
+ */
+static u64 checksum(u8 mode, identity const& id, u64 const* digest) noexcept
+{
+    u64 h = mix(mode + 1);
+    h = mix(h ^ id.device);
+    h = mix(h ^ id.inode);
+    h = mix(h ^ id.size);
+    h = mix(h ^ id.mtime_ns);
+    h = mix(h ^ id.ctime_ns);
+    for (int i = 0; i < sha256::digest_length / 8; i++) h = mix(h ^ digest[i]);
+
+    return h;
+}
+
+template<typename T>
+static T load(T const& value) noexcept
+{
+    return __atomic_load_n(&value, __ATOMIC_RELAXED);
+}
+
+template<typename T>
+static void store_relaxed(T& value, T v) noexcept
+{
+    __atomic_store_n(&value, v, __ATOMIC_RELAXED);
+}
+
+/**
+ * Converts a timestamp to nanoseconds.
+ */
+static u64 to_ns(struct timespec const& ts) noexcept
+{
+    return static_cast<u64>(ts.tv_sec) * 1000000000ull + static_cast<u64>(ts.tv_nsec);
+}
+
+/**
+ * Fills in the identity from the status of a file.
+ */
+static void to_identity(struct stat const& info, identity* result) noexcept
+{
+    result->device   = static_cast<u64>(info.st_dev);
+    result->inode    = static_cast<u64>(info.st_ino);
+    result->size     = static_cast<u64>(info.st_size);
+    result->mtime_ns = to_ns(info.st_mtim);
+    result->ctime_ns = to_ns(info.st_ctim);
+}
+
+static bool same_identity(identity const& a, identity const& b) noexcept
+{
+    return a.device == b.device && a.inode == b.inode && a.size == b.size
+        && a.mtime_ns == b.mtime_ns && a.ctime_ns == b.ctime_ns;
+}
+
+/**
+ * Locates the table of a mapped cache.
+ */
+static entry* entries(void* map) noexcept
+{
+    return reinterpret_cast<entry*>(static_cast<byte*>(map) + sizeof(header));
+}
+
+/**
+ * Releases the lock of an entry claimed by a process that died
+ * while writing it, and drops the entry. Only done while no other
+ * process has the cache open, on the first open after a crash of
+ * the last process and by the last process to close it.
+ */
+static void repair(entry* table, u64 capacity) noexcept
+{
+    for (u64 i = 0; i < capacity; i++)
+    {
+        if ((table[i].sequence & 1) == 0) continue;
+
+        table[i].valid    = 0;
+        table[i].sequence = table[i].sequence + 1;
+    }
+}
+
+/* Implementation */
+
+bool bkh::sha256_cache::open(char const* path, u64 capacity) noexcept
+{
+    this->fd  = -1;
+    this->map = nullptr;
+
+    //Round the capacity up to a power of two
+    u64 c = probe_length;
+    while (c < capacity && c < (u64{ 1 } << 40)) c <<= 1;
+
+    int const f = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (f < 0) return false;
+
+    auto const fail = [f]()
+    {
+        int const error = errno;
+        ::close(f);
+        errno = error;
+        return false;
+    };
+
+    //Only the first process to open it may create or repair it, the others wait for it to finish
+    bool exclusive = true;
+    if (flock(f, LOCK_EX | LOCK_NB) != 0)
+    {
+        if (errno != EWOULDBLOCK) return fail();
+        exclusive = false;
+        while (flock(f, LOCK_SH) != 0)
+        {
+            if (errno != EINTR) return fail();
+        }
+    }
+
+    struct stat info;
+    if (fstat(f, &info) != 0) return fail();
+    if (info.st_size == 0 && exclusive)
+    {
+        header h{};
+        h.magic      = cache_magic;
+        h.version    = cache_version;
+        h.entry_size = sizeof(entry);
+        h.capacity   = c;
+        h.clean      = 1;
+
+        //The table is sparse, so only the entries in use take up space
+        if (ftruncate(f, static_cast<off_t>(sizeof(header) + c * sizeof(entry))) != 0) return fail();
+        if (pwrite(f, &h, sizeof(h), 0) != static_cast<ssize_t>(sizeof(h)))            return fail();
+        info.st_size = static_cast<off_t>(sizeof(header) + c * sizeof(entry));
+    }
+
+    //Validate the header
+    header h;
+    if (pread(f, &h, sizeof(h), 0) != static_cast<ssize_t>(sizeof(h))) return fail();
+    bool const valid = h.magic == cache_magic && h.version == cache_version && h.entry_size == sizeof(entry)
+                    && h.capacity >= probe_length && (h.capacity & (h.capacity - 1)) == 0
+                    && static_cast<u64>(info.st_size) == sizeof(header) + h.capacity * sizeof(entry);
+    if (!valid)
+    {
+        errno = EINVAL;
+        return fail();
+    }
+
+    u64 const size = sizeof(header) + h.capacity * sizeof(entry);
+    void* m = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, f, 0);
+    if (m == MAP_FAILED) return fail();
+
+    //Clean up after a crash if no one else has it open, then mark it as in use
+    auto* mapped = static_cast<header*>(m);
+    if (exclusive && !mapped->clean) repair(entries(m), h.capacity);
+    mapped->clean = 0;
+
+    //Keep a shared lock for as long as it is open, the last one to close it sees it released
+    if (exclusive) flock(f, LOCK_SH);
+
+    this->fd       = f;
+    this->map      = m;
+    this->map_size = size;
+    this->mask     = h.capacity - 1;
+    return true;
+}
+
+void bkh::sha256_cache::close() noexcept
+{
+    if (this->fd < 0) return;
+
+    //The last process to close it releases the entries of any that died while writing, and marks it as clean
+    if (flock(this->fd, LOCK_EX | LOCK_NB) == 0)
+    {
+        repair(entries(this->map), this->mask + 1);
+        static_cast<header*>(this->map)->clean = 1;
+    }
+
+    munmap(this->map, this->map_size);
+    ::close(this->fd);
+    this->fd  = -1;
+    this->map = nullptr;
+}
+
+bool bkh::sha256_cache::identify(char const* path, identity* result) noexcept
+{
+    struct stat info;
+    if (stat(path, &info) != 0) return false;
+    if (!S_ISREG(info.st_mode))
+    {
+        errno = S_ISDIR(info.st_mode) ? EISDIR : EINVAL;
+        return false;
+    }
+
+    to_identity(info, result);
+    return true;
+}
+
+bool bkh::sha256_cache::lookup(identity const& id, byte* digest, sha256_file::mode* m) const noexcept
+{
+    entry* const table = entries(this->map);
+    u64 const    home  = home_slot(id);
+
+    for (u64 p = 0; p < probe_length; p++)
+    {
+        entry const& e = table[(home + p) & this->mask];
+        for (int attempt = 0; attempt < read_attempts; attempt++)
+        {
+            //Skip it while it is being written
+            u32 const before = __atomic_load_n(&e.sequence, __ATOMIC_ACQUIRE);
+            if (before & 1) continue;
+
+            //Take a copy, and check that it didn't change meanwhile
+            identity stored;
+            u64      words[sha256::digest_length / 8];
+            u8 const valid   = load(e.valid);
+            u8 const mode_id = load(e.mode);
+            stored.device    = load(e.device);
+            stored.inode     = load(e.inode);
+            stored.size      = load(e.size);
+            stored.mtime_ns  = load(e.mtime_ns);
+            stored.ctime_ns  = load(e.ctime_ns);
+            for (int i = 0; i < sha256::digest_length / 8; i++) words[i] = load(e.digest[i]);
+            u64 const sum    = load(e.checksum);
+
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (__atomic_load_n(&e.sequence, __ATOMIC_RELAXED) != before) continue;
+
+            //It's a hit only if it's intact and the file is unchanged
+            if (!valid || stored.device != id.device || stored.inode != id.inode) break;
+            if (!same_identity(stored, id) || sum != checksum(mode_id, stored, words)) return false;
+
+            byte const* bytes = reinterpret_cast<byte const*>(words);
+            for (int i = 0; i < sha256::digest_length; i++) digest[i] = bytes[i];
+            if (m) *m = static_cast<sha256_file::mode>(mode_id);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void bkh::sha256_cache::store(identity const& id, byte const* digest, sha256_file::mode m) noexcept
+{
+    entry* const table = entries(this->map);
+    u64 const    home  = home_slot(id);
+
+    for (int attempt = 0; attempt < read_attempts; attempt++)
+    {
+        //Prefer the entry of the same file, then an empty one, and replace one otherwise
+        entry* target = &table[(home + (home >> 61) % probe_length) & this->mask];
+        entry* empty  = nullptr;
+        for (u64 p = 0; p < probe_length; p++)
+        {
+            entry& e = table[(home + p) & this->mask];
+            if (!load(e.valid))
+            {
+                if (!empty) empty = &e;
+                continue;
+            }
+            if (load(e.device) == id.device && load(e.inode) == id.inode)
+            {
+                empty = nullptr;
+                target = &e;
+                break;
+            }
+        }
+        if (empty) target = empty;
+
+        //Claim it, someone else may be writing it
+        u32 sequence = __atomic_load_n(&target->sequence, __ATOMIC_RELAXED);
+        if (sequence & 1) continue;
+        if (!__atomic_compare_exchange_n(&target->sequence, &sequence, sequence + 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) continue;
+
+        //Write it and release it
+        u64 words[sha256::digest_length / 8];
+        byte* bytes = reinterpret_cast<byte*>(words);
+        for (int i = 0; i < sha256::digest_length; i++) bytes[i] = digest[i];
+
+        store_relaxed(target->mode,     static_cast<u8>(m));
+        store_relaxed(target->device,   id.device);
+        store_relaxed(target->inode,    id.inode);
+        store_relaxed(target->size,     id.size);
+        store_relaxed(target->mtime_ns, id.mtime_ns);
+        store_relaxed(target->ctime_ns, id.ctime_ns);
+        for (int i = 0; i < sha256::digest_length / 8; i++) store_relaxed(target->digest[i], words[i]);
+        store_relaxed(target->checksum, checksum(static_cast<u8>(m), id, words));
+        store_relaxed(target->valid,    u8{ 1 });
+
+        __atomic_store_n(&target->sequence, sequence + 2, __ATOMIC_RELEASE);
+        return;
+    }
+}
+
+bool bkh::sha256_cache::hash_file(char const* path, byte* result, bool* cached) noexcept
+{
+    return this->hash_file(path, result, cached, sha256_file::default_options());
+}
+
+bool bkh::sha256_cache::hash_file(char const* path, byte* result, bool* cached, sha256_file::options const& opts) noexcept
+{
+    *cached = false;
+
+    //Only regular files have an identity worth caching
+    identity before;
+    if (!identify(path, &before))
+    {
+        if (errno != EINVAL) return false;
+        return sha256_file::hash_file(path, result, opts);
+    }
+
+    //Use the cached digest if the file is unchanged
+    if (this->lookup(before, result, nullptr))
+    {
+        *cached = true;
+        return true;
+    }
+
+    //Otherwise hash it
+    if (!sha256_file::hash_file(path, result, opts)) return false;
+
+    //Only store it if the file didn't change while it was read, and has settled
+    identity after;
+    struct timespec now;
+    if (!identify(path, &after) || !same_identity(before, after))   return true;
+    if (clock_gettime(CLOCK_REALTIME, &now) != 0)                   return true;
+    u64 const latest = (after.mtime_ns > after.ctime_ns) ? after.mtime_ns : after.ctime_ns;
+    if (latest + settle_time_ns > to_ns(now))                       return true;
+
+    mode const used = (opts.io_mode == mode::automatic) ? sha256_file::select_mode(after.size, opts) : opts.io_mode;
+    this->store(after, result, used);
+    return true;
+}
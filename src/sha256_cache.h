@@ -0,0 +1,158 @@
+#ifndef BKH_SHA256_CACHE_H
+#define BKH_SHA256_CACHE_H
+#pragma once
+
+/** sha256_cache.h - Bendik Hillestad - Public Domain
+ * Implements a persistent cache of file digests on POSIX systems,
+ * such that files which have not changed since they were last
+ * hashed cost a stat() rather than a full read.
+ *
+ * A file is identified by its device and inode, and a cached
+ * digest is only used while its size, modification time and
+ * status change time are unchanged. The status change time can
+ * not be set by the user, so unlike the modification time it
+ * can't be reset to hide a modification. Files modified within
+ * the last two seconds are not cached, as a later modification
+ * within the granularity of the timestamps would go unnoticed.
+ *
+ * The cache is a file holding a hash table of fixed capacity,
+ * which is memory-mapped and shared by every process that opens
+ * it. Each entry is guarded by a sequence number, so lookups
+ * never block and never see an entry that is being written, and
+ * carries a checksum, so entries torn by a crash are ignored. When
+ * the table is full the entries are replaced, there is no need
+ * to ever remove them. Entries also record the mode the digest
+ * was computed with.
+ *
+ * The layout of the file depends on the host, as do the device
+ * and inode numbers it stores, so it is not meant to be moved
+ * between hosts.
+ * Example:
+
+    using byte = unsigned char;
+
+    sha256_cache cache;
+    if (!cache.open("/var/cache/sweep.digests")) perror("cache");
+
+    for (char const* path : paths)
+    {
+        byte digest[sha256::digest_length];
+        bool cached;
+        if (cache.hash_file(path, digest, &cached)) verify(path, digest);
+    }
+
+    cache.close();
+
+ *
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sha256_file.h"
+
+namespace bkh
+{
+    struct sha256_cache
+    {
+    public:
+        using byte = sha256::byte;
+
+        /**
+         * The number of entries of a new cache by default,
+         * taking up 96 MiB of disk space once filled.
+         */
+        static constexpr u64 const default_capacity = 1 << 20;
+
+        /**
+         * What identifies a version of a file.
+         */
+        struct identity
+        {
+            u64 device;
+            u64 inode;
+            u64 size;
+            u64 mtime_ns;
+            u64 ctime_ns;
+        };
+
+        /**
+         * Opens the cache, creating it with room for the given
+         * number of entries, rounded up to a power of two, if
+         * it does not exist. Returns false, with errno set, if
+         * it could not be opened or is not a valid cache.
+         * Any number of processes may have it open at once,
+         * it only waits while another process is creating it.
+         * close must be called once the cache is no longer
+         * needed.
+         */
+        bool open(char const* path, u64 capacity = default_capacity) noexcept;
+
+        /**
+         * Unmaps and closes the cache.
+         */
+        void close() noexcept;
+
+        /**
+         * Retrieves the identity of a file. Returns false, with
+         * errno set, if it could not be retrieved or the file
+         * is not a regular file.
+         */
+        static bool identify(char const* path, identity* result) noexcept;
+
+        /**
+         * Looks up the digest of the file, and optionally the
+         * mode it was computed with. Returns false if there is
+         * no digest for this exact identity.
+         */
+        bool lookup(identity const& id, byte* digest, sha256_file::mode* mode) const noexcept;
+
+        /**
+         * Stores the digest of the file, replacing any previous
+         * digest of the same file, or another entry if the
+         * table is full.
+         */
+        void store(identity const& id, byte const* digest, sha256_file::mode mode) noexcept;
+
+        /**
+         * Retrieves the digest of the file from the cache if it
+         * is unchanged, and otherwise computes it using
+         * sha256_file and stores it. `cached` is set to whether
+         * the digest came from the cache. Returns false, with
+         * errno set, if the file could not be hashed.
+         */
+        bool hash_file(char const* path, byte* result, bool* cached) noexcept;
+
+        /**
+         * Same as above, hashing with the given options.
+         */
+        bool hash_file(char const* path, byte* result, bool* cached, sha256_file::options const& opts) noexcept;
+
+    private:
+        int   fd;
+        void* map;
+        u64   map_size;
+        u64   mask;
+    };
+};
+
+#endif
@@ -0,0 +1,348 @@
+/** sha256_cdc.cpp - Bendik Hillestad - Public Domain
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sha256_cdc.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/* Types */
+
+using byte     = bkh::sha256_cdc::byte;
+using params   = bkh::sha256_cdc::parameters;
+using chunk    = bkh::sha256_cdc::chunk;
+using callback = bkh::sha256_cdc::callback;
+
+using bkh::u32;
+using bkh::u64;
+using bkh::sha256;
+using bkh::sha256_cdc;
+
+/* Helpers */
+
+/**
+ * The number of bytes scanned for a cut point before they are
+ * hashed, small enough for them to still be in the L1 cache.
+ */
+static constexpr u64 const stride = 4096;
+
+/**
+ * The smallest segment the input is split into for the threads.
+ * Segments are also at least 64 chunks of the largest size, so
+ * the chunks redone where they meet are few in comparison.
+ */
+static constexpr u64 const min_segment = 16 * 1024 * 1024;
+
+/**
+ * The table of random values the bytes are mapped through.
+ */
+struct gear_table
+{
+    u64 values[256];
+};
+
+/**
+ * Fills the table with the output of SplitMix64 seeded with 0.
+ */
+static constexpr gear_table make_gear_table() noexcept
+{
+    gear_table table{};
+
+    u64 state = 0;
+    for (int i = 0; i < 256; i++)
+    {
+        state += 0x9E3779B97F4A7C15ull;
+
+        u64 z = state;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        table.values[i] = z ^ (z >> 31);
+    }
+
+    return table;
+}
+
+static constexpr gear_table const gear = make_gear_table();
+
+/**
+ * Builds a mask with `count` one bits spread over the top 48 bits.
+ */
+static constexpr u64 make_mask(u32 count) noexcept
+{
+    u64 mask = 0;
+    for (u32 j = 0; j < count; j++) mask |= u64{ 1 } << (63 - (48 * j) / count);
+
+    return mask;
+}
+
+/**
+ * Computes the base 2 logarithm of a power of two.
+ */
+static u32 log2(u64 value) noexcept
+{
+    u32 bits = 0;
+    while (value > 1)
+    {
+        value >>= 1;
+        bits++;
+    }
+
+    return bits;
+}
+
+/**
+ * Rolls the fingerprint over the bytes until it matches the mask.
+ * Returns the number of bytes consumed, including the one that
+ * matched.
+ */
+static u64 scan(u64& fingerprint, byte const* data, u64 length, u64 mask, bool* found) noexcept
+{
+    u64 fp = fingerprint;
+    for (u64 i = 0; i < length; i++)
+    {
+        fp = (fp << 1) + gear.values[data[i]];
+        if ((fp & mask) == 0)
+        {
+            fingerprint = fp;
+            *found      = true;
+            return i + 1;
+        }
+    }
+
+    fingerprint = fp;
+    *found      = false;
+    return length;
+}
+
+/**
+ * Collects chunks into a vector.
+ */
+static void collect(void* user, chunk const& c)
+{
+    static_cast<std::vector<chunk>*>(user)->push_back(c);
+}
+
+/* Implementation */
+
+params bkh::sha256_cdc::default_parameters() noexcept
+{
+    return parameters{ 2 * 1024, 8 * 1024, 64 * 1024, 2, 0 };
+}
+
+bool bkh::sha256_cdc::init(parameters const& p) noexcept
+{
+    //Validate the parameters
+    if (p.min_size >= p.avg_size || p.avg_size >= p.max_size)    return false;
+    if (p.avg_size < 64 || p.avg_size > (u64{ 1 } << 28))         return false;
+    if ((p.avg_size & (p.avg_size - 1)) != 0 || p.normalization > 3) return false;
+
+    //Prepare the masks
+    u32 const bits   = log2(p.avg_size);
+    this->mask_small = make_mask(bits + p.normalization);
+    this->mask_large = make_mask(bits - p.normalization);
+
+    //Start out empty
+    this->min_size    = p.min_size;
+    this->avg_size    = p.avg_size;
+    this->max_size    = p.max_size;
+    this->fingerprint = 0;
+    this->offset      = 0;
+    this->length      = 0;
+    this->hasher.init();
+    return true;
+}
+
+void bkh::sha256_cdc::update(byte const* data, u64 data_length, callback on_chunk, void* user) noexcept
+{
+    while (data_length > 0)
+    {
+        bool      cut;
+        u64 const consumed = this->consume(data, data_length, &cut);
+        data        += consumed;
+        data_length -= consumed;
+
+        if (cut) this->emit(on_chunk, user);
+    }
+}
+
+void bkh::sha256_cdc::finalize(callback on_chunk, void* user) noexcept
+{
+    //The last chunk ends with the stream
+    if (this->length > 0) this->emit(on_chunk, user);
+
+    this->offset = 0;
+}
+
+bool bkh::sha256_cdc::split(byte const* data, u64 data_length, parameters const& p, callback on_chunk, void* user)
+{
+    //Validate the parameters
+    sha256_cdc serial;
+    if (!serial.init(p)) return false;
+
+    //Decide how big the segments are and how many threads to use
+    u64 const segment  = (64 * p.max_size > min_segment) ? 64 * p.max_size : min_segment;
+    u64 const segments = (data_length + segment - 1) / segment;
+
+    unsigned threads = (p.threads > 0) ? p.threads : std::thread::hardware_concurrency();
+    if (threads < 1)        threads = 1;
+    if (threads > segments) threads = static_cast<unsigned>(segments);
+
+    //Small inputs aren't worth splitting
+    if (threads <= 1)
+    {
+        serial.update(data, data_length, on_chunk, user);
+        serial.finalize(on_chunk, user);
+        return true;
+    }
+
+    //Chunk every segment from its start, until a chunk ends past the segment
+    std::vector<std::vector<chunk>> results(segments);
+    std::atomic<u64>                next_segment{ 0 };
+    auto const worker = [&]()
+    {
+        for (u64 k = next_segment++; k < segments; k = next_segment++)
+        {
+            sha256_cdc c = serial;
+            c.offset = k * segment;
+
+            u64 const end = (c.offset + segment < data_length) ? c.offset + segment : data_length;
+            u64       pos = c.offset;
+            while (pos < data_length)
+            {
+                bool cut;
+                pos += c.consume(data + pos, data_length - pos, &cut);
+                if (!cut) continue;
+
+                c.emit(collect, &results[k]);
+                if (pos >= end) break;
+            }
+            if (c.length > 0) c.emit(collect, &results[k]);
+        }
+    };
+
+    //The calling thread does its share of the work
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    for (unsigned i = 1; i < threads; i++) pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool) t.join();
+
+    //Chunks the input from the given offset on the calling thread, returning where the chunk ends
+    auto const redo = [&](u64 from)
+    {
+        bool cut;
+        serial.offset = from;
+        serial.consume(data + from, data_length - from, &cut);
+        serial.emit(on_chunk, user);
+
+        return serial.offset;
+    };
+
+    //Stitch the segments together, following the chunks from the start
+    u64 pos = 0;
+    for (auto const& list : results)
+    {
+        u64 i = 0;
+        for (;;)
+        {
+            //Skip the chunks that begin before where the chain is
+            while (i < list.size() && list[i].offset < pos) i++;
+            if (i == list.size() || list[i].offset == pos) break;
+
+            //The chain is not in line with this segment yet, so redo its next chunk
+            pos = redo(pos);
+        }
+
+        //From here on the segment agrees with the chain
+        for (; i < list.size(); i++)
+        {
+            on_chunk(user, list[i]);
+            pos = list[i].offset + list[i].length;
+        }
+    }
+
+    //Finish the chain if it never caught up with the last segment
+    while (pos < data_length) pos = redo(pos);
+
+    return true;
+}
+
+u64 bkh::sha256_cdc::consume(byte const* data, u64 data_length, bool* cut) noexcept
+{
+    u64 i = 0;
+
+    //There is never a cut point before the minimum size, so that part is only hashed
+    if (this->length < this->min_size)
+    {
+        u64 const skip = (this->min_size - this->length < data_length) ? this->min_size - this->length : data_length;
+        this->hasher.update(data, skip);
+        this->length += skip;
+        i            += skip;
+    }
+
+    while (i < data_length)
+    {
+        //Use the stricter mask until the average size is reached
+        bool const small = this->length < this->avg_size;
+        u64  const mask  = small ? this->mask_small : this->mask_large;
+        u64  const limit = small ? this->avg_size   : this->max_size;
+
+        //Scan a stride, then hash it while it is still in the cache
+        u64 n = data_length - i;
+        if (n > limit - this->length) n = limit - this->length;
+        if (n > stride)               n = stride;
+
+        bool      found;
+        u64 const scanned = scan(this->fingerprint, data + i, n, mask, &found);
+        this->hasher.update(data + i, scanned);
+        this->length += scanned;
+        i            += scanned;
+
+        if (found || this->length == this->max_size)
+        {
+            *cut = true;
+            return i;
+        }
+    }
+
+    *cut = false;
+    return i;
+}
+
+void bkh::sha256_cdc::emit(callback on_chunk, void* user) noexcept
+{
+    chunk c;
+    c.offset = this->offset;
+    c.length = this->length;
+    this->hasher.finalize(c.digest);
+    on_chunk(user, c);
+
+    //Start the next chunk
+    this->offset     += this->length;
+    this->length      = 0;
+    this->fingerprint = 0;
+    this->hasher.init();
+}
@@ -0,0 +1,181 @@
+#ifndef BKH_SHA256_CDC_H
+#define BKH_SHA256_CDC_H
+#pragma once
+
+/** sha256_cdc.h - Bendik Hillestad - Public Domain
+ * Implements content-defined chunking with FastCDC, fused with
+ * SHA-256 such that every chunk is hashed while it is being
+ * scanned for its end. This is the building block of
+ * deduplication: as the boundaries depend on the content rather
+ * than on offsets, inserting or removing bytes only changes the
+ * chunks around the edit, and identical chunks are recognized by
+ * their digest.
+ *
+ * Format:
+ * A gear fingerprint is rolled over the bytes of the chunk,
+ *   fp := (fp << 1) + G[byte]
+ * starting from 0 at the first byte past `min_size`. The chunk
+ * ends right after the first byte where (fp & mask) == 0, or at
+ * `max_size` bytes. Following FastCDC's normalized chunking the
+ * mask has log2(avg_size) + normalization one bits before
+ * `avg_size` bytes, and log2(avg_size) - normalization one bits
+ * after, which narrows the spread of the chunk sizes around the
+ * average. The one bits of a mask are spread evenly over the top
+ * 48 bits, bit 63 - (48 * j) / count for j in [0, count), such
+ * that the fingerprint covers a window of at least 48 bytes.
+ * G[i] is output i + 1 of SplitMix64 seeded with 0. The last
+ * chunk ends with the input, and an empty input has no chunks.
+ *
+ * The bytes are scanned and hashed in strides small enough to
+ * stay in the L1 cache, so the input is only brought in from
+ * memory once. Large inputs in memory may also be split on
+ * several threads, with the same chunks as a single thread.
+ *
+ * The parallel split collects the chunks of every thread in a
+ * std::vector before reporting them in order, whereas the
+ * streaming interface performs no allocations.
+ * Example:
+
+    using byte = unsigned char;
+
+    static void on_chunk(void* user, sha256_cdc::chunk const& c)
+    {
+        auto& store = *static_cast<chunk_store*>(user);
+        if (!store.contains(c.digest)) store.add(c.digest, c.offset, c.length);
+    }
+
+    //Split a stream as it arrives
+    sha256_cdc cdc;
+    cdc.init(sha256_cdc::default_parameters());
+    while ((read = read_some_data(buf, sizeof(buf))) > 0)
+        cdc.update(buf, read, on_chunk, &store);
+    cdc.finalize(on_chunk, &store);
+
+ *
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sha256.h"
+
+namespace bkh
+{
+    struct sha256_cdc
+    {
+    public:
+        using byte = sha256::byte;
+
+        /**
+         * The sizes of the chunks and how to split them. All
+         * but the threads are part of the format, so the same
+         * values must be used to reproduce the chunks.
+         */
+        struct parameters
+        {
+            u64      min_size;      //Smallest chunk, except for the last one
+            u64      avg_size;      //Desired average, a power of two from 64 B to 256 MiB
+            u64      max_size;      //Largest chunk
+            u32      normalization; //Level of normalized chunking, from 0 to 3
+            unsigned threads;       //Number of threads for split, 0 for one per core
+        };
+
+        /**
+         * A chunk of the input, along with its SHA-256 digest.
+         */
+        struct chunk
+        {
+            u64  offset;
+            u64  length;
+            byte digest[sha256::digest_length];
+        };
+
+        /**
+         * Called for every chunk, in the order of the input.
+         */
+        using callback = void (*)(void* user, chunk const& c);
+
+        /**
+         * Retrieves the default parameters, which aim for 8 KiB
+         * chunks between 2 KiB and 64 KiB with normalization
+         * level 2, and one thread per core.
+         */
+        static parameters default_parameters() noexcept;
+
+        /**
+         * Prepares the chunker for a new stream. Returns false
+         * if the parameters are invalid, i.e. not
+         * min_size < avg_size < max_size.
+         */
+        bool init(parameters const& params) noexcept;
+
+        /**
+         * Appends data to the stream, calling the callback for
+         * every chunk that ends within it. May be called any
+         * number of times with any length, including zero.
+         */
+        void update(byte const* data, u64 data_length, callback on_chunk, void* user) noexcept;
+
+        /**
+         * Ends the stream, calling the callback for the last
+         * chunk if there is one. The chunker is reset
+         * afterwards, ready for a new stream.
+         */
+        void finalize(callback on_chunk, void* user) noexcept;
+
+        /**
+         * Splits an input that is entirely in memory. With
+         * more than one thread the input is divided into
+         * segments which are chunked in parallel, each
+         * starting from its own offset. Chunking is
+         * self-synchronizing, so the chunks of a segment soon
+         * line up with those continuing from the segment
+         * before it, and only the few chunks before that point
+         * are redone. The callback is called on the calling
+         * thread, in order, once every segment is done.
+         * Returns false if the parameters are invalid.
+         */
+        static bool split(
+            byte const*       data,
+            u64               data_length,
+            parameters const& params,
+            callback          on_chunk,
+            void*             user
+        );
+
+    private:
+        u64  consume(byte const* data, u64 data_length, bool* cut) noexcept;
+        void emit(callback on_chunk, void* user) noexcept;
+
+        sha256::hasher hasher;
+        u64            mask_small;
+        u64            mask_large;
+        u64            min_size;
+        u64            avg_size;
+        u64            max_size;
+        u64            fingerprint;
+        u64            offset;
+        u64            length;
+    };
+};
+
+#endif
@@ -0,0 +1,359 @@
+/** sha256_file.cpp - Bendik Hillestad - Public Domain
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sha256_file.h"
+
+#include <cerrno>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Types */
+
+using byte    = bkh::sha256_file::byte;
+using mode    = bkh::sha256_file::mode;
+using options = bkh::sha256_file::options;
+
+using bkh::u64;
+using bkh::sha256;
+using bkh::sha256_file;
+
+/* Helpers */
+
+static constexpr u64 const kib = 1024;
+static constexpr u64 const mib = 1024 * kib;
+static constexpr u64 const gib = 1024 * mib;
+
+/**
+ * The alignment of the buffer, the offset and the length of
+ * O_DIRECT reads. The logical block size of the device may be
+ * smaller, but the page size satisfies every common device.
+ */
+static constexpr u64 const direct_alignment = 4 * kib;
+
+/**
+ * How much of a mapped file is hashed between dropping the
+ * pages behind it, when asked to drop them.
+ */
+static constexpr u64 const map_chunk = 64 * mib;
+
+/**
+ * The size from which a mapping is worth backing with
+ * transparent hugepages.
+ */
+static constexpr u64 const hugepage_size = 2 * mib;
+
+/**
+ * Rounds the value up to a multiple of the alignment.
+ */
+static u64 round_up(u64 value, u64 alignment) noexcept
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+/**
+ * Tells the kernel that the file will be read sequentially, which
+ * makes it read further ahead.
+ */
+static void advise_sequential(int fd) noexcept
+{
+#if defined(POSIX_FADV_SEQUENTIAL)
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#else
+    static_cast<void>(fd);
+#endif
+}
+
+/**
+ * Evicts a range of the file from the page cache.
+ */
+static void drop_pages(int fd, u64 offset, u64 length) noexcept
+{
+#if defined(POSIX_FADV_DONTNEED)
+    posix_fadvise(fd, static_cast<off_t>(offset), static_cast<off_t>(length), POSIX_FADV_DONTNEED);
+#else
+    static_cast<void>(fd);
+    static_cast<void>(offset);
+    static_cast<void>(length);
+#endif
+}
+
+/**
+ * Reads until the buffer is full or the end of the file is
+ * reached, retrying interrupted reads. Returns the number of
+ * bytes read, or -1 on error.
+ */
+static long long read_full(int fd, byte* buffer, u64 length) noexcept
+{
+    u64 total = 0;
+    while (total < length)
+    {
+        ssize_t const n = ::read(fd, buffer + total, length - total);
+        if (n < 0)
+        {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (n == 0) break;
+
+        total += static_cast<u64>(n);
+    }
+
+    return static_cast<long long>(total);
+}
+
+/**
+ * An aligned buffer which frees itself.
+ */
+struct aligned_buffer
+{
+    byte* data = nullptr;
+
+    bool allocate(u64 size) noexcept
+    {
+        void* p = nullptr;
+        if (posix_memalign(&p, direct_alignment, size) != 0) return false;
+
+        data = static_cast<byte*>(p);
+        return true;
+    }
+
+    ~aligned_buffer() noexcept
+    {
+        free(data);
+    }
+};
+
+/**
+ * Hashes the rest of the file with plain reads. With a known
+ * offset the pages behind the reads can be dropped.
+ */
+static bool hash_read(int fd, u64 offset, bool known_offset, sha256::hasher& h, u64 buffer_size, bool drop_cache) noexcept
+{
+    aligned_buffer buffer;
+    if (!buffer.allocate(buffer_size)) return false;
+
+    advise_sequential(fd);
+    while (true)
+    {
+        long long const n = read_full(fd, buffer.data, buffer_size);
+        if (n < 0) return false;
+
+        h.update(buffer.data, static_cast<u64>(n));
+        if (drop_cache && known_offset) drop_pages(fd, offset, static_cast<u64>(n));
+        offset += static_cast<u64>(n);
+
+        if (static_cast<u64>(n) < buffer_size) return true;
+    }
+}
+
+/**
+ * Hashes the rest of the file with O_DIRECT reads, or with plain
+ * reads dropping the pages behind them where the file system
+ * does not support O_DIRECT.
+ */
+static bool hash_direct(int fd, u64 offset, sha256::hasher& h, u64 buffer_size) noexcept
+{
+#if defined(O_DIRECT)
+    //The offset must be aligned as well
+    int const flags = fcntl(fd, F_GETFL);
+    if (flags >= 0 && offset % direct_alignment == 0 && fcntl(fd, F_SETFL, flags | O_DIRECT) == 0)
+    {
+        aligned_buffer buffer;
+        if (!buffer.allocate(buffer_size))
+        {
+            fcntl(fd, F_SETFL, flags);
+            return false;
+        }
+
+        bool first = true;
+        while (true)
+        {
+            //A short read only happens at the end of the file, which leaves the offset unaligned
+            ssize_t const n = ::read(fd, buffer.data, buffer_size);
+            if (n < 0)
+            {
+                if (errno == EINTR) continue;
+
+                //Some file systems accept the flag but refuse the reads
+                if (errno == EINVAL && first) break;
+
+                int const error = errno;
+                fcntl(fd, F_SETFL, flags);
+                errno = error;
+                return false;
+            }
+            first = false;
+
+            h.update(buffer.data, static_cast<u64>(n));
+            if (static_cast<u64>(n) < buffer_size)
+            {
+                fcntl(fd, F_SETFL, flags);
+                return true;
+            }
+        }
+
+        fcntl(fd, F_SETFL, flags);
+    }
+#endif
+
+    //Keep the page cache clean the next best way
+    return hash_read(fd, offset, true, h, buffer_size, true);
+}
+
+/**
+ * Hashes the rest of the file straight from a mapping of it.
+ * Returns false, leaving the hasher untouched, if the file
+ * cannot be mapped.
+ */
+static bool hash_mapped(int fd, u64 offset, u64 size, sha256::hasher& h, bool drop_cache) noexcept
+{
+    void* const p = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) return false;
+
+    auto* const base = static_cast<byte*>(p);
+    madvise(p, size, MADV_SEQUENTIAL);
+#if defined(MADV_HUGEPAGE)
+    if (size >= hugepage_size) madvise(p, size, MADV_HUGEPAGE);
+#endif
+
+    if (!drop_cache)
+    {
+        h.update(base + offset, size - offset);
+    }
+    else
+    {
+        //Hash in chunks, unmapping and evicting the pages behind
+        for (u64 chunk = offset; chunk < size; chunk += map_chunk)
+        {
+            u64 const length = (size - chunk < map_chunk) ? size - chunk : map_chunk;
+            h.update(base + chunk, length);
+
+            u64 const page_begin = chunk / direct_alignment * direct_alignment;
+            madvise(base + page_begin, chunk + length - page_begin, MADV_DONTNEED);
+            drop_pages(fd, page_begin, chunk + length - page_begin);
+        }
+    }
+
+    munmap(p, size);
+    return true;
+}
+
+/* Implementation */
+
+options bkh::sha256_file::default_options() noexcept
+{
+    return { mode::automatic, 1 * mib, 1 * gib, false };
+}
+
+mode bkh::sha256_file::select_mode(u64 file_size, options const& opts) noexcept
+{
+    //Never map on its own, a file truncated under the mapping kills the process
+    if (file_size >= opts.direct_threshold) return mode::direct;
+
+    return mode::read;
+}
+
+bool bkh::sha256_file::hash_file(char const* path, byte* result) noexcept
+{
+    return hash_file(path, result, default_options());
+}
+
+bool bkh::sha256_file::hash_file(char const* path, byte* result, options const& opts, u64* length) noexcept
+{
+    int const fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    bool const ok    = hash_descriptor(fd, result, opts, length);
+    int const  error = errno;
+    close(fd);
+    errno = error;
+
+    return ok;
+}
+
+bool bkh::sha256_file::hash_descriptor(int fd, byte* result, options const& opts, u64* length) noexcept
+{
+    struct stat st;
+    if (fstat(fd, &st) != 0) return false;
+
+    //Only regular files have a size and can be mapped
+    bool const regular = S_ISREG(st.st_mode);
+    off_t const pos    = regular ? lseek(fd, 0, SEEK_CUR) : -1;
+    bool const seeks   = pos >= 0;
+    u64 const  offset  = seeks ? static_cast<u64>(pos) : 0;
+    u64 const  size    = regular ? static_cast<u64>(st.st_size) : 0;
+
+    //Pick the mode
+    mode m = opts.io_mode;
+    if (!regular || !seeks)      m = mode::read;
+    else if (m == mode::automatic) m = select_mode(size - (offset < size ? offset : size), opts);
+
+    //Never use a buffer larger than needed, but keep it aligned for O_DIRECT
+    u64 buffer_size = round_up(opts.buffer_size > 0 ? opts.buffer_size : default_options().buffer_size, direct_alignment);
+    if (regular && seeks && size > offset && size - offset < buffer_size)
+    {
+        //One byte extra allows the end of the file to be seen without a second read
+        buffer_size = round_up(size - offset + 1, direct_alignment);
+    }
+
+    sha256::hasher h;
+    h.init();
+
+    bool ok = false;
+    switch (m)
+    {
+        case mode::mmap:
+            //An empty file cannot be mapped, and special files may refuse it
+            if (size > offset && hash_mapped(fd, offset, size, h, opts.drop_cache))
+            {
+                ok = true;
+                break;
+            }
+            ok = hash_read(fd, offset, seeks, h, buffer_size, opts.drop_cache);
+            break;
+        case mode::direct:
+            ok = hash_direct(fd, offset, h, buffer_size);
+            break;
+        default:
+            ok = hash_read(fd, offset, seeks, h, buffer_size, opts.drop_cache);
+            break;
+    }
+
+    if (!ok)
+    {
+        int const error = errno;
+        h.clear_state();
+        errno = error;
+        return false;
+    }
+
+    if (length) *length = h.get_length();
+    h.finalize(result);
+    return true;
+}
@@ -0,0 +1,134 @@
+#ifndef BKH_SHA256_FILE_H
+#define BKH_SHA256_FILE_H
+#pragma once
+
+/** sha256_file.h - Bendik Hillestad - Public Domain
+ * Implements hashing of files on POSIX systems, taking care of
+ * how the file is brought into memory, which for large files
+ * matters as much as the transform itself.
+ *
+ * Three ways of reading the file are offered:
+ *   read:   read(2) into a buffer, with the kernel told that the
+ *           access is sequential so it reads ahead aggressively.
+ *   mmap:   the file is mapped and hashed straight from the page
+ *           cache, without any copying, with MADV_SEQUENTIAL and
+ *           transparent hugepages requested where available. If
+ *           the file is truncated while it is being hashed, the
+ *           pages past its new end raise SIGBUS and kill the
+ *           process, so this is only ever used when asked for.
+ *   direct: O_DIRECT reads into aligned buffers, bypassing the
+ *           page cache entirely, such that hashing a cold archive
+ *           does not evict everything else from it. Falls back to
+ *           read if the file system does not support it.
+ * By default the mode is picked based on the size of the file,
+ * see options. Files that are not regular files, such as pipes,
+ * are always read.
+ *
+ * Unlike the core library this depends on the operating system
+ * and allocates the read buffer, which is why it lives in its own
+ * translation unit.
+ * Example:
+
+    using byte = unsigned char;
+
+    byte digest[sha256::digest_length];
+    if (!sha256_file::hash_file("archive.tar", digest))
+        perror("archive.tar");
+
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sha256.h"
+
+namespace bkh
+{
+    struct sha256_file
+    {
+    public:
+        using byte = sha256::byte;
+
+        /**
+         * The ways of reading the file, see above.
+         */
+        enum class mode : u8
+        {
+            automatic, //Pick based on the size of the file
+            read,      //read(2) through the page cache
+            mmap,      //Map the file and hash it in place, see above
+            direct     //O_DIRECT reads bypassing the page cache
+        };
+
+        /**
+         * How to read the file.
+         */
+        struct options
+        {
+            mode io_mode;          //The mode to use, or automatic
+            u64  buffer_size;      //Size of the buffer for read and direct
+            u64  direct_threshold; //Automatic uses direct for files at least this large
+            bool drop_cache;       //Evict the pages of the file once they are hashed
+        };
+
+        /**
+         * Retrieves the default options. Files of 1 GiB or
+         * more are read with O_DIRECT and the smaller ones with
+         * read, into a buffer of 1 MiB, and the page cache is
+         * left alone.
+         */
+        static options default_options() noexcept;
+
+        /**
+         * Picks the mode automatic would use for a regular
+         * file of the given size.
+         */
+        static mode select_mode(u64 file_size, options const& opts) noexcept;
+
+        /**
+         * Computes the SHA-256 hash of the file using the
+         * default options. Returns false, with errno set, if
+         * the file could not be opened or read.
+         */
+        static bool hash_file(char const* path, byte* result) noexcept;
+
+        /**
+         * Same as above, using the given options. If `length`
+         * is given it receives the number of bytes hashed.
+         */
+        static bool hash_file(char const* path, byte* result, options const& opts, u64* length = nullptr) noexcept;
+
+        /**
+         * Computes the SHA-256 hash of everything from the
+         * current position of an open file descriptor to its
+         * end, such as standard input. The descriptor is left
+         * open, but its position is unspecified afterwards. If
+         * `length` is given it receives the number of bytes
+         * hashed.
+         */
+        static bool hash_descriptor(int fd, byte* result, options const& opts, u64* length = nullptr) noexcept;
+
+        sha256_file() = delete;
+    };
+};
+
+#endif
@@ -0,0 +1,250 @@
+/** sha256_hmac.cpp - Bendik Hillestad - Public Domain
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sha256_hmac.h"
+
+/* Types */
+
+using byte = bkh::hmac_sha256::byte;
+
+using bkh::u64;
+using bkh::sha256;
+using bkh::hmac_sha256;
+
+/* Helpers */
+
+/**
+ * The values the key is padded with, see RFC 2104.
+ */
+static constexpr byte const ipad = 0x36;
+static constexpr byte const opad = 0x5C;
+
+/**
+ * The number of messages handled at a time by the batch calls,
+ * which bounds the scratch space they keep on the stack.
+ */
+static constexpr u64 const batch_chunk = 64;
+
+/**
+ * Clears a buffer holding key material.
+ */
+static void clear_buffer(void* buffer, u64 length) noexcept
+{
+    auto* vptr = reinterpret_cast<char volatile*>(buffer);
+    for (u64 i = length; i--;)
+    {
+        *(vptr++) = 0;
+    }
+}
+
+/**
+ * Hashes a single key block, returning the midstate after it.
+ */
+static sha256::midstate hash_key_block(byte const* block) noexcept
+{
+    sha256::hasher   h;
+    sha256::midstate m;
+    h.init();
+    h.update(block, sha256::block_length);
+    h.save_midstate(&m);
+    h.clear_state();
+
+    return m;
+}
+
+/* Implementation */
+
+void bkh::hmac_sha256::init(byte const* key, u64 key_length) noexcept
+{
+    //Keys longer than a block are replaced by their digest, shorter ones are padded with zeroes
+    byte block[sha256::block_length]{};
+    if (key_length > sha256::block_length)
+    {
+        sha256::compute_hash(key, key_length, block);
+    }
+    else
+    {
+        for (u64 i = 0; i < key_length; i++) block[i] = key[i];
+    }
+
+    //Hash the inner key block
+    for (int i = 0; i < sha256::block_length; i++) block[i] ^= ipad;
+    this->inner = hash_key_block(block);
+
+    //Hash the outer key block
+    for (int i = 0; i < sha256::block_length; i++) block[i] ^= ipad ^ opad;
+    this->outer = hash_key_block(block);
+
+    //Don't leave the key behind on the stack
+    clear_buffer(block, sizeof(block));
+}
+
+void bkh::hmac_sha256::outer_hash(byte const* inner_digest, byte* result) const noexcept
+{
+    //The outer message is always the key block followed by the inner digest, so the padding is fixed
+    constexpr u64 const bit_count = (sha256::block_length + sha256::digest_length) * 8;
+
+    byte block[sha256::block_length]{};
+    for (int i = 0; i < sha256::digest_length; i++) block[i] = inner_digest[i];
+    block[sha256::digest_length] = 0x80;
+    for (int i = 0; i < 8; i++)
+    {
+        block[sha256::block_length - 1 - i] = static_cast<byte>(bit_count >> (8 * i));
+    }
+
+    //Perform the single transform from the outer midstate
+    sha256::context ctx;
+    ctx.set_state(this->outer.state);
+    ctx.transform_block(block);
+    ctx.get_digest(result);
+    ctx.clear_state();
+}
+
+void bkh::hmac_sha256::compute(byte const* data, u64 data_length, byte* result) const noexcept
+{
+    sha256::hasher h;
+    this->begin(&h);
+    h.update(data, data_length);
+    this->finalize(&h, result);
+}
+
+void bkh::hmac_sha256::compute_batch(sha256::message const* messages, u64 count) const noexcept
+{
+    //Only worth batching the single block outer hashes if there are lanes to spread them over
+    bool const outer_lanes = sha256::get_batch_backend() != sha256::batch_backend::serial;
+
+    sha256::message batch[batch_chunk];
+    byte            inner_digests[batch_chunk * sha256::digest_length];
+
+    for (u64 first = 0; first < count; first += batch_chunk)
+    {
+        auto const n = (count - first < batch_chunk) ? count - first : batch_chunk;
+
+        //Compute the inner hashes
+        for (u64 i = 0; i < n; i++)
+        {
+            batch[i] = { messages[first + i].data, messages[first + i].length, inner_digests + i * sha256::digest_length };
+        }
+        sha256::compute_hash_batch(this->inner, batch, n);
+
+        //Compute the outer hashes straight into the results
+        if (outer_lanes)
+        {
+            for (u64 i = 0; i < n; i++)
+            {
+                batch[i] = { inner_digests + i * sha256::digest_length, sha256::digest_length, messages[first + i].result };
+            }
+            sha256::compute_hash_batch(this->outer, batch, n);
+        }
+        else
+        {
+            for (u64 i = 0; i < n; i++)
+            {
+                this->outer_hash(inner_digests + i * sha256::digest_length, messages[first + i].result);
+            }
+        }
+    }
+}
+
+bool bkh::hmac_sha256::verify(byte const* data, u64 data_length, byte const* tag) const noexcept
+{
+    byte expected[tag_length];
+    this->compute(data, data_length, expected);
+
+    return equal(expected, tag, tag_length);
+}
+
+u64 bkh::hmac_sha256::verify_batch(tagged_message const* messages, u64 count, bool* results) const noexcept
+{
+    sha256::message batch[batch_chunk];
+    byte            expected[batch_chunk * tag_length];
+
+    u64 valid = 0;
+    for (u64 first = 0; first < count; first += batch_chunk)
+    {
+        auto const n = (count - first < batch_chunk) ? count - first : batch_chunk;
+
+        //Compute the expected tags
+        for (u64 i = 0; i < n; i++)
+        {
+            batch[i] = { messages[first + i].data, messages[first + i].length, expected + i * tag_length };
+        }
+        this->compute_batch(batch, n);
+
+        //Compare them against the given ones
+        for (u64 i = 0; i < n; i++)
+        {
+            bool const ok = equal(expected + i * tag_length, messages[first + i].tag, tag_length);
+            if (results) results[first + i] = ok;
+            valid += ok ? 1 : 0;
+        }
+    }
+
+    return valid;
+}
+
+void bkh::hmac_sha256::begin(sha256::hasher* h) const noexcept
+{
+    h->init(this->inner);
+}
+
+void bkh::hmac_sha256::finalize(sha256::hasher* h, byte* result) const noexcept
+{
+    byte inner_digest[sha256::digest_length];
+    h->finalize(inner_digest);
+    this->outer_hash(inner_digest, result);
+}
+
+void bkh::hmac_sha256::get_midstates(sha256::midstate* inner_result, sha256::midstate* outer_result) const noexcept
+{
+    *inner_result = this->inner;
+    *outer_result = this->outer;
+}
+
+void bkh::hmac_sha256::clear_state() noexcept
+{
+    clear_buffer(&this->inner, sizeof(this->inner));
+    clear_buffer(&this->outer, sizeof(this->outer));
+}
+
+void bkh::hmac_sha256::compute_hmac(byte const* key, u64 key_length, byte const* data, u64 data_length, byte* result) noexcept
+{
+    hmac_sha256 mac;
+    mac.init(key, key_length);
+    mac.compute(data, data_length, result);
+    mac.clear_state();
+}
+
+bool bkh::hmac_sha256::equal(byte const* lhs, byte const* rhs, u64 length) noexcept
+{
+    //Accumulate the differences without branching on them
+    byte volatile diff = 0;
+    for (u64 i = 0; i < length; i++)
+    {
+        diff = diff | (lhs[i] ^ rhs[i]);
+    }
+
+    return diff == 0;
+}
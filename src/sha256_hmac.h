@@ -0,0 +1,172 @@
+#ifndef BKH_SHA256_HMAC_H
+#define BKH_SHA256_HMAC_H
+#pragma once
+
+/** sha256_hmac.h - Bendik Hillestad - Public Domain
+ * Implements HMAC-SHA256 as described in RFC 2104 (and FIPS PUB
+ * 198-1) on top of the SHA-256 implementation in sha256.h.
+ *
+ * HMAC hashes the key padded with ipad and opad ahead of the
+ * inner and outer hash respectively. Those blocks only depend on
+ * the key, so they are hashed once in init and kept as midstates.
+ * Computing a tag thus costs the blocks of the message plus the
+ * single block of the outer hash, regardless of the key length.
+ *
+ * Like the core library this performs no allocations, and the
+ * keyed state can be shared by any number of threads once it has
+ * been initialized.
+ * Example:
+
+    using byte = unsigned char;
+
+    //Prepare the key once
+    hmac_sha256 mac;
+    mac.init(key.data(), key.size());
+
+    //Verify a request
+    if (!mac.verify(body.data(), body.size(), tag))
+        reject();
+
+    //Or verify many at once
+    hmac_sha256::tagged_message batch[] = { ... };
+    bool valid[std::size(batch)];
+    mac.verify_batch(batch, std::size(batch), valid);
+
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sha256.h"
+
+namespace bkh
+{
+    struct hmac_sha256
+    {
+    public:
+        using byte = sha256::byte;
+
+        static constexpr int const tag_length = sha256::digest_length;
+
+        /**
+         * Describes a single message of a batch, along with
+         * the tag it is expected to have.
+         */
+        struct tagged_message
+        {
+            byte const* data;
+            u64         length;
+            byte const* tag;
+        };
+
+        /**
+         * Prepares the keyed state. Keys longer than the block
+         * length are hashed first, as required by HMAC. Must
+         * be called before computing any tags, and may be
+         * called again to change the key.
+         */
+        void init(byte const* key, u64 key_length) noexcept;
+
+        /**
+         * Computes the tag of the message. The provided
+         * pointer is expected to point to a buffer with a
+         * capacity equal to or greater than tag_length.
+         */
+        void compute(byte const* data, u64 data_length, byte* result) const noexcept;
+
+        /**
+         * Computes the tag of each message in the batch,
+         * hashing the messages in parallel lanes where the
+         * host supports it, see sha256::compute_hash_batch.
+         */
+        void compute_batch(sha256::message const* messages, u64 count) const noexcept;
+
+        /**
+         * Checks whether the message has the given tag. The
+         * comparison takes the same time no matter where the
+         * tags differ.
+         */
+        bool verify(byte const* data, u64 data_length, byte const* tag) const noexcept;
+
+        /**
+         * Checks each message of the batch against its tag,
+         * storing the outcome in the corresponding element of
+         * `results`, which may be null. Returns the number of
+         * messages that had the expected tag.
+         */
+        u64 verify_batch(tagged_message const* messages, u64 count, bool* results) const noexcept;
+
+        /**
+         * Prepares a hasher for computing the tag of a message
+         * that arrives in pieces. Pass the hasher to finalize
+         * once the whole message has been passed to update.
+         */
+        void begin(sha256::hasher* h) const noexcept;
+
+        /**
+         * Retrieves the tag of a message fed to a hasher
+         * prepared by begin. Clears the hasher like
+         * sha256::hasher::finalize.
+         */
+        void finalize(sha256::hasher* h, byte* result) const noexcept;
+
+        /**
+         * Retrieves the midstates after the inner and outer key
+         * blocks, for building other constructions on HMAC
+         * such as PBKDF2.
+         */
+        void get_midstates(sha256::midstate* inner_result, sha256::midstate* outer_result) const noexcept;
+
+        /**
+         * Clears the keyed state.
+         */
+        void clear_state() noexcept;
+
+        /**
+         * Computes the tag of a message in a single call.
+         * Prefer keeping an initialized hmac_sha256 around
+         * when the same key is used more than once.
+         */
+        static void compute_hmac(
+            byte const* key,
+            u64         key_length,
+            byte const* data,
+            u64         data_length,
+            byte*       result
+        ) noexcept;
+
+        /**
+         * Compares two buffers in a time that only depends
+         * on their length, for comparing secret values such
+         * as tags.
+         */
+        static bool equal(byte const* lhs, byte const* rhs, u64 length) noexcept;
+
+    private:
+        void outer_hash(byte const* inner_digest, byte* result) const noexcept;
+
+        sha256::midstate inner;
+        sha256::midstate outer;
+    };
+};
+
+#endif
@@ -0,0 +1,383 @@
+/** sha256_index.cpp - Bendik Hillestad - Public Domain
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sha256_index.h"
+
+#include <cerrno>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    include <emmintrin.h>
+#    define BKH_INDEX_SSE2 1
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#    include <intrin.h>
+#endif
+
+/* Types */
+
+using byte   = bkh::sha256_index::byte;
+using digest = bkh::sha256_index::digest;
+
+using bkh::u32;
+using bkh::u64;
+using bkh::sha256_index;
+
+/* Helpers */
+
+static constexpr u64 const index_magic   = 0x3130584449484B42ull; //"BKHIDX01"
+static constexpr u32 const index_version = 1;
+
+/**
+ * The control bytes. Full entries hold the low seven bits of the
+ * hash, the other two have the high bit set.
+ */
+static constexpr byte const empty_slot   = 0x80;
+static constexpr byte const deleted_slot = 0xFE;
+
+static constexpr u64 const group_size = sha256_index::group_size;
+static constexpr u64 const no_slot    = ~u64{ 0 };
+
+/**
+ * The start of the memory of a table. The flags tell whether it
+ * has values.
+ */
+struct sha256_index::header
+{
+    u64 magic;
+    u32 version;
+    u32 flags;
+    u64 capacity;
+    u64 count; //Full entries
+    u64 used;  //Full and deleted entries
+    u64 reserved[3];
+};
+
+static constexpr u32 const flag_values = 1;
+
+/**
+ * The size of the header, which keeps the arrays after it aligned.
+ */
+static constexpr u64 const header_size = 64;
+
+/**
+ * The largest number of full and deleted entries a table holds,
+ * beyond which probing gets long.
+ */
+static u64 max_used(u64 capacity) noexcept
+{
+    return capacity - capacity / 8;
+}
+
+static u32 lowest_bit(u32 mask) noexcept
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return index;
+#else
+    return static_cast<u32>(__builtin_ctz(mask));
+#endif
+}
+
+/**
+ * Finds the entries of the group whose control byte equals the
+ * given one, as a mask with a bit for each entry.
+ */
+static u32 match(byte const* group, byte value) noexcept
+{
+#if defined(BKH_INDEX_SSE2)
+    __m128i const ctrl = _mm_load_si128(reinterpret_cast<__m128i const*>(group));
+    __m128i const cmp  = _mm_cmpeq_epi8(ctrl, _mm_set1_epi8(static_cast<char>(value)));
+    return static_cast<u32>(_mm_movemask_epi8(cmp));
+#else
+    u32 mask = 0;
+    for (u32 i = 0; i < group_size; i++) mask |= static_cast<u32>(group[i] == value) << i;
+    return mask;
+#endif
+}
+
+/**
+ * Finds the entries of the group that are empty or deleted.
+ */
+static u32 match_free(byte const* group) noexcept
+{
+#if defined(BKH_INDEX_SSE2)
+    return static_cast<u32>(_mm_movemask_epi8(_mm_load_si128(reinterpret_cast<__m128i const*>(group))));
+#else
+    u32 mask = 0;
+    for (u32 i = 0; i < group_size; i++) mask |= static_cast<u32>(group[i] >> 7) << i;
+    return mask;
+#endif
+}
+
+/**
+ * Computes the layout of a table in its memory.
+ */
+static u64 control_offset()            noexcept { return header_size; }
+static u64 keys_offset(u64 capacity)   noexcept { return control_offset() + capacity; }
+static u64 values_offset(u64 capacity) noexcept { return keys_offset(capacity) + capacity * sizeof(digest); }
+
+/* Implementation */
+
+u64 bkh::sha256_index::capacity_for(u64 entries) noexcept
+{
+    u64 capacity = min_capacity;
+    while (max_used(capacity) < entries) capacity <<= 1;
+
+    return capacity;
+}
+
+u64 bkh::sha256_index::required_size(u64 capacity, bool with_values) noexcept
+{
+    return values_offset(capacity) + (with_values ? capacity * sizeof(u64) : 0);
+}
+
+bool bkh::sha256_index::init(void* memory, u64 memory_size, u64 capacity, bool with_values) noexcept
+{
+    this->head = nullptr;
+    this->fd   = -1;
+
+    //Validate the arguments, the groups and digests must be aligned
+    if (capacity < min_capacity || (capacity & (capacity - 1)) != 0) return false;
+    if (reinterpret_cast<u64>(memory) % alignof(digest) != 0)          return false;
+    if (memory_size < required_size(capacity, with_values))            return false;
+
+    //Write the header and mark every entry as empty
+    static_assert(sizeof(header) == header_size);
+    auto* h = static_cast<header*>(memory);
+    *h = header{};
+    h->magic    = index_magic;
+    h->version  = index_version;
+    h->flags    = with_values ? flag_values : 0;
+    h->capacity = capacity;
+
+    byte* ctrl = static_cast<byte*>(memory) + control_offset();
+    for (u64 i = 0; i < capacity; i++) ctrl[i] = empty_slot;
+
+    return this->attach(memory, memory_size);
+}
+
+bool bkh::sha256_index::attach(void* memory, u64 memory_size) noexcept
+{
+    this->head = nullptr;
+    this->fd   = -1;
+
+    //Check that it is a table, and that it fits
+    auto* h = static_cast<header*>(memory);
+    if (reinterpret_cast<u64>(memory) % alignof(digest) != 0 || memory_size < sizeof(header)) return false;
+    if (h->magic != index_magic || h->version != index_version || (h->flags & ~flag_values) != 0) return false;
+    if (h->capacity < min_capacity || (h->capacity & (h->capacity - 1)) != 0)                 return false;
+    if (memory_size < required_size(h->capacity, h->flags & flag_values))                     return false;
+    if (h->count > h->used || h->used > max_used(h->capacity))                                return false;
+
+    byte* base    = static_cast<byte*>(memory);
+    this->head    = h;
+    this->control = base + control_offset();
+    this->keys    = reinterpret_cast<digest*>(base + keys_offset(h->capacity));
+    this->values  = (h->flags & flag_values) ? reinterpret_cast<u64*>(base + values_offset(h->capacity)) : nullptr;
+    return true;
+}
+
+bool bkh::sha256_index::open(char const* path, u64 capacity, bool with_values) noexcept
+{
+    this->head = nullptr;
+    this->fd   = -1;
+
+    int const f = ::open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (f < 0) return false;
+
+    auto const fail = [f](int error)
+    {
+        ::close(f);
+        errno = error;
+        return false;
+    };
+
+    //Create it if it's new, the arrays are sparse until used
+    struct stat info;
+    if (fstat(f, &info) != 0) return fail(errno);
+
+    bool const fresh = info.st_size == 0;
+    if (fresh)
+    {
+        if (capacity < min_capacity || (capacity & (capacity - 1)) != 0) return fail(EINVAL);
+        info.st_size = static_cast<off_t>(required_size(capacity, with_values));
+        if (ftruncate(f, info.st_size) != 0) return fail(errno);
+    }
+
+    u64 const size = static_cast<u64>(info.st_size);
+    void*     map  = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, f, 0);
+    if (map == MAP_FAILED) return fail(errno);
+
+    bool const ok = fresh ? this->init(map, size, capacity, with_values) : this->attach(map, size);
+    if (!ok)
+    {
+        munmap(map, size);
+        return fail(EINVAL);
+    }
+
+    this->fd       = f;
+    this->map_size = size;
+    return true;
+}
+
+bool bkh::sha256_index::sync() noexcept
+{
+    if (this->fd < 0) return true;
+
+    return msync(this->head, this->map_size, MS_SYNC) == 0;
+}
+
+void bkh::sha256_index::close() noexcept
+{
+    if (this->fd >= 0)
+    {
+        munmap(this->head, this->map_size);
+        ::close(this->fd);
+    }
+
+    this->head = nullptr;
+    this->fd   = -1;
+}
+
+u64 bkh::sha256_index::probe(digest const& key) const noexcept
+{
+    //The digest is its own hash, the low bits pick the control byte and the rest the group
+    u64 const  hash = key.prefix();
+    byte const tag  = static_cast<byte>(hash & 0x7F);
+    u64 const  mask = this->head->capacity / group_size - 1;
+
+    //Visit the groups in triangular order, which covers every group
+    u64 g = (hash >> 7) & mask;
+    for (u64 step = 1; step <= mask + 1; step++)
+    {
+        byte const* group = this->control + g * group_size;
+        for (u32 m = match(group, tag); m != 0; m &= m - 1)
+        {
+            u64 const slot = g * group_size + lowest_bit(m);
+            if (this->keys[slot] == key) return slot;
+        }
+
+        //An empty entry ends the search, the digest would have been put there
+        if (match(group, empty_slot) != 0) return no_slot;
+
+        g = (g + step) & mask;
+    }
+
+    return no_slot;
+}
+
+bool bkh::sha256_index::find(digest const& key, u64* value) const noexcept
+{
+    u64 const slot = this->probe(key);
+    if (slot == no_slot) return false;
+
+    if (value) *value = this->values ? this->values[slot] : 0;
+    return true;
+}
+
+bool bkh::sha256_index::contains(digest const& key) const noexcept
+{
+    return this->probe(key) != no_slot;
+}
+
+bool bkh::sha256_index::insert(digest const& key, u64 value, bool* inserted) noexcept
+{
+    if (inserted) *inserted = false;
+
+    //Update it if it's already there
+    u64 slot = this->probe(key);
+    if (slot != no_slot)
+    {
+        if (this->values) this->values[slot] = value;
+        return true;
+    }
+
+    //Take the first free entry along the same sequence
+    u64 const hash = key.prefix();
+    u64 const mask = this->head->capacity / group_size - 1;
+    u64 g = (hash >> 7) & mask;
+    for (u64 step = 1; step <= mask + 1; step++)
+    {
+        u32 const m = match_free(this->control + g * group_size);
+        if (m != 0)
+        {
+            slot = g * group_size + lowest_bit(m);
+            break;
+        }
+        g = (g + step) & mask;
+    }
+    if (slot == no_slot) return false;
+
+    //Reusing a deleted entry doesn't add to the load
+    bool const reuse = this->control[slot] == deleted_slot;
+    if (!reuse && this->head->used >= max_used(this->head->capacity)) return false;
+
+    this->control[slot] = static_cast<byte>(hash & 0x7F);
+    this->keys[slot]    = key;
+    if (this->values) this->values[slot] = value;
+
+    this->head->count++;
+    if (!reuse) this->head->used++;
+    if (inserted) *inserted = true;
+    return true;
+}
+
+bool bkh::sha256_index::erase(digest const& key) noexcept
+{
+    u64 const slot = this->probe(key);
+    if (slot == no_slot) return false;
+
+    //No search goes past a group with an empty entry, so the entry can be emptied rather than deleted
+    byte* group = this->control + slot / group_size * group_size;
+    if (match(group, empty_slot) != 0)
+    {
+        this->control[slot] = empty_slot;
+        this->head->used--;
+    }
+    else
+    {
+        this->control[slot] = deleted_slot;
+    }
+
+    this->head->count--;
+    return true;
+}
+
+u64 bkh::sha256_index::size() const noexcept
+{
+    return this->head->count;
+}
+
+u64 bkh::sha256_index::capacity() const noexcept
+{
+    return this->head->capacity;
+}
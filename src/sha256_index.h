@@ -0,0 +1,189 @@
+#ifndef BKH_SHA256_INDEX_H
+#define BKH_SHA256_INDEX_H
+#pragma once
+
+/** sha256_index.h - Bendik Hillestad - Public Domain
+ * Implements a flat hash set of digests, optionally mapping each
+ * of them to a 64-bit value such as the location of a chunk, for
+ * deduplication indexes holding vast numbers of digests.
+ *
+ * Digests are uniformly distributed already, so the first eight
+ * bytes of the digest are used as the hash without hashing it
+ * again. The table uses open addressing with a control byte per
+ * entry, holding seven bits of the hash for full entries or
+ * marking it empty or deleted. Lookups probe groups of 16 control
+ * bytes at once with SSE2, and only compare the digests whose
+ * control byte matches, which is almost always just the one being
+ * looked for. Control bytes, digests and values live in separate
+ * arrays, so an entry takes 33 bytes, or 41 with a value, and the
+ * table is filled up to 7/8 of its capacity.
+ *
+ * The table lives in a single block of memory provided by the
+ * user, which starts with a header describing it, so it performs
+ * no allocations and can be stored as is. open() maps a file and
+ * uses that as the memory, making the index persistent. The
+ * layout is in the byte order of the host, and the capacity is
+ * fixed, an index that fills up must be rebuilt into a larger one.
+ * It is not synchronized, neither between threads nor between
+ * processes sharing the file.
+ * Example:
+
+    //Create an index of up to a billion digests
+    sha256_index index;
+    if (!index.open("chunks.idx", sha256_index::capacity_for(1000000000), true))
+        perror("chunks.idx");
+
+    //Store the location of a chunk unless it's already there
+    sha256::digest d;
+    sha256::compute_hash(data, length, d.bytes);
+    u64 location;
+    if (!index.find(d, &location))
+        index.insert(d, store_chunk(data, length));
+
+    index.close();
+
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sha256.h"
+
+namespace bkh
+{
+    struct sha256_index
+    {
+    public:
+        using byte   = sha256::byte;
+        using digest = sha256::digest;
+
+        /**
+         * The number of entries probed at once.
+         */
+        static constexpr u64 const group_size = 16;
+
+        /**
+         * The smallest capacity of a table.
+         */
+        static constexpr u64 const min_capacity = 32;
+
+        /**
+         * Computes the capacity needed to hold the given number
+         * of digests, a power of two.
+         */
+        static u64 capacity_for(u64 entries) noexcept;
+
+        /**
+         * Computes the number of bytes of memory a table of the
+         * given capacity needs, with or without values.
+         */
+        static u64 required_size(u64 capacity, bool with_values) noexcept;
+
+        /**
+         * Sets up an empty table in the memory, which must be
+         * aligned to 32 bytes and at least required_size large.
+         * The capacity must be a power of two of at least
+         * min_capacity. Returns false if it isn't, or if the
+         * memory is too small or misaligned.
+         */
+        bool init(void* memory, u64 memory_size, u64 capacity, bool with_values) noexcept;
+
+        /**
+         * Uses a table previously set up in the memory, such as
+         * one read back from storage. Returns false if the
+         * memory doesn't hold a valid table.
+         */
+        bool attach(void* memory, u64 memory_size) noexcept;
+
+        /**
+         * Maps the file and uses it as the memory of the table,
+         * creating it with the given capacity if it is empty or
+         * doesn't exist. An existing table keeps its capacity
+         * and whether it has values. Returns false, with errno
+         * set, if the file could not be opened or mapped, or to
+         * EINVAL if it doesn't hold a valid table.
+         */
+        bool open(char const* path, u64 capacity, bool with_values) noexcept;
+
+        /**
+         * Writes the changes to a mapped file back to storage.
+         * Does nothing for memory provided by the user.
+         */
+        bool sync() noexcept;
+
+        /**
+         * Unmaps the file, if one was opened. The table must be
+         * initialized or attached again before further use.
+         */
+        void close() noexcept;
+
+        /**
+         * Looks up the digest, returning false if it isn't in
+         * the table. Otherwise its value is written to `value`
+         * unless it is null, or 0 if the table has no values.
+         */
+        bool find(digest const& key, u64* value) const noexcept;
+
+        /**
+         * Checks whether the digest is in the table.
+         */
+        bool contains(digest const& key) const noexcept;
+
+        /**
+         * Adds the digest with the given value, or updates the
+         * value if it is already in the table. `inserted`, if
+         * not null, tells which happened. Returns false if the
+         * table is full.
+         */
+        bool insert(digest const& key, u64 value, bool* inserted = nullptr) noexcept;
+
+        /**
+         * Removes the digest, returning false if it wasn't in
+         * the table.
+         */
+        bool erase(digest const& key) noexcept;
+
+        /**
+         * Retrieves the number of digests in the table.
+         */
+        u64 size() const noexcept;
+
+        /**
+         * Retrieves the capacity of the table.
+         */
+        u64 capacity() const noexcept;
+
+    private:
+        struct header;
+
+        u64 probe(digest const& key) const noexcept;
+
+        header* head;
+        byte*   control;
+        digest* keys;
+        u64*    values;
+        int     fd;
+        u64     map_size;
+    };
+};
+
+#endif
@@ -0,0 +1,424 @@
+/** sha256_manifest.cpp - Bendik Hillestad - Public Domain
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sha256_manifest.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+/* Types */
+
+using byte            = bkh::sha256_manifest::byte;
+using options         = bkh::sha256_manifest::options;
+using status          = bkh::sha256_manifest::status;
+using line_callback   = bkh::sha256_manifest::line_callback;
+using verify_callback = bkh::sha256_manifest::verify_callback;
+
+using bkh::u64;
+using bkh::sha256;
+using bkh::sha256_file;
+
+/* Helpers */
+
+static constexpr int const hex_length = 2 * sha256::digest_length;
+
+/**
+ * A file of the tree and its digest.
+ */
+struct file_entry
+{
+    std::string path;
+    byte        digest[sha256::digest_length];
+};
+
+/**
+ * A directory to read or a file to hash, relative to the root.
+ */
+struct walk_item
+{
+    std::string                      path;
+    bool                             directory;
+    std::vector<std::pair<u64, u64>> ancestors; //The directories leading to it, when following links
+};
+
+/**
+ * The state shared by the threads walking the tree. Directories
+ * and files are taken from the same stack, which keeps it small
+ * as the walk goes depth first.
+ */
+struct walk_state
+{
+    std::string const& root;
+    options const&     opts;
+
+    walk_state(std::string const& r, options const& o) : root{ r }, opts{ o } {}
+
+    std::mutex              lock;
+    std::condition_variable cv;
+    std::vector<walk_item>  stack;
+    u64                     pending = 0; //Items queued or being processed
+    int                     error   = 0;
+
+    std::vector<file_entry> files;
+};
+
+/**
+ * Decides how many threads to use.
+ */
+static unsigned thread_count(options const& opts, u64 work)
+{
+    unsigned threads = (opts.threads > 0) ? opts.threads : std::thread::hardware_concurrency();
+    if (threads < 1)    threads = 1;
+    if (threads > work) threads = static_cast<unsigned>(work > 0 ? work : 1);
+
+    return threads;
+}
+
+/**
+ * Runs the worker on the calling thread and threads - 1 others.
+ */
+template<typename Worker>
+static void run_threads(unsigned threads, Worker const& worker)
+{
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    for (unsigned i = 1; i < threads; i++) pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool) t.join();
+}
+
+/**
+ * Joins a path relative to the root onto it.
+ */
+static std::string full_path(std::string const& root, std::string const& path)
+{
+    if (path.empty()) return root;
+    if (!root.empty() && root.back() == '/') return root + path;
+
+    return root + "/" + path;
+}
+
+/**
+ * Reads a directory, adding what's in it to `found`. Returns
+ * false, with errno set, if it could not be read.
+ */
+static bool read_directory(walk_state& w, walk_item const& item, std::vector<walk_item>& found)
+{
+    std::string const& path = item.path;
+    std::string const  full = full_path(w.root, path);
+
+    //Don't enter a directory a link leads back to
+    std::vector<std::pair<u64, u64>> ancestors;
+    if (w.opts.follow_symlinks)
+    {
+        struct stat info;
+        if (stat(full.c_str(), &info) != 0) return false;
+
+        std::pair<u64, u64> const self{ static_cast<u64>(info.st_dev), static_cast<u64>(info.st_ino) };
+        if (std::find(item.ancestors.begin(), item.ancestors.end(), self) != item.ancestors.end()) return true;
+
+        ancestors = item.ancestors;
+        ancestors.push_back(self);
+    }
+
+    DIR* dir = opendir(full.c_str());
+    if (!dir) return false;
+
+    errno = 0;
+    while (dirent* entry = readdir(dir))
+    {
+        char const* name = entry->d_name;
+        if (std::strcmp(name, ".") == 0 || std::strcmp(name, "..") == 0) continue;
+
+        std::string child = path.empty() ? std::string{ name } : path + "/" + name;
+
+        //Find out what it is, the directory entry may not tell
+        unsigned char type = entry->d_type;
+        if (type == DT_UNKNOWN || (type == DT_LNK && w.opts.follow_symlinks))
+        {
+            struct stat info;
+            std::string const child_full = full_path(w.root, child);
+            int const result = w.opts.follow_symlinks ? stat(child_full.c_str(), &info) : lstat(child_full.c_str(), &info);
+            if (result != 0)
+            {
+                //A dangling link is skipped like any other link
+                if (errno == ENOENT) continue;
+
+                int const error = errno;
+                closedir(dir);
+                errno = error;
+                return false;
+            }
+
+            type = S_ISDIR(info.st_mode) ? DT_DIR : S_ISREG(info.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+
+        if      (type == DT_DIR) found.push_back({ std::move(child), true, ancestors });
+        else if (type == DT_REG) found.push_back({ std::move(child), false, {} });
+        errno = 0;
+    }
+
+    int const error = errno;
+    closedir(dir);
+    errno = error;
+    return error == 0;
+}
+
+/**
+ * Takes items off the stack until the walk is done or failed.
+ */
+static void walk(walk_state& w)
+{
+    std::vector<walk_item> found;
+
+    std::unique_lock<std::mutex> guard{ w.lock };
+    while (true)
+    {
+        while (w.stack.empty() && w.pending > 0 && w.error == 0) w.cv.wait(guard);
+        if (w.stack.empty() || w.error != 0) return;
+
+        walk_item item = std::move(w.stack.back());
+        w.stack.pop_back();
+        guard.unlock();
+
+        //Read the directory or hash the file
+        found.clear();
+        file_entry file;
+        bool ok;
+        if (item.directory)
+        {
+            ok = read_directory(w, item, found);
+        }
+        else
+        {
+            ok        = sha256_file::hash_file(full_path(w.root, item.path).c_str(), file.digest, w.opts.io);
+            file.path = std::move(item.path);
+        }
+        int const error = errno;
+
+        guard.lock();
+        if (!ok && w.error == 0) w.error = (error != 0) ? error : EIO;
+        if (ok && !item.directory) w.files.push_back(std::move(file));
+        for (auto& f : found) w.stack.push_back(std::move(f));
+        w.pending += found.size();
+        w.pending -= 1;
+
+        //Wake the others when there's more to do, or nothing left
+        if (!found.empty() || w.pending == 0 || w.error != 0) w.cv.notify_all();
+    }
+}
+
+/**
+ * Formats a line of the manifest.
+ */
+static void format_line(file_entry const& f, std::string& line)
+{
+    static char const digits[] = "0123456789abcdef";
+
+    line.clear();
+    bool const escape = f.path.find_first_of("\\\n") != std::string::npos;
+    if (escape) line += '\\';
+
+    for (int i = 0; i < sha256::digest_length; i++)
+    {
+        line += digits[f.digest[i] >> 4];
+        line += digits[f.digest[i] & 15];
+    }
+    line += "  ";
+
+    for (char c : f.path)
+    {
+        if      (escape && c == '\\') line += "\\\\";
+        else if (escape && c == '\n') line += "\\n";
+        else                          line += c;
+    }
+    line += '\n';
+}
+
+static int hex_value(char c) noexcept
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+
+    return -1;
+}
+
+/**
+ * Parses a line of the manifest, returning false if it is
+ * malformed.
+ */
+static bool parse_line(char const* line, u64 length, file_entry& f)
+{
+    //Parse "[\]HEX  PATH" or "[\]HEX *PATH"
+    bool const escaped = length > 0 && line[0] == '\\';
+    u64 const  h       = escaped ? 1 : 0;
+    if (length < h + hex_length + 3) return false;
+    if (line[h + hex_length] != ' ' || (line[h + hex_length + 1] != ' ' && line[h + hex_length + 1] != '*')) return false;
+
+    for (int i = 0; i < sha256::digest_length; i++)
+    {
+        int const hi = hex_value(line[h + 2 * i]);
+        int const lo = hex_value(line[h + 2 * i + 1]);
+        if (hi < 0 || lo < 0) return false;
+
+        f.digest[i] = static_cast<byte>(hi << 4 | lo);
+    }
+
+    f.path.clear();
+    for (u64 i = h + hex_length + 2; i < length; i++)
+    {
+        if (escaped && line[i] == '\\' && i + 1 < length)
+        {
+            char const c = line[++i];
+            f.path += (c == 'n') ? '\n' : c;
+        }
+        else
+        {
+            f.path += line[i];
+        }
+    }
+
+    return true;
+}
+
+/* Implementation */
+
+options bkh::sha256_manifest::default_options() noexcept
+{
+    return options{ 0, false, false, sha256_file::default_options() };
+}
+
+bool bkh::sha256_manifest::hash_tree(char const* root, line_callback cb, void* user, byte* tree_digest, options const& opts)
+{
+    std::string const r{ root };
+    walk_state        w{ r, opts };
+
+    //Start from the root, which must be a directory
+    struct stat info;
+    if (stat(root, &info) != 0) return false;
+    if (!S_ISDIR(info.st_mode))
+    {
+        errno = ENOTDIR;
+        return false;
+    }
+    w.stack.push_back({ std::string{}, true, {} });
+    w.pending = 1;
+
+    run_threads(thread_count(opts, ~u64{ 0 }), [&w]() { walk(w); });
+    if (w.error != 0)
+    {
+        errno = w.error;
+        return false;
+    }
+
+    //Sort the files so the manifest doesn't depend on the order they were found in
+    std::sort(w.files.begin(), w.files.end(), [](file_entry const& a, file_entry const& b) { return a.path < b.path; });
+
+    sha256::hasher h;
+    h.init();
+
+    std::string line;
+    for (auto const& f : w.files)
+    {
+        format_line(f, line);
+        h.update(reinterpret_cast<byte const*>(line.data()), line.size());
+        if (cb) cb(user, line.data(), line.size());
+    }
+
+    if (tree_digest) h.finalize(tree_digest);
+    else             h.clear_state();
+
+    return true;
+}
+
+bool bkh::sha256_manifest::verify_tree(char const* root, char const* manifest, u64 manifest_length, verify_callback cb, void* user, options const& opts)
+{
+    //Parse the whole manifest first
+    std::vector<file_entry> files;
+    for (u64 begin = 0; begin < manifest_length; )
+    {
+        u64 end = begin;
+        while (end < manifest_length && manifest[end] != '\n') end++;
+
+        u64 length = end - begin;
+        if (length > 0 && manifest[begin + length - 1] == '\r') length--;
+
+        file_entry f;
+        if (!parse_line(manifest + begin, length, f))
+        {
+            errno = EINVAL;
+            return false;
+        }
+        files.push_back(std::move(f));
+
+        begin = end + 1;
+    }
+
+    //Check the files, handing them out one at a time
+    std::string const r{ root };
+    std::atomic<u64>  next{ 0 };
+    std::atomic<bool> failed{ false };
+    std::mutex        report;
+    auto const worker = [&]()
+    {
+        for (u64 i = next++; i < files.size(); i = next++)
+        {
+            if (opts.stop_on_mismatch && failed.load(std::memory_order_relaxed)) return;
+
+            byte   digest[sha256::digest_length];
+            status result = status::ok;
+            if (!sha256_file::hash_file(full_path(r, files[i].path).c_str(), digest, opts.io))
+            {
+                result = (errno == ENOENT) ? status::missing : status::unreadable;
+            }
+            else if (std::memcmp(digest, files[i].digest, sha256::digest_length) != 0)
+            {
+                result = status::mismatch;
+            }
+
+            if (result != status::ok) failed.store(true, std::memory_order_relaxed);
+            if (cb)
+            {
+                std::lock_guard<std::mutex> guard{ report };
+                cb(user, files[i].path.c_str(), result);
+            }
+        }
+    };
+
+    run_threads(thread_count(opts, files.size()), worker);
+    return !failed.load();
+}
@@ -0,0 +1,149 @@
+#ifndef BKH_SHA256_MANIFEST_H
+#define BKH_SHA256_MANIFEST_H
+#pragma once
+
+/** sha256_manifest.h - Bendik Hillestad - Public Domain
+ * Implements hashing of directory trees into a manifest, and
+ * verifying trees against one, with the directories walked and
+ * the files hashed in parallel on every core.
+ *
+ * The manifest has a line for every regular file in the tree in
+ * the format of sha256sum, the hex digest, two spaces and the path
+ * relative to the root with '/' as the separator, such that it can
+ * also be checked with `sha256sum -c` from the root. File names
+ * containing a backslash or a newline are escaped the same way
+ * sha256sum does it. The lines are sorted by the bytes of the
+ * path, so the same tree always gives the same manifest no matter
+ * the order the directories were read in. The tree digest is the
+ * SHA-256 digest of the manifest.
+ *
+ * Only regular files are listed, empty directories leave no trace
+ * and other kinds of files are skipped. Symbolic links are skipped
+ * unless asked to follow them, in which case a file reached through
+ * several links is listed under each path, and links leading back
+ * to a directory above them are skipped.
+ *
+ * The lines can only be sorted once the walk is done, so every
+ * path of the tree is held in memory until then.
+ * Example:
+
+    //Print the manifest of a tree
+    auto const print = [](void*, char const* line, u64 length)
+    {
+        fwrite(line, 1, length, stdout);
+    };
+
+    byte tree_digest[sha256::digest_length];
+    if (!sha256_manifest::hash_tree("release", print, nullptr, tree_digest, sha256_manifest::default_options()))
+        perror("release");
+
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sha256_file.h"
+
+namespace bkh
+{
+    struct sha256_manifest
+    {
+    public:
+        using byte = sha256::byte;
+
+        struct options
+        {
+            unsigned             threads;          //Number of threads, 0 for one per core
+            bool                 follow_symlinks;  //Follow symbolic links rather than skipping them
+            bool                 stop_on_mismatch; //Stop verifying at the first file that fails
+            sha256_file::options io;               //How to read the files
+        };
+
+        /**
+         * The outcome of verifying a file of the manifest.
+         */
+        enum class status : u8
+        {
+            ok,         //The digest matches
+            mismatch,   //The digest differs
+            missing,    //The file does not exist
+            unreadable  //The file could not be read
+        };
+
+        /**
+         * Receives a line of the manifest, including the newline.
+         */
+        using line_callback = void(*)(void* user, char const* line, u64 length);
+
+        /**
+         * Receives the outcome of verifying a file. The path is
+         * relative to the root, as written in the manifest.
+         */
+        using verify_callback = void(*)(void* user, char const* path, status result);
+
+        /**
+         * Retrieves the default options, which use one thread
+         * per core, skip symbolic links, verify every file and
+         * read the files with sha256_file's default options.
+         */
+        static options default_options() noexcept;
+
+        /**
+         * Hashes every regular file below the root and hands the
+         * lines of the manifest to the callback in order, once
+         * every file has been hashed. The tree digest is written
+         * to `tree_digest` unless it is null. Returns false, with
+         * errno set and without calling the callback, if a
+         * directory or file could not be read.
+         */
+        static bool hash_tree(
+            char const*    root,
+            line_callback  cb,
+            void*          user,
+            byte*          tree_digest,
+            options const& opts
+        );
+
+        /**
+         * Verifies the files of a manifest, relative to the
+         * root. The callback is called for every file checked,
+         * from one thread at a time but in no particular order.
+         * Returns true if every file matched. If a file fails
+         * and `opts.stop_on_mismatch` is set the files not yet
+         * checked are skipped. Returns false with errno set to
+         * EINVAL, without checking anything, if a line of the
+         * manifest is malformed.
+         */
+        static bool verify_tree(
+            char const*     root,
+            char const*     manifest,
+            u64             manifest_length,
+            verify_callback cb,
+            void*           user,
+            options const&  opts
+        );
+
+        sha256_manifest() = delete;
+    };
+};
+
+#endif
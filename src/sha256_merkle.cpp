@@ -0,0 +1,333 @@
+/** sha256_merkle.cpp - Bendik Hillestad - Public Domain
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sha256_merkle.h"
+
+/* Types */
+
+using byte = bkh::sha256_merkle::byte;
+
+using bkh::u64;
+using bkh::sha256;
+
+/* Helpers */
+
+/**
+ * The prefixes which separate leaves from internal nodes.
+ */
+static constexpr byte const leaf_prefix = 0x00;
+static constexpr byte const node_prefix = 0x01;
+
+/**
+ * The largest supported capacity, for which the size of the
+ * storage still fits in 64 bits.
+ */
+static constexpr u64 const max_capacity = 1ull << 57;
+
+/**
+ * Copies a digest from one buffer to another.
+ */
+static void copy_digest(byte* dst, byte const* src) noexcept
+{
+    for (int i = 0; i < sha256::digest_length; i++) dst[i] = src[i];
+}
+
+/**
+ * Compares two digests.
+ */
+static bool equal_digest(byte const* lhs, byte const* rhs) noexcept
+{
+    for (int i = 0; i < sha256::digest_length; i++)
+    {
+        if (lhs[i] != rhs[i]) return false;
+    }
+
+    return true;
+}
+
+/**
+ * Rounds the capacity up to a power of two, at least one.
+ */
+static u64 round_capacity(u64 capacity) noexcept
+{
+    u64 p = 1;
+    while (p < capacity) p <<= 1;
+
+    return p;
+}
+
+/* Implementation */
+
+u64 bkh::sha256_merkle::storage_size(u64 capacity) noexcept
+{
+    //Check that it's not too big
+    if (capacity > max_capacity) return 0;
+
+    //One digest per node, index 0 is unused
+    return 2 * round_capacity(capacity) * sha256::digest_length;
+}
+
+bool bkh::sha256_merkle::init(void* storage, u64 storage_length, u64 capacity) noexcept
+{
+    //Check that the storage is large enough
+    u64 const required = storage_size(capacity);
+    if (required == 0 || storage_length < required) return false;
+
+    //Calculate the height of the tree
+    this->leaf_capacity = round_capacity(capacity);
+    this->height        = 0;
+    while ((1ull << this->height) < this->leaf_capacity) this->height++;
+
+    //Start out empty
+    this->nodes      = static_cast<byte*>(storage);
+    this->leaf_count = 0;
+    return true;
+}
+
+u64 bkh::sha256_merkle::size() const noexcept
+{
+    return this->leaf_count;
+}
+
+u64 bkh::sha256_merkle::capacity() const noexcept
+{
+    return this->leaf_capacity;
+}
+
+bool bkh::sha256_merkle::append(byte const* data, u64 data_length) noexcept
+{
+    byte digest[sha256::digest_length];
+    hash_leaf(data, data_length, digest);
+
+    return this->append_digest(digest);
+}
+
+bool bkh::sha256_merkle::append_digest(byte const* leaf_digest) noexcept
+{
+    //Check that there's room
+    if (this->leaf_count == this->leaf_capacity) return false;
+
+    //Store the leaf and update the nodes covering it
+    u64 const index = this->leaf_count++;
+    copy_digest(this->nodes + (this->leaf_capacity + index) * sha256::digest_length, leaf_digest);
+    this->update_path(index);
+    return true;
+}
+
+bool bkh::sha256_merkle::set_leaf(u64 index, byte const* data, u64 data_length) noexcept
+{
+    //Check that the leaf exists
+    if (index >= this->leaf_count) return false;
+
+    byte digest[sha256::digest_length];
+    hash_leaf(data, data_length, digest);
+
+    return this->set_leaf_digest(index, digest);
+}
+
+bool bkh::sha256_merkle::set_leaf_digest(u64 index, byte const* leaf_digest) noexcept
+{
+    //Check that the leaf exists
+    if (index >= this->leaf_count) return false;
+
+    //Store the leaf and update the nodes covering it
+    copy_digest(this->nodes + (this->leaf_capacity + index) * sha256::digest_length, leaf_digest);
+    this->update_path(index);
+    return true;
+}
+
+bool bkh::sha256_merkle::set_leaves(leaf const* leaves, u64 count) noexcept
+{
+    //Validate everything up front
+    for (u64 i = 0; i < count; i++)
+    {
+        if (leaves[i].index >= this->leaf_count)                return false;
+        if (i > 0 && leaves[i].index <= leaves[i - 1].index) return false;
+    }
+
+    //Store the leaves
+    for (u64 i = 0; i < count; i++)
+    {
+        u64 const node = this->leaf_capacity + leaves[i].index;
+        hash_leaf(leaves[i].data, leaves[i].length, this->nodes + node * sha256::digest_length);
+    }
+
+    //Update one level at a time, the sorting makes shared ancestors adjacent
+    for (u64 h = 1; h <= this->height; h++)
+    {
+        u64 previous = 0;
+        for (u64 i = 0; i < count; i++)
+        {
+            u64 const node = (this->leaf_capacity + leaves[i].index) >> h;
+            if (node == previous) continue;
+
+            this->update_node(node, h);
+            previous = node;
+        }
+    }
+
+    return true;
+}
+
+void bkh::sha256_merkle::get_root(byte* result_buffer) const noexcept
+{
+    //The root of an empty tree is the digest of the empty string
+    if (this->leaf_count == 0)
+    {
+        sha256::compute_hash(nullptr, 0, result_buffer);
+        return;
+    }
+
+    copy_digest(result_buffer, this->nodes + 1 * sha256::digest_length);
+}
+
+bool bkh::sha256_merkle::get_leaf_digest(u64 index, byte* result_buffer) const noexcept
+{
+    //Check that the leaf exists
+    if (index >= this->leaf_count) return false;
+
+    copy_digest(result_buffer, this->nodes + (this->leaf_capacity + index) * sha256::digest_length);
+    return true;
+}
+
+bool bkh::sha256_merkle::get_proof(u64 index, byte* proof, u64* proof_length) const noexcept
+{
+    //Check that the leaf exists
+    if (index >= this->leaf_count) return false;
+
+    //Walk from the leaf to the root, collecting the siblings
+    u64 count = 0;
+    u64 node  = this->leaf_capacity + index;
+    for (u64 h = 0; h < this->height; h++, node >>= 1)
+    {
+        //A right sibling past the last leaf is empty, the node was promoted instead
+        u64 const sibling = node ^ 1;
+        u64 const first   = (sibling - (this->leaf_capacity >> h)) << h;
+        if (first >= this->leaf_count) continue;
+
+        copy_digest(proof + count * sha256::digest_length, this->nodes + sibling * sha256::digest_length);
+        count++;
+    }
+
+    *proof_length = count;
+    return true;
+}
+
+u64 bkh::sha256_merkle::max_proof_length() const noexcept
+{
+    return this->height;
+}
+
+bool bkh::sha256_merkle::verify_proof(byte const* leaf_digest, u64 index, u64 tree_size, byte const* proof, u64 proof_length, byte const* root) noexcept
+{
+    //Check that the leaf can exist
+    if (index >= tree_size) return false;
+
+    //Recompute the root as described in RFC 9162 section 2.1.3.2
+    byte r[sha256::digest_length];
+    copy_digest(r, leaf_digest);
+
+    u64 fn = index;
+    u64 sn = tree_size - 1;
+    for (u64 i = 0; i < proof_length; i++)
+    {
+        byte const* p = proof + i * sha256::digest_length;
+
+        //There can't be more levels than the tree has
+        if (sn == 0) return false;
+
+        if ((fn & 1) || fn == sn)
+        {
+            hash_children(p, r, r);
+
+            //Skip the levels where the node was promoted
+            if (!(fn & 1))
+            {
+                while (!(fn & 1) && fn != 0)
+                {
+                    fn >>= 1;
+                    sn >>= 1;
+                }
+            }
+        }
+        else
+        {
+            hash_children(r, p, r);
+        }
+
+        fn >>= 1;
+        sn >>= 1;
+    }
+
+    return sn == 0 && equal_digest(r, root);
+}
+
+void bkh::sha256_merkle::hash_leaf(byte const* data, u64 data_length, byte* result) noexcept
+{
+    sha256::hasher h;
+    h.init();
+    h.update(&leaf_prefix, 1);
+    h.update(data, data_length);
+    h.finalize(result);
+}
+
+void bkh::sha256_merkle::hash_children(byte const* left, byte const* right, byte* result) noexcept
+{
+    //Gather the prefix and both digests, this also allows `result` to alias them
+    byte buf[1 + 2 * sha256::digest_length];
+    buf[0] = node_prefix;
+    copy_digest(buf + 1,                         left);
+    copy_digest(buf + 1 + sha256::digest_length, right);
+
+    sha256::compute_hash(buf, sizeof(buf), result);
+}
+
+void bkh::sha256_merkle::update_path(u64 index) noexcept
+{
+    u64 node = this->leaf_capacity + index;
+    for (u64 h = 1; h <= this->height; h++)
+    {
+        node >>= 1;
+        this->update_node(node, h);
+    }
+}
+
+void bkh::sha256_merkle::update_node(u64 node, u64 h) noexcept
+{
+    byte*       out   = this->nodes + node * sha256::digest_length;
+    byte const* left  = this->nodes + (2 * node + 0) * sha256::digest_length;
+    byte const* right = this->nodes + (2 * node + 1) * sha256::digest_length;
+
+    //Check whether the right child covers any leaves
+    u64 const first = ((2 * node + 1) - (this->leaf_capacity >> (h - 1))) << (h - 1);
+    if (first >= this->leaf_count)
+    {
+        //Promote the left child
+        copy_digest(out, left);
+        return;
+    }
+
+    hash_children(left, right, out);
+}
@@ -0,0 +1,215 @@
+#ifndef BKH_SHA256_MERKLE_H
+#define BKH_SHA256_MERKLE_H
+#pragma once
+
+/** sha256_merkle.h - Bendik Hillestad - Public Domain
+ * Implements an incremental Merkle tree on top of SHA-256, which
+ * keeps the digest of a large mutable object up to date at the
+ * cost of O(log n) hashes per modified leaf.
+ *
+ * The tree follows RFC 6962 (and RFC 9162), such that the root
+ * and the inclusion proofs are interoperable with Certificate
+ * Transparency and other implementations of it:
+ *   leaf digest := SHA-256(0x00 || leaf data)
+ *   node digest := SHA-256(0x01 || left digest || right digest)
+ * where a node without a right child takes the digest of its
+ * left child, and the root of an empty tree is SHA-256("").
+ *
+ * Like the core library this performs no allocations. The nodes
+ * are stored in a flat array provided by the user, laid out as
+ * an implicit binary heap with the root at index 1 and the
+ * children of node i at 2i and 2i + 1. The leaves are thus
+ * contiguous at the end of the array, and every level is stored
+ * contiguously above them.
+ * Example:
+
+    using byte = unsigned char;
+
+    //Prepare storage for up to 4096 leaves
+    std::vector<byte> storage(sha256_merkle::storage_size(4096));
+    sha256_merkle tree;
+    tree.init(storage.data(), storage.size(), 4096);
+
+    //Add the pages
+    for (auto const& page : pages)
+        tree.append(page.data(), page.size());
+
+    //Modify one of them, which only rehashes its path
+    tree.set_leaf(17, new_page.data(), new_page.size());
+
+    //Retrieve the root digest
+    byte root[sha256::digest_length];
+    tree.get_root(root);
+
+ *
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sha256.h"
+
+namespace bkh
+{
+    struct sha256_merkle
+    {
+    public:
+        using byte = sha256::byte;
+
+        /**
+         * Describes the new contents of a single leaf.
+         */
+        struct leaf
+        {
+            u64         index;
+            byte const* data;
+            u64         length;
+        };
+
+        /**
+         * Retrieves the number of bytes of storage needed for a
+         * tree of up to `capacity` leaves. The capacity is
+         * rounded up to a power of two. Returns 0 if the
+         * capacity is too large.
+         */
+        static u64 storage_size(u64 capacity) noexcept;
+
+        /**
+         * Prepares an empty tree of up to `capacity` leaves in
+         * the provided storage, which must remain valid for as
+         * long as the tree is in use. Returns false if the
+         * storage is too small.
+         */
+        bool init(void* storage, u64 storage_length, u64 capacity) noexcept;
+
+        /**
+         * Retrieves the number of leaves in the tree.
+         */
+        u64 size() const noexcept;
+
+        /**
+         * Retrieves the maximum number of leaves in the tree.
+         */
+        u64 capacity() const noexcept;
+
+        /**
+         * Appends a leaf to the tree, hashing only the path
+         * from the new leaf to the root. Returns false if the
+         * tree is full.
+         */
+        bool append(byte const* data, u64 data_length) noexcept;
+
+        /**
+         * Same as append, but takes the digest of the leaf as
+         * computed by hash_leaf.
+         */
+        bool append_digest(byte const* leaf_digest) noexcept;
+
+        /**
+         * Replaces the contents of an existing leaf, hashing
+         * only the path from the leaf to the root. Returns
+         * false if the index is out of range.
+         */
+        bool set_leaf(u64 index, byte const* data, u64 data_length) noexcept;
+
+        /**
+         * Same as set_leaf, but takes the digest of the leaf as
+         * computed by hash_leaf.
+         */
+        bool set_leaf_digest(u64 index, byte const* leaf_digest) noexcept;
+
+        /**
+         * Replaces the contents of several existing leaves,
+         * which must be sorted by strictly increasing index.
+         * Nodes shared by the paths of several leaves are only
+         * hashed once. Returns false, without modifying the
+         * tree, if an index is out of range or the leaves are
+         * not sorted.
+         */
+        bool set_leaves(leaf const* leaves, u64 count) noexcept;
+
+        /**
+         * Retrieves the root digest of the tree. The provided
+         * pointer is expected to point to a buffer with
+         * capacity equal to or greater than the
+         * sha256::digest_length.
+         */
+        void get_root(byte* result_buffer) const noexcept;
+
+        /**
+         * Retrieves the digest of an existing leaf. Returns
+         * false if the index is out of range.
+         */
+        bool get_leaf_digest(u64 index, byte* result_buffer) const noexcept;
+
+        /**
+         * Retrieves the inclusion proof (audit path) of an
+         * existing leaf, which is a sequence of digests from
+         * the leaf towards the root. The buffer must have room
+         * for max_proof_length() digests, and the number of
+         * digests written is stored in `proof_length`. Returns
+         * false if the index is out of range.
+         */
+        bool get_proof(u64 index, byte* proof, u64* proof_length) const noexcept;
+
+        /**
+         * Retrieves the maximum number of digests in a proof.
+         */
+        u64 max_proof_length() const noexcept;
+
+        /**
+         * Checks that the proof shows the leaf digest to be at
+         * the given index of a tree of `tree_size` leaves with
+         * the given root digest.
+         */
+        static bool verify_proof(
+            byte const* leaf_digest,
+            u64         index,
+            u64         tree_size,
+            byte const* proof,
+            u64         proof_length,
+            byte const* root
+        ) noexcept;
+
+        /**
+         * Computes the digest of a leaf, SHA-256(0x00 || data).
+         */
+        static void hash_leaf(byte const* data, u64 data_length, byte* result) noexcept;
+
+        /**
+         * Computes the digest of an internal node from the
+         * digests of its children, SHA-256(0x01 || left || right).
+         */
+        static void hash_children(byte const* left, byte const* right, byte* result) noexcept;
+
+    private:
+        void update_path(u64 index) noexcept;
+        void update_node(u64 node, u64 height) noexcept;
+
+        byte* nodes;
+        u64   leaf_capacity;
+        u64   height;
+        u64   leaf_count;
+    };
+};
+
+#endif
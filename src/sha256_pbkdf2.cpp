@@ -0,0 +1,283 @@
+/** sha256_pbkdf2.cpp - Bendik Hillestad - Public Domain
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sha256_pbkdf2.h"
+
+/* Types */
+
+using byte = bkh::pbkdf2_sha256::byte;
+using word = bkh::sha256::word;
+
+using bkh::u64;
+using bkh::sha256;
+using bkh::hmac_sha256;
+using bkh::pbkdf2_sha256;
+
+/* Helpers */
+
+/**
+ * The number of words in an intermediate hash value.
+ */
+static constexpr int const state_words = sha256::digest_length / sizeof(word);
+
+/**
+ * Clears a buffer holding key material.
+ */
+static void clear_buffer(void* buffer, u64 length) noexcept
+{
+    auto* vptr = reinterpret_cast<char volatile*>(buffer);
+    for (u64 i = length; i--;)
+    {
+        *(vptr++) = 0;
+    }
+}
+
+/**
+ * Reads a big-endian word.
+ */
+static word read_be_u32(byte const* ptr) noexcept
+{
+    return (static_cast<word>(ptr[0]) << 24) | (static_cast<word>(ptr[1]) << 16)
+         | (static_cast<word>(ptr[2]) <<  8) | (static_cast<word>(ptr[3]) <<  0);
+}
+
+/**
+ * Checks that the derivation is allowed by RFC 8018.
+ */
+static bool is_valid(pbkdf2_sha256::derivation const& d) noexcept
+{
+    return d.iterations > 0 && d.result_length <= pbkdf2_sha256::max_key_length;
+}
+
+/**
+ * Stores the digest of output block `index` (counting from one)
+ * of a derivation, truncating the final block as needed.
+ */
+static void store_block(pbkdf2_sha256::derivation const& d, u64 index, byte const* digest) noexcept
+{
+    auto const offset = (index - 1) * sha256::digest_length;
+    auto const length = (d.result_length - offset < sha256::digest_length) ? d.result_length - offset : sha256::digest_length;
+
+    for (u64 i = 0; i < length; i++) d.result[offset + i] = digest[i];
+}
+
+/**
+ * Same as store_block, but for a digest stored as words.
+ */
+static void store_block_words(pbkdf2_sha256::derivation const& d, u64 index, word const* digest, int stride) noexcept
+{
+    byte bytes[sha256::digest_length];
+    for (int i = 0; i < state_words; i++)
+    {
+        word const w = digest[i * stride];
+        bytes[4 * i + 0] = static_cast<byte>(w >> 24);
+        bytes[4 * i + 1] = static_cast<byte>(w >> 16);
+        bytes[4 * i + 2] = static_cast<byte>(w >>  8);
+        bytes[4 * i + 3] = static_cast<byte>(w >>  0);
+    }
+
+    store_block(d, index, bytes);
+    clear_buffer(bytes, sizeof(bytes));
+}
+
+/* Implementation */
+
+bool bkh::pbkdf2_sha256::derive_key(byte const* password, u64 password_length, byte const* salt, u64 salt_length, u64 iterations, byte* result, u64 result_length) noexcept
+{
+    derivation const d{ password, password_length, salt, salt_length, iterations, result, result_length };
+    return derive_keys(&d, 1);
+}
+
+bool bkh::pbkdf2_sha256::derive_keys(derivation const* derivations, u64 count) noexcept
+{
+    //Refuse the whole batch if any of it is invalid
+    for (u64 i = 0; i < count; i++)
+    {
+        if (!is_valid(derivations[i])) return false;
+    }
+
+    //Tracks the output block being worked on in each lane
+    struct lane_info
+    {
+        derivation const* d;
+        u64               index;
+        u64               remaining;
+    };
+
+    int const L = sha256::get_lane_count();
+
+    //Both blocks of an iteration hold a digest followed by the fixed padding of a 96 byte message.
+    //The digest rows of one double as the state of the transform producing the other.
+    alignas(64) word inner_words[16 * sha256::max_lanes];
+    alignas(64) word outer_words[16 * sha256::max_lanes];
+    alignas(64) word inner_state[state_words * sha256::max_lanes];
+    alignas(64) word outer_state[state_words * sha256::max_lanes];
+    alignas(64) word accumulator[state_words * sha256::max_lanes];
+    lane_info        lanes[sha256::max_lanes];
+
+    //Idle lanes compute on zeros, which are never read back
+    for (int i = 0; i < state_words * L; i++)
+    {
+        inner_words[i] = 0;
+        inner_state[i] = 0;
+        outer_state[i] = 0;
+        accumulator[i] = 0;
+    }
+
+    constexpr word const bit_count = (sha256::block_length + sha256::digest_length) * 8;
+    for (int t = state_words; t < 16; t++)
+    {
+        word const w = (t == state_words) ? 0x80000000u : (t == 15) ? bit_count : 0;
+        for (int l = 0; l < L; l++)
+        {
+            inner_words[t * L + l] = w;
+            outer_words[t * L + l] = w;
+        }
+    }
+
+    //The keyed state is shared by the output blocks of a derivation
+    hmac_sha256       mac;
+    derivation const* keyed = nullptr;
+    sha256::midstate  inner, outer;
+
+    u64 next_derivation = 0;
+    u64 next_index      = 1;
+    int active          = 0;
+
+    //Helper for handing the next output block to a lane
+    auto const assign = [&](int l) noexcept
+    {
+        lanes[l].d = nullptr;
+        while (next_derivation < count)
+        {
+            //Find the next output block
+            derivation const& d = derivations[next_derivation];
+            if ((next_index - 1) * sha256::digest_length >= d.result_length)
+            {
+                next_derivation++;
+                next_index = 1;
+                continue;
+            }
+            auto const index = next_index++;
+
+            //Prepare the key
+            if (keyed != &d)
+            {
+                mac.init(d.password, d.password_length);
+                mac.get_midstates(&inner, &outer);
+                keyed = &d;
+            }
+
+            //Compute the first iteration, U1 = HMAC(P, S || INT(i))
+            byte const be_index[4] =
+            {
+                static_cast<byte>(index >> 24), static_cast<byte>(index >> 16),
+                static_cast<byte>(index >>  8), static_cast<byte>(index >>  0)
+            };
+            byte u1[sha256::digest_length];
+            sha256::hasher h;
+            mac.begin(&h);
+            h.update(d.salt, d.salt_length);
+            h.update(be_index, sizeof(be_index));
+            mac.finalize(&h, u1);
+
+            //Nothing more to do with a single iteration
+            if (d.iterations == 1)
+            {
+                store_block(d, index, u1);
+                clear_buffer(u1, sizeof(u1));
+                continue;
+            }
+
+            //Hand the remaining iterations to the lane
+            for (int i = 0; i < state_words; i++)
+            {
+                word const w = read_be_u32(u1 + 4 * i);
+                inner_words[i * L + l] = w;
+                accumulator[i * L + l] = w;
+                inner_state[i * L + l] = inner.state[i];
+                outer_state[i * L + l] = outer.state[i];
+            }
+            clear_buffer(u1, sizeof(u1));
+
+            lanes[l] = { &d, index, d.iterations - 1 };
+            active++;
+            return;
+        }
+    };
+
+    //Fill up the lanes
+    for (int l = 0; l < L; l++) assign(l);
+
+    while (active > 0)
+    {
+        //Run until the first lane is done
+        u64 steps = ~0ull;
+        for (int l = 0; l < L; l++)
+        {
+            if (lanes[l].d && lanes[l].remaining < steps) steps = lanes[l].remaining;
+        }
+
+        for (u64 s = 0; s < steps; s++)
+        {
+            //Inner hash, producing the digest rows of the outer block
+            for (int i = 0; i < state_words * L; i++) outer_words[i] = inner_state[i];
+            sha256::transform_lanes(outer_words, inner_words);
+
+            //Outer hash, producing the digest rows of the next inner block
+            for (int i = 0; i < state_words * L; i++) inner_words[i] = outer_state[i];
+            sha256::transform_lanes(inner_words, outer_words);
+
+            //Accumulate the result
+            for (int i = 0; i < state_words * L; i++) accumulator[i] ^= inner_words[i];
+        }
+
+        //Retire any finished output blocks
+        for (int l = 0; l < L; l++)
+        {
+            lane_info& lane = lanes[l];
+            if (lane.d == nullptr) continue;
+
+            lane.remaining -= steps;
+            if (lane.remaining > 0) continue;
+
+            store_block_words(*lane.d, lane.index, accumulator + l, L);
+            active--;
+            assign(l);
+        }
+    }
+
+    //Don't leave key material behind on the stack
+    mac.clear_state();
+    clear_buffer(&inner,      sizeof(inner));
+    clear_buffer(&outer,      sizeof(outer));
+    clear_buffer(inner_words, sizeof(inner_words));
+    clear_buffer(outer_words, sizeof(outer_words));
+    clear_buffer(inner_state, sizeof(inner_state));
+    clear_buffer(outer_state, sizeof(outer_state));
+    clear_buffer(accumulator, sizeof(accumulator));
+
+    return true;
+}
@@ -0,0 +1,117 @@
+#ifndef BKH_SHA256_PBKDF2_H
+#define BKH_SHA256_PBKDF2_H
+#pragma once
+
+/** sha256_pbkdf2.h - Bendik Hillestad - Public Domain
+ * Implements PBKDF2-HMAC-SHA256 as described in RFC 8018, on top
+ * of the HMAC implementation in sha256_hmac.h.
+ *
+ * Nearly all of the time goes into the iterations, where each
+ * one is two transforms of a single block: the previous digest
+ * hashed after the inner key block, and that digest hashed after
+ * the outer key block. Both of those blocks have the same fixed
+ * length, so their padding is prepared once, and the digests
+ * are passed from one transform to the next as words without
+ * ever being converted to bytes.
+ * The iterations of independent output blocks, from the same or
+ * from different derivations, are spread over the lanes of the
+ * batch backend (see sha256::transform_lanes). Each lane takes
+ * on the next output block as soon as it is done, so deriving
+ * several keys in one call is considerably faster than deriving
+ * them one at a time.
+ *
+ * Like the core library this performs no allocations.
+ * Example:
+
+    using byte = unsigned char;
+
+    //Derive a 32 byte key
+    byte key[32];
+    pbkdf2_sha256::derive_key(
+        password.data(), password.size(),
+        salt.data(),     salt.size(),
+        600000, key, sizeof(key)
+    );
+
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sha256_hmac.h"
+
+namespace bkh
+{
+    struct pbkdf2_sha256
+    {
+    public:
+        using byte = sha256::byte;
+
+        /**
+         * The largest key that can be derived, see RFC 8018.
+         */
+        static constexpr u64 const max_key_length = 0xFFFFFFFFull * sha256::digest_length;
+
+        /**
+         * Describes a single derivation of a batch, along with
+         * where to store the derived key.
+         */
+        struct derivation
+        {
+            byte const* password;
+            u64         password_length;
+            byte const* salt;
+            u64         salt_length;
+            u64         iterations;
+            byte*       result;
+            u64         result_length;
+        };
+
+        /**
+         * Derives a key of `result_length` bytes from the
+         * password and salt. Returns false, without deriving
+         * anything, if the iteration count is zero or the key
+         * is longer than max_key_length.
+         */
+        static bool derive_key(
+            byte const* password,
+            u64         password_length,
+            byte const* salt,
+            u64         salt_length,
+            u64         iterations,
+            byte*       result,
+            u64         result_length
+        ) noexcept;
+
+        /**
+         * Performs each derivation of the batch, running
+         * the iterations of all of them in parallel. Returns
+         * false, without deriving anything, if any of them
+         * is invalid as described for derive_key.
+         */
+        static bool derive_keys(derivation const* derivations, u64 count) noexcept;
+
+        pbkdf2_sha256() = delete;
+    };
+};
+
+#endif
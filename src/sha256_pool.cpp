@@ -0,0 +1,536 @@
+/** sha256_pool.cpp - Bendik Hillestad - Public Domain
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sha256_pool.h"
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <dirent.h>
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+/* Types */
+
+using message   = bkh::sha256::message;
+using params    = bkh::sha256_pool::parameters;
+using placement = bkh::sha256_pool::placement;
+using callback  = bkh::sha256_pool::callback;
+
+using bkh::u32;
+using bkh::u64;
+using bkh::sha256;
+
+/* Helpers */
+
+/**
+ * The number of short messages hashed together at most, a few
+ * times the widest batch backend so lanes are refilled rather than
+ * left idle while the longest message of the bundle finishes.
+ */
+static constexpr u32 const bundle_capacity = 4 * sha256::max_lanes;
+
+/**
+ * Ranges of more messages than this are split before hashing.
+ */
+static constexpr u64 const split_threshold = bundle_capacity;
+
+/**
+ * The number of ranges a deque holds, beyond which a worker
+ * keeps the work to itself. Splitting in halves keeps it far
+ * below this.
+ */
+static constexpr std::int64_t const deque_capacity = 1024;
+
+/**
+ * A submitted batch.
+ */
+struct batch
+{
+    message const*   messages;
+    u64              count;
+    callback         cb;
+    void*            user;
+    std::atomic<u64> remaining;
+};
+
+/**
+ * A range of messages of a batch.
+ */
+struct task
+{
+    batch* owner;
+    u64    begin;
+    u64    end;
+};
+
+/**
+ * A work-stealing deque of a fixed capacity, after Chase and Lev.
+ * The worker owning it pushes and pops at the bottom while the
+ * others steal from the top.
+ */
+struct work_deque
+{
+    struct slot
+    {
+        std::atomic<batch*> owner;
+        std::atomic<u64>    begin;
+        std::atomic<u64>    end;
+    };
+
+    alignas(64) std::atomic<std::int64_t> top{ 0 };
+    alignas(64) std::atomic<std::int64_t> bottom{ 0 };
+    alignas(64) slot                      items[deque_capacity];
+
+    /**
+     * Pushes a range, returning false if the deque is full.
+     * Only called by the owner.
+     */
+    bool push(task const& t) noexcept
+    {
+        std::int64_t const b = bottom.load(std::memory_order_relaxed);
+        std::int64_t const f = top.load(std::memory_order_acquire);
+        if (b - f >= deque_capacity) return false;
+
+        slot& s = items[b % deque_capacity];
+        s.owner.store(t.owner, std::memory_order_relaxed);
+        s.begin.store(t.begin, std::memory_order_relaxed);
+        s.end.store(t.end, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom.store(b + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    /**
+     * Pops the most recently pushed range. Only called by the
+     * owner.
+     */
+    bool pop(task* t) noexcept
+    {
+        std::int64_t const b = bottom.load(std::memory_order_relaxed) - 1;
+        bottom.store(b, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::int64_t f = top.load(std::memory_order_relaxed);
+
+        //Check if it's empty
+        if (f > b)
+        {
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return false;
+        }
+
+        read(b, t);
+
+        //The last range may be stolen meanwhile, race the thieves for it
+        if (f == b)
+        {
+            bool const won = top.compare_exchange_strong(f, f + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+            bottom.store(b + 1, std::memory_order_relaxed);
+            return won;
+        }
+
+        return true;
+    }
+
+    /**
+     * Steals the oldest range. Called by any worker.
+     */
+    bool steal(task* t) noexcept
+    {
+        std::int64_t f = top.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        std::int64_t const b = bottom.load(std::memory_order_acquire);
+        if (f >= b) return false;
+
+        read(f, t);
+        return top.compare_exchange_strong(f, f + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    }
+
+    void read(std::int64_t index, task* t) const noexcept
+    {
+        slot const& s = items[index % deque_capacity];
+        t->owner = s.owner.load(std::memory_order_relaxed);
+        t->begin = s.begin.load(std::memory_order_relaxed);
+        t->end   = s.end.load(std::memory_order_relaxed);
+    }
+};
+
+/**
+ * A worker and the order in which it tries to steal from the
+ * others.
+ */
+struct worker_info
+{
+    work_deque            work;
+    std::vector<unsigned> victims;
+    int                   cpu = -1;
+};
+
+#if defined(__linux__)
+/**
+ * Looks up the NUMA node of a processor, or -1 if unknown.
+ */
+static int node_of(int cpu)
+{
+    char path[64];
+    std::snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+
+    DIR* dir = opendir(path);
+    if (!dir) return -1;
+
+    int node = -1;
+    while (dirent* entry = readdir(dir))
+    {
+        if (std::sscanf(entry->d_name, "node%d", &node) == 1) break;
+        node = -1;
+    }
+    closedir(dir);
+
+    return node;
+}
+#endif
+
+/* Implementation */
+
+struct bkh::sha256_pool::shared
+{
+    params                         p;
+    std::unique_ptr<worker_info[]> workers;
+    std::vector<std::thread>       threads;
+
+    //New batches, before any worker has split them
+    std::mutex        inject_lock;
+    std::deque<task>  injected;
+    std::atomic<u64>  injected_count{ 0 };
+
+    //Where idle workers sleep, the epoch changes whenever there is new work
+    std::mutex              sleep_lock;
+    std::condition_variable sleep_cv;
+    std::atomic<u64>        epoch{ 0 };
+    std::atomic<unsigned>   sleepers{ 0 };
+    bool                    stopping = false;
+
+    //Where wait sleeps
+    std::mutex              done_lock;
+    std::condition_variable done_cv;
+    std::atomic<u64>        outstanding{ 0 };
+
+    /**
+     * Wakes a sleeping worker, or all of them.
+     */
+    void notify(bool all)
+    {
+        epoch.fetch_add(1);
+        if (sleepers.load() == 0) return;
+
+        //Taking the lock ensures a worker is either yet to check the epoch or already waiting
+        { std::lock_guard<std::mutex> guard{ sleep_lock }; }
+        if (all) sleep_cv.notify_all();
+        else     sleep_cv.notify_one();
+    }
+
+    /**
+     * Finds a range to hash, from the worker's own deque, then
+     * the other workers and then the new batches.
+     */
+    bool find_work(unsigned self, task* t)
+    {
+        worker_info& w = workers[self];
+        if (w.work.pop(t)) return true;
+
+        for (unsigned victim : w.victims)
+        {
+            if (workers[victim].work.steal(t)) return true;
+        }
+
+        if (injected_count.load() > 0)
+        {
+            std::lock_guard<std::mutex> guard{ inject_lock };
+            if (!injected.empty())
+            {
+                *t = injected.front();
+                injected.pop_front();
+                injected_count.fetch_sub(1);
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    /**
+     * Accounts for hashed messages, finishing the batch with the
+     * last of them.
+     */
+    void finish(batch* b, u64 count)
+    {
+        if (b->remaining.fetch_sub(count, std::memory_order_acq_rel) != count) return;
+
+        if (b->cb) b->cb(b->user, b->messages, b->count);
+        delete b;
+
+        outstanding.fetch_sub(1);
+        { std::lock_guard<std::mutex> guard{ done_lock }; }
+        done_cv.notify_all();
+    }
+
+    /**
+     * Hashes a range, pushing parts of it for others to steal.
+     */
+    void run(unsigned self, task t)
+    {
+        work_deque&          own      = workers[self].work;
+        message const* const messages = t.owner->messages;
+
+        //Split off halves until the rest is small
+        u64 begin = t.begin, end = t.end;
+        while (end - begin > split_threshold)
+        {
+            u64 const middle = begin + (end - begin) / 2;
+            if (!own.push({ t.owner, middle, end })) break;
+            notify(false);
+            end = middle;
+        }
+
+        message bundle[bundle_capacity];
+        u32     bundled = 0;
+        for (u64 i = begin; i < end; i++)
+        {
+            //Gather the short messages
+            message const& m = messages[i];
+            if (m.length <= p.small_message_size)
+            {
+                bundle[bundled++] = m;
+                if (bundled == bundle_capacity)
+                {
+                    sha256::compute_hash_batch(bundle, bundled);
+                    bundled = 0;
+                }
+                continue;
+            }
+
+            //Let others take the rest while this one is hashed
+            if (i + 1 < end && own.push({ t.owner, i + 1, end }))
+            {
+                notify(false);
+                end = i + 1;
+            }
+            sha256::compute_hash(m.data, m.length, m.result);
+        }
+        if (bundled > 0) sha256::compute_hash_batch(bundle, bundled);
+
+        finish(t.owner, end - begin);
+    }
+
+    /**
+     * The loop of every worker.
+     */
+    void work(unsigned self)
+    {
+#if defined(__linux__)
+        if (workers[self].cpu >= 0)
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(workers[self].cpu, &set);
+            pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        }
+#endif
+
+        while (true)
+        {
+            task t;
+            if (find_work(self, &t))
+            {
+                run(self, t);
+                continue;
+            }
+
+            //Announce the sleep before looking one last time, such that new work isn't missed
+            sleepers.fetch_add(1);
+            u64 const seen = epoch.load();
+            if (find_work(self, &t))
+            {
+                sleepers.fetch_sub(1);
+                run(self, t);
+                continue;
+            }
+
+            std::unique_lock<std::mutex> guard{ sleep_lock };
+            while (epoch.load() == seen && !stopping) sleep_cv.wait(guard);
+            bool const stop = stopping;
+            guard.unlock();
+            sleepers.fetch_sub(1);
+
+            //Nothing is left once stopping, as it waits for the batches first
+            if (stop) return;
+        }
+    }
+};
+
+params bkh::sha256_pool::default_parameters() noexcept
+{
+    return params{ 0, 16 * 1024, placement::any };
+}
+
+bool bkh::sha256_pool::init(parameters const& p)
+{
+    this->state = nullptr;
+
+    //Decide how many workers to use
+    unsigned threads = (p.threads > 0) ? p.threads : std::thread::hardware_concurrency();
+    if (threads < 1) threads = 1;
+
+    auto s = std::make_unique<shared>();
+    s->p       = p;
+    s->workers = std::make_unique<worker_info[]>(threads);
+
+    //Assign the processors, in the order the process may run on them
+    std::vector<int> nodes(threads, 0);
+#if defined(__linux__)
+    cpu_set_t allowed;
+    if (p.worker_placement != placement::any && sched_getaffinity(0, sizeof(allowed), &allowed) == 0)
+    {
+        std::vector<int> cpus;
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) if (CPU_ISSET(cpu, &allowed)) cpus.push_back(cpu);
+
+        for (unsigned i = 0; i < threads && !cpus.empty(); i++)
+        {
+            s->workers[i].cpu = cpus[i % cpus.size()];
+            if (p.worker_placement == placement::numa) nodes[i] = node_of(s->workers[i].cpu);
+        }
+    }
+#endif
+
+    //Steal from the next workers in turn, the ones on the same node first
+    for (unsigned i = 0; i < threads; i++)
+    {
+        for (int pass = 0; pass < 2; pass++)
+        {
+            for (unsigned j = 1; j < threads; j++)
+            {
+                unsigned const victim = (i + j) % threads;
+                if ((nodes[victim] == nodes[i]) == (pass == 0)) s->workers[i].victims.push_back(victim);
+            }
+        }
+    }
+
+    //Start the workers
+    shared* raw = s.get();
+    s->threads.reserve(threads);
+    for (unsigned i = 0; i < threads; i++)
+    {
+        try
+        {
+            s->threads.emplace_back([raw, i]() { raw->work(i); });
+        }
+        catch (std::system_error const&)
+        {
+            //Stop the ones already running, nothing has been submitted to them
+            {
+                std::lock_guard<std::mutex> guard{ s->sleep_lock };
+                s->stopping = true;
+            }
+            s->sleep_cv.notify_all();
+            for (auto& t : s->threads) t.join();
+
+            errno = EAGAIN;
+            return false;
+        }
+    }
+
+    this->state = s.release();
+    return true;
+}
+
+void bkh::sha256_pool::destroy()
+{
+    if (!this->state) return;
+
+    this->wait();
+    {
+        std::lock_guard<std::mutex> guard{ this->state->sleep_lock };
+        this->state->stopping = true;
+    }
+    this->state->sleep_cv.notify_all();
+    for (auto& t : this->state->threads) t.join();
+
+    delete this->state;
+    this->state = nullptr;
+}
+
+void bkh::sha256_pool::submit(sha256::message const* messages, u64 count, callback cb, void* user)
+{
+    if (count == 0)
+    {
+        if (cb) cb(user, messages, count);
+        return;
+    }
+
+    auto* b = new batch{ messages, count, cb, user, { count } };
+    this->state->outstanding.fetch_add(1);
+    {
+        std::lock_guard<std::mutex> guard{ this->state->inject_lock };
+        this->state->injected.push_back({ b, 0, count });
+        this->state->injected_count.fetch_add(1);
+    }
+    this->state->notify(false);
+}
+
+void bkh::sha256_pool::wait()
+{
+    std::unique_lock<std::mutex> guard{ this->state->done_lock };
+    while (this->state->outstanding.load() > 0) this->state->done_cv.wait(guard);
+}
+
+void bkh::sha256_pool::compute_hash_batch(sha256::message const* messages, u64 count)
+{
+    //Wait for this batch only
+    struct completion
+    {
+        std::atomic<bool> done{ false };
+    } c;
+
+    auto const on_done = [](void* user, sha256::message const*, u64)
+    {
+        static_cast<completion*>(user)->done.store(true);
+    };
+
+    this->submit(messages, count, on_done, &c);
+
+    std::unique_lock<std::mutex> guard{ this->state->done_lock };
+    while (!c.done.load()) this->state->done_cv.wait(guard);
+}
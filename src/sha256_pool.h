@@ -0,0 +1,143 @@
+#ifndef BKH_SHA256_POOL_H
+#define BKH_SHA256_POOL_H
+#pragma once
+
+/** sha256_pool.h - Bendik Hillestad - Public Domain
+ * Implements a pool of threads for hashing large batches of
+ * independent messages of wildly different sizes, where splitting
+ * the batch evenly between threads would leave every thread but
+ * the one that drew the largest message idle.
+ *
+ * Each worker has its own deque of ranges of messages. A worker
+ * splits the range it takes in halves, keeping one half and
+ * pushing the other, until the range is small, and idle workers
+ * steal the oldest, and thus largest, ranges of the others. Short
+ * messages are gathered into bundles that are hashed together
+ * through sha256::compute_hash_batch, such that the lanes of the
+ * batch backend are kept full. A long message is hashed from start
+ * to end by the worker that drew it, keeping its state and the
+ * data it reads local to one core, and the rest of its range is
+ * pushed first so others may take it meanwhile.
+ *
+ * Workers may be pinned to the processors the process may run
+ * on, one each, and with NUMA placement they steal from workers
+ * on the same node before those on other nodes. The nodes are
+ * read from sysfs, so this is only available on Linux.
+ *
+ * Batches are submitted from any thread and are finished in the
+ * background, with a callback invoked from a worker once every
+ * message of the batch has its result, or waited for.
+ * Example:
+
+    sha256_pool pool;
+    if (!pool.init(sha256_pool::default_parameters()))
+        return;
+
+    //Hash a batch of messages and wait for them
+    std::vector<sha256::message> messages{ ... };
+    pool.submit(messages.data(), messages.size(), nullptr, nullptr);
+    pool.wait();
+    pool.destroy();
+
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sha256.h"
+
+namespace bkh
+{
+    struct sha256_pool
+    {
+    public:
+        /**
+         * How workers are assigned to processors.
+         */
+        enum class placement : u8
+        {
+            any,    //Let the operating system schedule them
+            pinned, //Pin each worker to its own processor
+            numa    //Pin them and steal within a node first
+        };
+
+        struct parameters
+        {
+            unsigned  threads;            //Number of workers, 0 for one per core
+            u64       small_message_size; //Messages up to this length are bundled
+            placement worker_placement;   //How workers are assigned to processors
+        };
+
+        /**
+         * Invoked from a worker once every message of the batch
+         * has been hashed, or from the submitting thread if the
+         * batch is empty.
+         */
+        using callback = void(*)(void* user, sha256::message const* messages, u64 count);
+
+        /**
+         * Retrieves the default parameters, which use one
+         * worker per core, bundle messages of up to 16 KiB and
+         * leave the placement to the operating system.
+         */
+        static parameters default_parameters() noexcept;
+
+        /**
+         * Starts the workers. Returns false, with errno set to
+         * EAGAIN, if any of them could not be started, in which
+         * case the others are stopped again.
+         */
+        bool init(parameters const& params);
+
+        /**
+         * Waits for every batch to finish, then stops the
+         * workers.
+         */
+        void destroy();
+
+        /**
+         * Submits a batch of messages to be hashed in the
+         * background. The messages and their data must stay
+         * valid until the batch has finished, which is when the
+         * callback, if any, is invoked. An empty batch finishes
+         * at once, invoking the callback before returning.
+         */
+        void submit(sha256::message const* messages, u64 count, callback cb, void* user);
+
+        /**
+         * Waits until every batch submitted so far has finished.
+         */
+        void wait();
+
+        /**
+         * Hashes the batch on the pool and waits for it.
+         */
+        void compute_hash_batch(sha256::message const* messages, u64 count);
+
+    private:
+        struct shared;
+
+        shared* state;
+    };
+};
+
+#endif
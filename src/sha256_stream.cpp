@@ -0,0 +1,301 @@
+/** sha256_stream.cpp - Bendik Hillestad - Public Domain
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sha256_stream.h"
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+/* Types */
+
+using byte    = bkh::sha256_stream::byte;
+using options = bkh::sha256_stream::options;
+using source  = bkh::sha256_stream::source;
+
+using bkh::u32;
+using bkh::u64;
+using bkh::sha256;
+using bkh::sha256_stream;
+
+/* Helpers */
+
+static constexpr u64 const kib = 1024;
+
+/**
+ * The alignment of the buffers, which also keeps them a multiple
+ * of the block length.
+ */
+static constexpr u64 const page_size = 4 * kib;
+
+/**
+ * Lets the other hardware thread of the core run while polling.
+ */
+static void cpu_relax() noexcept
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+/**
+ * Where one side of the ring sleeps while waiting for the other.
+ */
+struct waiter
+{
+    std::mutex              lock;
+    std::condition_variable cv;
+    std::atomic<bool>       sleeping{ false };
+
+    /**
+     * Waits until the condition holds, polling it first.
+     */
+    template<typename Condition>
+    void wait(Condition ready, u32 spin_count)
+    {
+        for (u32 i = 0; i < spin_count; i++)
+        {
+            if (ready()) return;
+            cpu_relax();
+        }
+
+        //Announce the sleep before checking one last time, such that a wake-up can't be missed
+        std::unique_lock<std::mutex> guard{ lock };
+        sleeping.store(true);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while (!ready()) cv.wait(guard);
+        sleeping.store(false, std::memory_order_relaxed);
+    }
+
+    /**
+     * Wakes the other side if it is sleeping. Must follow the
+     * change it is waiting for.
+     */
+    void wake()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!sleeping.load(std::memory_order_relaxed)) return;
+
+        //Taking the lock ensures it is either yet to check or already waiting
+        { std::lock_guard<std::mutex> guard{ lock }; }
+        cv.notify_one();
+    }
+};
+
+/**
+ * The ring of buffers. The counters only ever grow, the buffer
+ * in use is the counter modulo the depth.
+ */
+struct ring
+{
+    alignas(64) std::atomic<u64> produced{ 0 };
+    alignas(64) std::atomic<u64> consumed{ 0 };
+
+    alignas(64) waiter reader;
+    waiter             hasher;
+
+    byte*      buffers;
+    long long* lengths; //-1 marks a failed read
+    u64        buffer_size;
+    u32        depth;
+    u32        spin_count;
+    int        error;
+};
+
+/**
+ * An aligned buffer which frees itself.
+ */
+struct aligned_buffer
+{
+    byte* data = nullptr;
+
+    bool allocate(u64 size) noexcept
+    {
+        void* p = nullptr;
+        if (posix_memalign(&p, page_size, size) != 0) return false;
+
+        data = static_cast<byte*>(p);
+        return true;
+    }
+
+    ~aligned_buffer() noexcept
+    {
+        free(data);
+    }
+};
+
+/**
+ * Reads until the buffer is full or the stream has ended.
+ */
+static long long read_full(source read, void* user, byte* buffer, u64 length)
+{
+    u64 total = 0;
+    while (total < length)
+    {
+        long long const n = read(user, buffer + total, length - total);
+        if (n < 0) return -1;
+        if (n == 0) break;
+
+        total += static_cast<u64>(n);
+    }
+
+    return static_cast<long long>(total);
+}
+
+/**
+ * Fills the ring until the stream ends or fails.
+ */
+static void produce(ring& r, source read, void* user)
+{
+    for (u64 i = 0; ; i++)
+    {
+        //Wait for a free buffer
+        r.reader.wait([&]() { return i - r.consumed.load(std::memory_order_acquire) < r.depth; }, r.spin_count);
+
+        u64 const       slot = i % r.depth;
+        long long const n    = read_full(read, user, r.buffers + slot * r.buffer_size, r.buffer_size);
+        if (n < 0) r.error = errno;
+        r.lengths[slot] = n;
+
+        //Hand it over
+        r.produced.store(i + 1, std::memory_order_release);
+        r.hasher.wake();
+
+        //A short buffer is the last one
+        if (n < 0 || static_cast<u64>(n) < r.buffer_size) return;
+    }
+}
+
+/**
+ * Reads from a file descriptor, retrying interrupted reads.
+ */
+static long long read_descriptor(void* user, byte* buffer, u64 length)
+{
+    int const fd = *static_cast<int*>(user);
+    while (true)
+    {
+        ssize_t const n = ::read(fd, buffer, length);
+        if (n >= 0 || errno != EINTR) return n;
+    }
+}
+
+/* Implementation */
+
+options bkh::sha256_stream::default_options() noexcept
+{
+    return { 256 * kib, 8, 4096 };
+}
+
+bool bkh::sha256_stream::hash_descriptor(int fd, byte* result)
+{
+    return hash_descriptor(fd, result, default_options());
+}
+
+bool bkh::sha256_stream::hash_descriptor(int fd, byte* result, options const& opts, u64* length)
+{
+#if defined(POSIX_FADV_SEQUENTIAL)
+    //Fails harmlessly on pipes and sockets
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+
+    return hash_source(read_descriptor, &fd, result, opts, length);
+}
+
+bool bkh::sha256_stream::hash_source(source read, void* user, byte* result, options const& opts, u64* length)
+{
+    if (opts.depth < 2)
+    {
+        errno = EINVAL;
+        return false;
+    }
+
+    //Allocate the buffers in one go
+    ring r;
+    r.buffer_size = (opts.buffer_size > 0) ? (opts.buffer_size + page_size - 1) / page_size * page_size : page_size;
+    r.depth       = opts.depth;
+    r.spin_count  = opts.spin_count;
+    r.error       = 0;
+
+    aligned_buffer         memory;
+    std::vector<long long> lengths(r.depth);
+    if (!memory.allocate(r.buffer_size * r.depth))
+    {
+        errno = ENOMEM;
+        return false;
+    }
+    r.buffers = memory.data;
+    r.lengths = lengths.data();
+
+    std::thread reader{ produce, std::ref(r), read, user };
+
+    sha256::hasher h;
+    h.init();
+
+    bool ok = true;
+    for (u64 i = 0; ; i++)
+    {
+        //Wait for a full buffer
+        r.hasher.wait([&]() { return r.produced.load(std::memory_order_acquire) > i; }, r.spin_count);
+
+        u64 const       slot = i % r.depth;
+        long long const n    = r.lengths[slot];
+        if (n < 0)
+        {
+            ok = false;
+            break;
+        }
+
+        //Every buffer but the last is a whole number of blocks, so nothing is copied
+        h.update(r.buffers + slot * r.buffer_size, static_cast<u64>(n));
+
+        //Hand it back
+        r.consumed.store(i + 1, std::memory_order_release);
+        r.reader.wake();
+
+        if (static_cast<u64>(n) < r.buffer_size) break;
+    }
+
+    reader.join();
+
+    if (!ok)
+    {
+        h.clear_state();
+        errno = r.error;
+        return false;
+    }
+
+    if (length) *length = h.get_length();
+    h.finalize(result);
+    return true;
+}
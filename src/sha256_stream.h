@@ -0,0 +1,122 @@
+#ifndef BKH_SHA256_STREAM_H
+#define BKH_SHA256_STREAM_H
+#pragma once
+
+/** sha256_stream.h - Bendik Hillestad - Public Domain
+ * Implements hashing of streams, such as pipes and sockets, with
+ * the reading and the hashing done on separate threads. Reading a
+ * stream and hashing it on one thread leaves the CPU idle while
+ * waiting for data and the stream idle while hashing, whereas here
+ * the latency of the reads is hidden behind the transform.
+ *
+ * A reader thread fills a ring of page aligned buffers, each one
+ * a multiple of the block length, and hands each buffer over once
+ * it is full or the stream has ended. The calling thread hashes
+ * the buffers straight from the ring, without copying, and hands
+ * them back. The ring itself is lock-free, with one producer and
+ * one consumer. When the ring is full the reader stops reading,
+ * which pushes back on the writer of the stream, and when it is
+ * empty the hasher waits. Either side polls the ring a number of
+ * times before going to sleep, trading CPU time for latency.
+ *
+ * The stream can be a file descriptor or any function which reads
+ * from one, such as one wrapping a TLS connection. The ring is
+ * allocated for each stream and the reader thread started for it,
+ * so for many short streams sha256_file is the cheaper choice.
+ * Example:
+
+    using byte = unsigned char;
+
+    byte digest[sha256::digest_length];
+    if (!sha256_stream::hash_descriptor(STDIN_FILENO, digest))
+        perror("stdin");
+
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sha256.h"
+
+namespace bkh
+{
+    struct sha256_stream
+    {
+    public:
+        using byte = sha256::byte;
+
+        /**
+         * Reads up to `length` bytes of the stream into the
+         * buffer. Returns the number of bytes read, 0 at the end
+         * of the stream, or -1 with errno set on an error. It is
+         * called from the reader thread only.
+         */
+        using source = long long(*)(void* user, byte* buffer, u64 length);
+
+        /**
+         * How to size the ring and how to wait on it.
+         */
+        struct options
+        {
+            u64 buffer_size; //Size of each buffer, rounded up to a multiple of the page size
+            u32 depth;       //Number of buffers in the ring, at least 2
+            u32 spin_count;  //Times to poll a full or empty ring before sleeping, 0 to sleep at once
+        };
+
+        /**
+         * Retrieves the default options, which use a ring of 8
+         * buffers of 256 KiB and poll it 4096 times before
+         * sleeping.
+         */
+        static options default_options() noexcept;
+
+        /**
+         * Computes the SHA-256 hash of everything from the
+         * current position of the file descriptor to its end,
+         * using the default options. Returns false, with errno
+         * set, if it could not be read. The descriptor is left
+         * open.
+         */
+        static bool hash_descriptor(int fd, byte* result);
+
+        /**
+         * Same as above, using the given options. Returns false
+         * with errno set to EINVAL if the depth is less than 2.
+         * If `length` is given it receives the number of bytes
+         * hashed.
+         */
+        static bool hash_descriptor(int fd, byte* result, options const& opts, u64* length = nullptr);
+
+        /**
+         * Computes the SHA-256 hash of everything the source
+         * returns until it reaches the end of the stream. Returns
+         * false, with the errno of the source, if it failed. If
+         * `length` is given it receives the number of bytes
+         * hashed.
+         */
+        static bool hash_source(source read, void* user, byte* result, options const& opts, u64* length = nullptr);
+
+        sha256_stream() = delete;
+    };
+};
+
+#endif
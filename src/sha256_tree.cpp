@@ -0,0 +1,176 @@
+/** sha256_tree.cpp - Bendik Hillestad - Public Domain
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sha256_tree.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+/* Types */
+
+using byte   = bkh::sha256_tree::byte;
+using params = bkh::sha256_tree::parameters;
+
+using bkh::u64;
+using bkh::sha256;
+
+/* Helpers */
+
+/**
+ * The node types stored in the first byte of the header.
+ */
+static constexpr byte const leaf_node     = 0x00;
+static constexpr byte const internal_node = 0x01;
+
+/**
+ * Builds the header block that prefixes every node.
+ */
+static void make_header(byte* header, byte type, params const& p) noexcept
+{
+    //Start from all zeroes
+    for (int i = 0; i < sha256::block_length; i++) header[i] = 0;
+
+    //Write the node type
+    header[0] = type;
+
+    //Write the shape of the tree in big-endian order
+    for (int i = 0; i < 8; i++)
+    {
+        header[ 8 + i] = static_cast<byte>(p.leaf_size >> (56 - 8 * i));
+        header[16 + i] = static_cast<byte>(p.fanout    >> (56 - 8 * i));
+    }
+}
+
+/**
+ * Computes the midstate after the header block of a node, so
+ * the header is only hashed once for every node of that type.
+ */
+static sha256::midstate header_midstate(byte type, params const& p) noexcept
+{
+    byte header[sha256::block_length];
+    make_header(header, type, p);
+
+    sha256::hasher   h;
+    sha256::midstate m;
+    h.init();
+    h.update(header, sha256::block_length);
+    h.save_midstate(&m);
+
+    return m;
+}
+
+/**
+ * Hashes the data following an already hashed header block.
+ */
+static void hash_with_header(sha256::midstate const& header, byte const* data, u64 data_length, byte* result) noexcept
+{
+    sha256::hasher h;
+    h.init(header);
+    h.update(data, data_length);
+    h.finalize(result);
+}
+
+/* Implementation */
+
+bkh::sha256_tree::parameters bkh::sha256_tree::default_parameters() noexcept
+{
+    return parameters{ default_leaf_size, default_fanout, 0 };
+}
+
+void bkh::sha256_tree::hash_leaf(byte const* data, u64 data_length, parameters const& p, byte* result) noexcept
+{
+    hash_with_header(header_midstate(leaf_node, p), data, data_length, result);
+}
+
+void bkh::sha256_tree::hash_node(byte const* children, u64 child_count, parameters const& p, byte* result) noexcept
+{
+    hash_with_header(header_midstate(internal_node, p), children, child_count * sha256::digest_length, result);
+}
+
+void bkh::sha256_tree::compute_hash(byte const* data, u64 data_length, byte* result)
+{
+    compute_hash(data, data_length, result, default_parameters());
+}
+
+bool bkh::sha256_tree::compute_hash(byte const* data, u64 data_length, byte* result, parameters const& p)
+{
+    //Validate the parameters
+    if (p.leaf_size < 1 || p.fanout < 2) return false;
+
+    //Calculate the number of leaves, there's always at least one
+    u64 const leaves = (data_length > 0) ? (data_length - 1) / p.leaf_size + 1 : 1;
+
+    //Decide how many threads to use
+    unsigned threads = (p.threads > 0) ? p.threads : std::thread::hardware_concurrency();
+    if (threads < 1)      threads = 1;
+    if (threads > leaves) threads = static_cast<unsigned>(leaves);
+
+    //Hash the headers once, they are shared by every node of the same type
+    sha256::midstate const leaf_header = header_midstate(leaf_node,     p);
+    sha256::midstate const node_header = header_midstate(internal_node, p);
+
+    //Hash the leaves, handing them out one at a time
+    std::vector<byte>     level(leaves * sha256::digest_length);
+    std::atomic<u64>      next_leaf{ 0 };
+    auto const worker = [&]()
+    {
+        for (u64 i = next_leaf++; i < leaves; i = next_leaf++)
+        {
+            u64 const offset = i * p.leaf_size;
+            u64 const length = (data_length - offset < p.leaf_size) ? data_length - offset : p.leaf_size;
+            hash_with_header(leaf_header, data + offset, length, level.data() + i * sha256::digest_length);
+        }
+    };
+
+    //The calling thread does its share of the work
+    std::vector<std::thread> pool;
+    pool.reserve(threads - 1);
+    for (unsigned i = 1; i < threads; i++) pool.emplace_back(worker);
+    worker();
+    for (auto& t : pool) t.join();
+
+    //Reduce the levels until only the root remains, these are comparatively tiny
+    u64 count = leaves;
+    while (count > 1)
+    {
+        u64 const nodes = (count - 1) / p.fanout + 1;
+        for (u64 i = 0; i < nodes; i++)
+        {
+            u64 const first    = i * p.fanout;
+            u64 const children = (count - first < p.fanout) ? count - first : p.fanout;
+
+            //The node is written over digests that have already been consumed
+            byte digest[sha256::digest_length];
+            hash_with_header(node_header, level.data() + first * sha256::digest_length, children * sha256::digest_length, digest);
+            for (int j = 0; j < sha256::digest_length; j++) level[i * sha256::digest_length + j] = digest[j];
+        }
+        count = nodes;
+    }
+
+    //Retrieve the root
+    for (int j = 0; j < sha256::digest_length; j++) result[j] = level[j];
+    return true;
+}
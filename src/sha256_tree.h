@@ -0,0 +1,158 @@
+#ifndef BKH_SHA256_TREE_H
+#define BKH_SHA256_TREE_H
+#pragma once
+
+/** sha256_tree.h - Bendik Hillestad - Public Domain
+ * Implements an opt-in tree hashing mode on top of SHA-256, which
+ * allows a single large message to be hashed using every core.
+ *
+ * The leaves are hashed on std::thread workers into an array of
+ * leaf digests, which is allocated for each message. Note that the
+ * resulting root digest is NOT the SHA-256 digest of the message.
+ *
+ * Format:
+ * The message is split into leaves of `leaf_size` bytes, the last
+ * of which may be shorter. An empty message has a single empty
+ * leaf. Every node of the tree is hashed with SHA-256 prefixed by
+ * a 64-byte header block:
+
+    offset  size  contents
+         0     1  node type, 0x00 for leaves and 0x01 for internal nodes
+         1     7  zero
+         8     8  leaf_size, big-endian
+        16     8  fanout, big-endian
+        24    40  zero
+
+ * The digest of a leaf is SHA-256(header || leaf bytes). The
+ * digest of an internal node is SHA-256(header || child digests)
+ * where the children are concatenated in order. The digests of
+ * one level are grouped into runs of `fanout` consecutive
+ * digests, the last of which may be shorter, and each run forms
+ * a node of the next level. This is repeated until a single
+ * digest remains, which is the root. A message with a single
+ * leaf thus has the digest of that leaf as its root.
+ *
+ * The header being a full block keeps the leaf data block
+ * aligned, so it is transformed straight from the message, and
+ * allows the hashed header to be reused through a midstate.
+ *
+ * Example:
+
+    using byte = unsigned char;
+
+    //Some large data
+    std::vector<byte> vec{ ... };
+
+    //Compute the root digest using every core
+    byte root[sha256::digest_length];
+    sha256_tree::compute_hash(vec.data(), vec.size(), root);
+
+ *
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sha256.h"
+
+namespace bkh
+{
+    struct sha256_tree
+    {
+        static constexpr u64 const default_leaf_size = 1024 * 1024;
+        static constexpr u64 const default_fanout    = 16;
+
+        using byte = sha256::byte;
+
+        /**
+         * The shape of the tree and how to compute it. Both
+         * leaf_size and fanout are part of the format, so the
+         * same values must be used to reproduce a root.
+         */
+        struct parameters
+        {
+            u64      leaf_size; //Size of each leaf in bytes, at least 1
+            u64      fanout;    //Children per internal node, at least 2
+            unsigned threads;   //Number of threads, 0 for one per core
+        };
+
+        /**
+         * Retrieves the default parameters, which use 1 MiB
+         * leaves, a fanout of 16 and one thread per core.
+         */
+        static parameters default_parameters() noexcept;
+
+        /**
+         * Computes the root digest of the message using the
+         * default parameters. The result is written to the
+         * provided `result` pointer, which is expected to point
+         * to a buffer with a capacity equal to or greater than
+         * the sha256::digest_length.
+         */
+        static void compute_hash(
+            byte const* data,
+            u64         data_length,
+            byte*       result
+        );
+
+        /**
+         * Computes the root digest of the message using the
+         * given parameters. The leaves are hashed in parallel
+         * on `params.threads` threads. Returns false, without
+         * writing the result, if the parameters are invalid.
+         */
+        static bool compute_hash(
+            byte const*       data,
+            u64               data_length,
+            byte*             result,
+            parameters const& params
+        );
+
+        /**
+         * Computes the digest of a single leaf, which must be at
+         * most `params.leaf_size` bytes long.
+         */
+        static void hash_leaf(
+            byte const*       data,
+            u64               data_length,
+            parameters const& params,
+            byte*             result
+        ) noexcept;
+
+        /**
+         * Computes the digest of an internal node from the
+         * digests of its children, which are stored back to back
+         * in `children`. There must be between 1 and
+         * `params.fanout` children.
+         */
+        static void hash_node(
+            byte const*       children,
+            u64               child_count,
+            parameters const& params,
+            byte*             result
+        ) noexcept;
+
+        sha256_tree() = delete;
+    };
+};
+
+#endif
@@ -0,0 +1,863 @@
+/** sha256_uring.cpp - Bendik Hillestad - Public Domain
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sha256_uring.h"
+#include "sha256_file.h"
+
+#include <cerrno>
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+/* Types */
+
+using byte     = bkh::sha256_uring::byte;
+using callback = bkh::sha256_uring::callback;
+using options  = bkh::sha256_uring::options;
+
+using bkh::u8;
+using bkh::u32;
+using bkh::u64;
+using bkh::sha256;
+using bkh::sha256_file;
+using bkh::sha256_uring;
+
+/* Helpers */
+
+static constexpr u32 const kib = 1024;
+
+/**
+ * The alignment of the buffers and of their size, which also
+ * satisfies O_DIRECT on every common device.
+ */
+static constexpr u32 const buffer_alignment = 4 * kib;
+
+/**
+ * The largest ring the kernel accepts.
+ */
+static constexpr u32 const max_entries = 32768;
+
+/**
+ * The largest number of buffers the kernel can register.
+ */
+static constexpr u32 const max_buffers = 16384;
+
+/**
+ * Marks the user data of an open, which carries the index of its
+ * slot. The user data of a read is the index of its buffer.
+ */
+static constexpr u64 const open_tag = 1ull << 63;
+
+/**
+ * The flags the files are opened with.
+ */
+static int open_flags(bool direct) noexcept
+{
+    return O_RDONLY | O_CLOEXEC | (direct ? O_DIRECT : 0);
+}
+
+/**
+ * Opens a file synchronously, retrying without O_DIRECT if the
+ * file system does not support it. Returns the descriptor, or the
+ * negated errno like the ring does.
+ */
+static int open_file(char const* path, bool direct) noexcept
+{
+    int fd = ::open(path, open_flags(direct));
+    if (fd < 0 && direct && errno == EINVAL) fd = ::open(path, open_flags(false));
+
+    return (fd < 0) ? -errno : fd;
+}
+
+/**
+ * Wrappers for the system calls, which have no libc functions.
+ */
+static int uring_setup(u32 entries, io_uring_params* params) noexcept
+{
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int uring_enter(int fd, u32 to_submit, u32 min_complete, u32 flags) noexcept
+{
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+static int uring_register(int fd, u32 opcode, void const* arg, u32 count) noexcept
+{
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+/**
+ * The submission and completion queues, mapped from the kernel.
+ */
+struct ring
+{
+    int fd = -1;
+
+    //Submission queue
+    void*         sq_map      = nullptr;
+    u64           sq_map_size = 0;
+    u32*          sq_tail     = nullptr;
+    u32*          sq_array    = nullptr;
+    u32           sq_mask     = 0;
+    u32           sq_local    = 0; //Tail including the entries not yet published
+    u32           queued      = 0; //Entries not yet submitted
+    io_uring_sqe* sqes        = nullptr;
+    u64           sqes_size   = 0;
+
+    //Completion queue
+    void*         cq_map      = nullptr;
+    u64           cq_map_size = 0;
+    u32*          cq_head     = nullptr;
+    u32*          cq_tail     = nullptr;
+    u32           cq_mask     = 0;
+    io_uring_cqe* cqes        = nullptr;
+
+    /**
+     * Sets up a ring with room for at least `entries` requests
+     * in flight. Returns false, with errno set, on failure.
+     */
+    bool init(u32 entries) noexcept
+    {
+        io_uring_params params{};
+        this->fd = uring_setup(entries, &params);
+        if (this->fd < 0) return false;
+
+        //Map the queues, which share one mapping on newer kernels
+        this->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(u32);
+        this->cq_map_size = params.cq_off.cqes  + params.cq_entries * sizeof(io_uring_cqe);
+        bool const single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+        if (single && this->cq_map_size > this->sq_map_size) this->sq_map_size = this->cq_map_size;
+
+        this->sq_map = mmap(nullptr, this->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_SQ_RING);
+        if (this->sq_map == MAP_FAILED) return this->sq_map = nullptr, false;
+
+        if (single)
+        {
+            this->cq_map = this->sq_map;
+        }
+        else
+        {
+            this->cq_map = mmap(nullptr, this->cq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_CQ_RING);
+            if (this->cq_map == MAP_FAILED) return this->cq_map = nullptr, false;
+        }
+
+        this->sqes_size = params.sq_entries * sizeof(io_uring_sqe);
+        void* sqes = mmap(nullptr, this->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->fd, IORING_OFF_SQES);
+        if (sqes == MAP_FAILED) return false;
+
+        //Locate the fields
+        byte* sq = static_cast<byte*>(this->sq_map);
+        byte* cq = static_cast<byte*>(this->cq_map);
+        this->sq_tail  = reinterpret_cast<u32*>(sq + params.sq_off.tail);
+        this->sq_array = reinterpret_cast<u32*>(sq + params.sq_off.array);
+        this->sq_mask  = *reinterpret_cast<u32*>(sq + params.sq_off.ring_mask);
+        this->sq_local = *this->sq_tail;
+        this->sqes     = static_cast<io_uring_sqe*>(sqes);
+        this->cq_head  = reinterpret_cast<u32*>(cq + params.cq_off.head);
+        this->cq_tail  = reinterpret_cast<u32*>(cq + params.cq_off.tail);
+        this->cq_mask  = *reinterpret_cast<u32*>(cq + params.cq_off.ring_mask);
+        this->cqes     = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+        return true;
+    }
+
+    ~ring() noexcept
+    {
+        if (this->sqes)                                   munmap(this->sqes,   this->sqes_size);
+        if (this->cq_map && this->cq_map != this->sq_map) munmap(this->cq_map, this->cq_map_size);
+        if (this->sq_map)                                 munmap(this->sq_map, this->sq_map_size);
+        if (this->fd >= 0)                                ::close(this->fd);
+    }
+
+    /**
+     * Retrieves a cleared entry to fill in. The caller keeps the
+     * number of requests in flight within the size of the ring,
+     * so there is always room.
+     */
+    io_uring_sqe* next_sqe() noexcept
+    {
+        u32 const index = this->sq_local & this->sq_mask;
+        io_uring_sqe* sqe = this->sqes + index;
+        *sqe = io_uring_sqe{};
+
+        this->sq_array[index] = index;
+        this->sq_local++;
+        this->queued++;
+        return sqe;
+    }
+
+    /**
+     * Publishes and submits the queued entries, then waits until
+     * at least `wait` completions are available. Returns false,
+     * with errno set, on failure.
+     */
+    bool submit_and_wait(u32 wait) noexcept
+    {
+        __atomic_store_n(this->sq_tail, this->sq_local, __ATOMIC_RELEASE);
+        for (;;)
+        {
+            int const n = uring_enter(this->fd, this->queued, wait, IORING_ENTER_GETEVENTS);
+            if (n >= 0)
+            {
+                this->queued -= static_cast<u32>(n);
+                if (this->queued == 0) return true;
+                continue;
+            }
+
+            //Out of resources, wait for completions before submitting more
+            if (errno == EAGAIN || errno == EBUSY)
+            {
+                if (uring_enter(this->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR) return false;
+                return true;
+            }
+            if (errno != EINTR) return false;
+        }
+    }
+
+    /**
+     * Checks whether the kernel supports the operation.
+     */
+    bool supports(u8 op) noexcept
+    {
+        constexpr u32 const op_count = 256;
+        u64 const size = sizeof(io_uring_probe) + op_count * sizeof(io_uring_probe_op);
+        auto* probe = static_cast<io_uring_probe*>(std::calloc(1, size));
+        if (!probe) return false;
+
+        bool const result = uring_register(this->fd, IORING_REGISTER_PROBE, probe, op_count) >= 0
+                         && op <= probe->last_op
+                         && (probe->ops[op].flags & IO_URING_OP_SUPPORTED);
+
+        std::free(probe);
+        return result;
+    }
+};
+
+/**
+ * A read buffer, and the read it is used for.
+ */
+struct buffer
+{
+    byte* data;
+    iovec iov;    //For readv, when the buffers could not be registered
+    u64   offset; //The offset of the read in the file
+    u32   length; //The number of bytes requested
+    u32   filled; //The number of bytes read so far
+    u32   slot;   //The file the read belongs to
+    bool  ready;  //Whether the read is complete
+};
+
+/**
+ * The states of a slot.
+ */
+enum class slot_state : u8
+{
+    free,    //Available for the next file
+    opening, //Waiting for the file to be opened
+    reading, //Reading and hashing the file
+    batched  //Waiting to be hashed by compute_hash_batch
+};
+
+/**
+ * A file being opened or read.
+ */
+struct slot
+{
+    sha256::hasher hasher;
+    byte           digest[sha256::digest_length];
+    u64            index;      //The index of the path
+    u64            size;       //The size of the file when it was opened
+    u64            issued;     //The end of the reads issued so far
+    u64            hashed;     //The number of bytes hashed so far
+    int            fd;
+    int            error;
+    u32            in_flight;  //Reads not yet complete
+    u32            fifo_head;  //The buffers of the file in the order of their offset
+    u32            fifo_count;
+    slot_state     state;
+};
+
+/**
+ * Drives the ring until every file has been hashed.
+ */
+struct scanner
+{
+    ring               uring;
+    options            opts;
+    bool               fixed;      //Whether the buffers are registered
+    bool               async_open; //Whether the ring can open files
+    bool               leak;       //Whether the kernel may still write to the buffers
+
+    char const* const* paths;
+    u64                count;
+    u64                next_path;
+    callback           on_file;
+    void*              user;
+
+    void*              memory;
+    buffer*            buffers;
+    u32*               free_buffers;
+    u32                free_buffer_count;
+    slot*              slots;
+    u32*               fifos;
+    u32*               free_slots;
+    u32                free_slot_count;
+    sha256::message*   batch;
+    u32*               batch_buffers;
+    u32                batch_count;
+    u32                in_flight;  //Requests submitted or queued, not yet complete
+    u32                cursor;     //Where the next round of reads starts
+
+    ~scanner() noexcept
+    {
+        //Close the files of an aborted scan
+        if (this->slots)
+        {
+            for (u32 i = 0; i < this->opts.max_open_files; i++)
+            {
+                if (this->slots[i].state != slot_state::free && this->slots[i].fd >= 0) ::close(this->slots[i].fd);
+            }
+        }
+
+        if (!this->leak) std::free(this->memory);
+        std::free(this->buffers);
+        std::free(this->free_buffers);
+        std::free(this->slots);
+        std::free(this->fifos);
+        std::free(this->free_slots);
+        std::free(this->batch);
+        std::free(this->batch_buffers);
+    }
+
+    /**
+     * Allocates everything. Returns false, with errno set, on
+     * failure.
+     */
+    bool allocate() noexcept
+    {
+        u32 const depth = this->opts.queue_depth;
+        u32 const files = this->opts.max_open_files;
+        if (posix_memalign(&this->memory, buffer_alignment, u64{ depth } * this->opts.buffer_size) != 0)
+        {
+            this->memory = nullptr;
+            errno        = ENOMEM;
+            return false;
+        }
+
+        this->buffers       = static_cast<buffer*>(std::calloc(depth, sizeof(buffer)));
+        this->free_buffers  = static_cast<u32*>(std::calloc(depth, sizeof(u32)));
+        this->slots         = static_cast<slot*>(std::calloc(files, sizeof(slot)));
+        this->fifos         = static_cast<u32*>(std::calloc(u64{ files } * this->opts.reads_per_file, sizeof(u32)));
+        this->free_slots    = static_cast<u32*>(std::calloc(files, sizeof(u32)));
+        this->batch         = static_cast<sha256::message*>(std::calloc(depth, sizeof(sha256::message)));
+        this->batch_buffers = static_cast<u32*>(std::calloc(depth, sizeof(u32)));
+        if (!this->buffers || !this->free_buffers || !this->slots || !this->fifos
+            || !this->free_slots || !this->batch || !this->batch_buffers)
+        {
+            errno = ENOMEM;
+            return false;
+        }
+
+        //Everything starts out free, handed out from the front
+        byte* const base = static_cast<byte*>(this->memory);
+        for (u32 i = 0; i < depth; i++)
+        {
+            this->buffers[i].data = base + u64{ i } * this->opts.buffer_size;
+            this->free_buffers[i] = depth - 1 - i;
+        }
+        for (u32 i = 0; i < files; i++) this->free_slots[i] = files - 1 - i;
+
+        this->free_buffer_count = depth;
+        this->free_slot_count   = files;
+        return true;
+    }
+
+    /**
+     * Registers the buffers with the kernel, which saves pinning
+     * and mapping the pages on every read. This is limited by
+     * RLIMIT_MEMLOCK on older kernels, so failing is not fatal.
+     */
+    void register_buffers() noexcept
+    {
+        u32 const depth = this->opts.queue_depth;
+        auto* iovs = static_cast<iovec*>(std::calloc(depth, sizeof(iovec)));
+        if (!iovs) return;
+
+        for (u32 i = 0; i < depth; i++)
+        {
+            iovs[i].iov_base = this->buffers[i].data;
+            iovs[i].iov_len  = this->opts.buffer_size;
+        }
+
+        this->fixed = uring_register(this->uring.fd, IORING_REGISTER_BUFFERS, iovs, depth) >= 0;
+        std::free(iovs);
+    }
+
+    /**
+     * Reports the result of a file and frees its slot.
+     */
+    void finish(u32 s, int error) noexcept
+    {
+        slot& f = this->slots[s];
+        this->on_file(this->user, f.index, error, error ? nullptr : f.digest);
+
+        if (f.fd >= 0) ::close(f.fd);
+        f.fd    = -1;
+        f.state = slot_state::free;
+        this->free_slots[this->free_slot_count++] = s;
+    }
+
+    /**
+     * Starts opening the next file in a free slot.
+     */
+    void start_file(u32 s) noexcept
+    {
+        slot& f = this->slots[s];
+        f.index      = this->next_path++;
+        f.size       = 0;
+        f.issued     = 0;
+        f.hashed     = 0;
+        f.fd         = -1;
+        f.error      = 0;
+        f.in_flight  = 0;
+        f.fifo_head  = 0;
+        f.fifo_count = 0;
+        f.state      = slot_state::opening;
+
+        if (!this->async_open)
+        {
+            this->file_opened(s, open_file(this->paths[f.index], this->opts.direct));
+            return;
+        }
+
+        io_uring_sqe* sqe = this->uring.next_sqe();
+        sqe->opcode     = IORING_OP_OPENAT;
+        sqe->fd         = AT_FDCWD;
+        sqe->addr       = reinterpret_cast<u64>(this->paths[f.index]);
+        sqe->open_flags = static_cast<u32>(open_flags(this->opts.direct));
+        sqe->user_data  = open_tag | s;
+        this->in_flight++;
+    }
+
+    /**
+     * Handles the result of opening a file.
+     */
+    void file_opened(u32 s, int result) noexcept
+    {
+        slot& f = this->slots[s];
+
+        //Retry without O_DIRECT where the file system lacks it
+        if (result == -EINVAL && this->opts.direct) result = open_file(this->paths[f.index], false);
+        if (result < 0) return this->finish(s, -result);
+        f.fd = result;
+
+        struct stat info;
+        if (fstat(f.fd, &info) != 0) return this->finish(s, errno);
+        if (S_ISDIR(info.st_mode))   return this->finish(s, EISDIR);
+
+        //Pipes and devices have no size to read up to
+        if (!S_ISREG(info.st_mode))
+        {
+            sha256_file::options o = sha256_file::default_options();
+            if (!sha256_file::hash_descriptor(f.fd, f.digest, o)) return this->finish(s, errno);
+
+            return this->finish(s, 0);
+        }
+
+        if (info.st_size == 0)
+        {
+            sha256::compute_hash(nullptr, 0, f.digest);
+            return this->finish(s, 0);
+        }
+
+        f.size  = static_cast<u64>(info.st_size);
+        f.state = slot_state::reading;
+        f.hasher.init();
+    }
+
+    /**
+     * Queues a read into the buffer, continuing from what it holds.
+     */
+    void queue_read(u32 b) noexcept
+    {
+        buffer& r = this->buffers[b];
+        slot&   f = this->slots[r.slot];
+
+        io_uring_sqe* sqe = this->uring.next_sqe();
+        sqe->fd        = f.fd;
+        sqe->off       = r.offset + r.filled;
+        sqe->user_data = b;
+        if (this->fixed)
+        {
+            sqe->opcode    = IORING_OP_READ_FIXED;
+            sqe->addr      = reinterpret_cast<u64>(r.data + r.filled);
+            sqe->len       = r.length - r.filled;
+            sqe->buf_index = static_cast<decltype(sqe->buf_index)>(b);
+        }
+        else
+        {
+            r.iov.iov_base = r.data + r.filled;
+            r.iov.iov_len  = r.length - r.filled;
+            sqe->opcode    = IORING_OP_READV;
+            sqe->addr      = reinterpret_cast<u64>(&r.iov);
+            sqe->len       = 1;
+        }
+
+        f.in_flight++;
+        this->in_flight++;
+    }
+
+    /**
+     * Issues the next read of a file, if it has any left and
+     * there is a buffer for it. Returns whether it did.
+     */
+    bool issue_read(u32 s) noexcept
+    {
+        slot& f = this->slots[s];
+        if (f.state != slot_state::reading || f.error != 0)       return false;
+        if (f.issued >= f.size || this->free_buffer_count == 0)   return false;
+        if (f.fifo_count >= this->opts.reads_per_file)            return false;
+
+        //Round the length up so that it stays valid for O_DIRECT
+        u64 const remaining = f.size - f.issued;
+        u64 const rounded   = (remaining + buffer_alignment - 1) / buffer_alignment * buffer_alignment;
+        u32 const length    = (rounded < this->opts.buffer_size) ? static_cast<u32>(rounded) : this->opts.buffer_size;
+
+        u32 const b = this->free_buffers[--this->free_buffer_count];
+        buffer& r = this->buffers[b];
+        r.offset = f.issued;
+        r.length = length;
+        r.filled = 0;
+        r.slot   = s;
+        r.ready  = false;
+
+        u32* fifo = this->fifos + u64{ s } * this->opts.reads_per_file;
+        fifo[(f.fifo_head + f.fifo_count++) % this->opts.reads_per_file] = b;
+        f.issued = (length < remaining) ? f.issued + length : f.size;
+
+        this->queue_read(b);
+        return true;
+    }
+
+    /**
+     * Spreads the free buffers over the files being read, one read
+     * per file per round, starting where the last call left off.
+     */
+    void issue_reads() noexcept
+    {
+        u32 const files = this->opts.max_open_files;
+        for (bool progress = true; progress && this->free_buffer_count > 0; )
+        {
+            progress = false;
+            for (u32 i = 0; i < files && this->free_buffer_count > 0; i++)
+            {
+                u32 const s = (this->cursor + i) % files;
+                progress |= this->issue_read(s);
+            }
+            this->cursor = (this->cursor + 1) % files;
+        }
+    }
+
+    /**
+     * Returns a buffer to the pool.
+     */
+    void release(u32 b) noexcept
+    {
+        this->free_buffers[this->free_buffer_count++] = b;
+    }
+
+    /**
+     * Hashes the completed buffers of a file in the order of their
+     * offset, and finishes it when everything has been hashed.
+     */
+    void advance(u32 s) noexcept
+    {
+        slot& f    = this->slots[s];
+        u32*  fifo = this->fifos + u64{ s } * this->opts.reads_per_file;
+        while (f.fifo_count > 0)
+        {
+            u32 const b = fifo[f.fifo_head];
+            buffer&   r = this->buffers[b];
+            if (!r.ready) break;
+
+            f.fifo_head = (f.fifo_head + 1) % this->opts.reads_per_file;
+            f.fifo_count--;
+
+            if (f.error == 0)
+            {
+                //Files held by a single buffer are hashed side by side
+                if (r.offset == 0 && r.filled == f.size)
+                {
+                    sha256::message& m = this->batch[this->batch_count];
+                    m.data   = r.data;
+                    m.length = r.filled;
+                    m.result = f.digest;
+
+                    this->batch_buffers[this->batch_count++] = b;
+                    f.state = slot_state::batched;
+                    continue;
+                }
+
+                f.hasher.update(r.data, r.filled);
+                f.hashed += r.filled;
+            }
+
+            this->release(b);
+        }
+
+        //Wait for the reads still in flight before giving up the slot
+        if (f.state != slot_state::reading || f.fifo_count > 0) return;
+        if (f.error != 0) return this->finish(s, f.error);
+        if (f.hashed == f.size)
+        {
+            f.hasher.finalize(f.digest);
+            this->finish(s, 0);
+        }
+    }
+
+    /**
+     * Handles the result of a read.
+     */
+    void read_done(u32 b, int result) noexcept
+    {
+        buffer& r = this->buffers[b];
+        slot&   f = this->slots[r.slot];
+        f.in_flight--;
+
+        if (result == -EINTR || result == -EAGAIN)
+        {
+            return this->queue_read(b);
+        }
+        if (result < 0)
+        {
+            if (f.error == 0) f.error = -result;
+            r.ready = true;
+            return this->advance(r.slot);
+        }
+
+        //Anything past the size the file had when opened is ignored
+        r.filled += static_cast<u32>(result);
+        u64 const wanted = (f.size - r.offset < r.length) ? f.size - r.offset : r.length;
+        if (r.filled >= wanted)
+        {
+            r.filled = static_cast<u32>(wanted);
+            r.ready  = true;
+        }
+        else if (result == 0)
+        {
+            //The file was truncated while being read
+            if (f.error == 0) f.error = EIO;
+            r.ready = true;
+        }
+        else
+        {
+            return this->queue_read(b);
+        }
+
+        this->advance(r.slot);
+    }
+
+    /**
+     * Hashes the files collected for the batch.
+     */
+    void flush_batch() noexcept
+    {
+        if (this->batch_count == 0) return;
+        sha256::compute_hash_batch(this->batch, this->batch_count);
+
+        for (u32 i = 0; i < this->batch_count; i++)
+        {
+            buffer const& r = this->buffers[this->batch_buffers[i]];
+            u32 const     s = r.slot;
+
+            this->release(this->batch_buffers[i]);
+            this->finish(s, 0);
+        }
+
+        this->batch_count = 0;
+    }
+
+    /**
+     * Handles every available completion.
+     */
+    void reap() noexcept
+    {
+        u32       head = *this->uring.cq_head;
+        u32 const tail = __atomic_load_n(this->uring.cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++)
+        {
+            io_uring_cqe const& cqe = this->uring.cqes[head & this->uring.cq_mask];
+            this->in_flight--;
+
+            if (cqe.user_data & open_tag) this->file_opened(static_cast<u32>(cqe.user_data & ~open_tag), cqe.res);
+            else                          this->read_done(static_cast<u32>(cqe.user_data), cqe.res);
+        }
+
+        __atomic_store_n(this->uring.cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    /**
+     * Waits for the requests in flight after a failure, such that
+     * the kernel no longer writes to the buffers. If even that
+     * fails the buffers are leaked rather than freed.
+     */
+    void drain() noexcept
+    {
+        while (this->in_flight > 0)
+        {
+            if (uring_enter(this->uring.fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+            {
+                this->leak = true;
+                return;
+            }
+
+            u32 const tail = __atomic_load_n(this->uring.cq_tail, __ATOMIC_ACQUIRE);
+            this->in_flight -= tail - *this->uring.cq_head;
+            __atomic_store_n(this->uring.cq_head, tail, __ATOMIC_RELEASE);
+        }
+    }
+
+    /**
+     * Hashes every file. Returns false, with errno set, if the ring
+     * failed.
+     */
+    bool run() noexcept
+    {
+        while (this->next_path < this->count || this->free_slot_count < this->opts.max_open_files)
+        {
+            //Keep every slot busy, then spread the buffers over them
+            while (this->free_slot_count > 0 && this->next_path < this->count)
+            {
+                this->start_file(this->free_slots[--this->free_slot_count]);
+            }
+            this->issue_reads();
+
+            //Everything may have finished without the ring
+            if (this->in_flight > 0)
+            {
+                if (!this->uring.submit_and_wait(1))
+                {
+                    int const error = errno;
+                    this->drain();
+                    errno = error;
+                    return false;
+                }
+                this->reap();
+            }
+
+            this->flush_batch();
+        }
+
+        return true;
+    }
+};
+
+/**
+ * Hashes the files one by one, for when io_uring is unavailable.
+ */
+static void hash_serial(char const* const* paths, u64 count, callback on_file, void* user, options const& opts) noexcept
+{
+    sha256_file::options o = sha256_file::default_options();
+    if (opts.direct) o.io_mode = sha256_file::mode::direct;
+
+    for (u64 i = 0; i < count; i++)
+    {
+        byte digest[sha256::digest_length];
+        if (sha256_file::hash_file(paths[i], digest, o)) on_file(user, i, 0, digest);
+        else                                             on_file(user, i, errno, nullptr);
+    }
+}
+
+/* Implementation */
+
+options bkh::sha256_uring::default_options() noexcept
+{
+    options opts;
+    opts.queue_depth    = 256;
+    opts.buffer_size    = 64 * kib;
+    opts.max_open_files = 128;
+    opts.reads_per_file = 16;
+    opts.direct         = false;
+
+    return opts;
+}
+
+bool bkh::sha256_uring::is_supported() noexcept
+{
+    ring r;
+    return r.init(1);
+}
+
+bool bkh::sha256_uring::hash_files(char const* const* paths, u64 count, callback on_file, void* user) noexcept
+{
+    return hash_files(paths, count, on_file, user, default_options());
+}
+
+bool bkh::sha256_uring::hash_files(char const* const* paths, u64 count, callback on_file, void* user, options const& opts) noexcept
+{
+    //Validate the options
+    if (opts.queue_depth == 0 || opts.queue_depth > max_buffers || opts.max_open_files == 0 || opts.reads_per_file == 0
+        || opts.buffer_size == 0 || opts.buffer_size % buffer_alignment != 0)
+    {
+        errno = EINVAL;
+        return false;
+    }
+    if (count == 0) return true;
+
+    scanner s{};
+    s.opts    = opts;
+    s.paths   = paths;
+    s.count   = count;
+    s.on_file = on_file;
+    s.user    = user;
+
+    //Every open and read may be in flight at once
+    u64 const entries = u64{ opts.queue_depth } + opts.max_open_files;
+    if (!s.uring.init(static_cast<u32>((entries < max_entries) ? entries : max_entries)))
+    {
+        hash_serial(paths, count, on_file, user, opts);
+        return true;
+    }
+
+    //Never have more in flight than the ring holds
+    if (entries > max_entries)
+    {
+        u32 const files = (opts.max_open_files < max_entries / 2) ? opts.max_open_files : max_entries / 2;
+        s.opts.max_open_files = files;
+        s.opts.queue_depth    = (opts.queue_depth < max_entries - files) ? opts.queue_depth : max_entries - files;
+    }
+
+    if (!s.allocate()) return false;
+    s.register_buffers();
+    s.async_open = s.uring.supports(IORING_OP_OPENAT);
+
+    return s.run();
+}
@@ -0,0 +1,143 @@
+#ifndef BKH_SHA256_URING_H
+#define BKH_SHA256_URING_H
+#pragma once
+
+/** sha256_uring.h - Bendik Hillestad - Public Domain
+ * Implements hashing of many files at once on Linux using
+ * io_uring, which keeps hundreds of reads in flight from a single
+ * thread instead of waiting for each one in turn. When scanning
+ * large numbers of small to medium files this makes hashing bound
+ * by the CPU rather than by the latency of the storage.
+ *
+ * The files are opened and read asynchronously into a pool of
+ * buffers registered with the kernel. Every file may have several
+ * reads in flight, and each buffer is fed to the hasher of its
+ * file as soon as the reads before it have been. Files that fit
+ * in a single buffer are collected and hashed together through
+ * sha256::compute_hash_batch. The digest of every file is
+ * reported through a callback as the file finishes, so the order
+ * of the callbacks is not the order of the paths.
+ *
+ * A file is hashed up to the size it had when it was opened.
+ * Files that are not regular files, such as pipes, are hashed
+ * synchronously through sha256_file. Where io_uring is not
+ * available, because the kernel is older than 5.1 or it has been
+ * disabled, every file is hashed through sha256_file instead.
+ *
+ * The ring is set up with the raw system calls, so no liburing is
+ * needed. The buffers are allocated for each call and registered
+ * with the kernel where RLIMIT_MEMLOCK allows it, and otherwise
+ * read into with plain vectored reads.
+ * Example:
+
+    using byte = unsigned char;
+
+    static void on_file(void* user, u64 index, int error, byte const* digest)
+    {
+        auto& paths = *static_cast<std::vector<char const*>*>(user);
+        if (error) fprintf(stderr, "%s: %s\n", paths[index], strerror(error));
+        else       store_digest(paths[index], digest);
+    }
+
+    sha256_uring::hash_files(paths.data(), paths.size(), on_file, &paths);
+
+ *
+ * This is free and unencumbered software released into the public domain.
+ *
+ * Anyone is free to copy, modify, publish, use, compile, sell, or
+ * distribute this software, either in source code form or as a compiled
+ * binary, for any purpose, commercial or non-commercial, and by any
+ * means.
+ *
+ * In jurisdictions that recognize copyright laws, the author or authors
+ * of this software dedicate any and all copyright interest in the
+ * software to the public domain. We make this dedication for the benefit
+ * of the public at large and to the detriment of our heirs and
+ * successors. We intend this dedication to be an overt act of
+ * relinquishment in perpetuity of all present and future rights to this
+ * software under copyright law.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "sha256.h"
+
+namespace bkh
+{
+    struct sha256_uring
+    {
+    public:
+        using byte = sha256::byte;
+
+        /**
+         * Called once for every file as it finishes, with the
+         * index of its path. On success the error is 0 and the
+         * digest points to sha256::digest_length bytes, which
+         * are only valid during the call. Otherwise the error is
+         * an errno value and the digest is null.
+         */
+        using callback = void (*)(void* user, u64 index, int error, byte const* digest);
+
+        /**
+         * How to drive the ring.
+         */
+        struct options
+        {
+            u32  queue_depth;    //Number of reads in flight, each with its own buffer, at most 16384
+            u32  buffer_size;    //Size of each buffer, a multiple of 4 KiB
+            u32  max_open_files; //Number of files being opened or read at once
+            u32  reads_per_file; //Number of reads in flight for a single file
+            bool direct;         //Open the files with O_DIRECT where supported
+        };
+
+        /**
+         * Retrieves the default options. 256 reads of 64 KiB
+         * are kept in flight, spread over up to 128 files, with
+         * at most 16 reads in flight for the same file. The
+         * files are read through the page cache.
+         */
+        static options default_options() noexcept;
+
+        /**
+         * Checks whether io_uring is available, otherwise
+         * hash_files falls back to hashing the files one by one.
+         */
+        static bool is_supported() noexcept;
+
+        /**
+         * Computes the SHA-256 hash of every file using the
+         * default options, calling the callback as each one
+         * finishes. Returns false, with errno set, if the
+         * options are invalid, the buffers could not be
+         * allocated or the ring failed, in which case the
+         * callback is not called for the remaining files.
+         */
+        static bool hash_files(
+            char const* const* paths,
+            u64                count,
+            callback           on_file,
+            void*              user
+        ) noexcept;
+
+        /**
+         * Same as above, using the given options.
+         */
+        static bool hash_files(
+            char const* const* paths,
+            u64                count,
+            callback           on_file,
+            void*              user,
+            options const&     opts
+        ) noexcept;
+
+        sha256_uring() = delete;
+    };
+};
+
+#endif
@@ -0,0 +1,28 @@
+#!/bin/sh
+
+# Builds and runs the checks with GCC or Clang. Set CXX to pick the
+# compiler, it defaults to c++.
+
+set -e
+
+cd "$(dirname "$0")"
+mkdir -p build
+
+CXX=${CXX:-c++}
+COMPILER_FLAGS="-std=c++17 -O2 -Wall -Wextra -pthread"
+
+$CXX $COMPILER_FLAGS ../src/sha256.cpp check_backends.cpp -o build/check_backends
+$CXX $COMPILER_FLAGS ../src/sha256.cpp check_batch.cpp -o build/check_batch
+$CXX $COMPILER_FLAGS ../src/sha256.cpp check_checkpoint.cpp -o build/check_checkpoint
+$CXX $COMPILER_FLAGS ../src/sha256.cpp ../src/sha256_file.cpp ../src/sha256_cache.cpp check_cache.cpp -o build/check_cache
+$CXX $COMPILER_FLAGS ../src/sha256.cpp ../src/sha256_hmac.cpp check_hmac.cpp -o build/check_hmac
+$CXX $COMPILER_FLAGS ../src/sha256.cpp ../src/sha256_hmac.cpp ../src/sha256_pbkdf2.cpp check_pbkdf2.cpp -o build/check_pbkdf2
+$CXX $COMPILER_FLAGS ../src/sha256.cpp ../src/sha256_merkle.cpp check_merkle.cpp -o build/check_merkle
+
+./build/check_backends
+./build/check_batch
+./build/check_cache
+./build/check_checkpoint
+./build/check_hmac
+./build/check_pbkdf2
+./build/check_merkle
@@ -0,0 +1,49 @@
+#ifndef BKH_CHECK_H
+#define BKH_CHECK_H
+#pragma once
+
+#include "../src/sha256.h"
+
+#include <cstdio>
+#include <cstring>
+
+/**
+ * Reports the check as failed unless the condition holds, and
+ * passes the condition on so the results can be accumulated.
+ */
+inline bool check(bool condition, char const* what) noexcept
+{
+    if (!condition) std::fprintf(stderr, "FAIL: %s\n", what);
+    return condition;
+}
+
+/**
+ * Decodes a string of hex digits into the buffer, which must
+ * have room for half as many bytes. Returns the number of bytes.
+ */
+inline bkh::u64 from_hex(char const* hex, bkh::u8* result) noexcept
+{
+    auto const nibble = [](char c) noexcept
+    {
+        return static_cast<bkh::u8>((c <= '9') ? c - '0' : (c | 0x20) - 'a' + 10);
+    };
+
+    bkh::u64 length = std::strlen(hex) / 2;
+    for (bkh::u64 i = 0; i < length; i++)
+    {
+        result[i] = static_cast<bkh::u8>((nibble(hex[2 * i]) << 4) | nibble(hex[2 * i + 1]));
+    }
+    return length;
+}
+
+/**
+ * Checks that the bytes match the hex digits.
+ */
+inline bool matches_hex(bkh::u8 const* bytes, char const* hex) noexcept
+{
+    bkh::u8 expected[256];
+    bkh::u64 const length = from_hex(hex, expected);
+    return std::memcmp(bytes, expected, length) == 0;
+}
+
+#endif
@@ -0,0 +1,109 @@
+#include "check.h"
+
+#include <cstdlib>
+
+using namespace bkh;
+
+/**
+ * Hashes the message through the low-level API, transforming all
+ * the full blocks in one call.
+ */
+static void hash_with_context(u8 const* data, u64 length, u8* result) noexcept
+{
+    u64 const full = length / sha256::block_length * sha256::block_length;
+
+    sha256::context ctx;
+    ctx.init();
+    ctx.transform_blocks(data, full / sha256::block_length);
+
+    u8 block[sha256::block_length];
+    if (!sha256::context::pad_block(data + full, length - full, length, block))
+    {
+        ctx.transform_block(block);
+        sha256::context::pad_block(nullptr, 0, length, block);
+    }
+    ctx.transform_block(block);
+    ctx.get_digest(result);
+}
+
+/**
+ * Hashes the message through the hasher, in pieces of uneven
+ * lengths.
+ */
+static void hash_with_hasher(u8 const* data, u64 length, u8* result) noexcept
+{
+    sha256::hasher h;
+    h.init();
+    for (u64 offset = 0, piece = 1; offset < length; offset += piece, piece = piece * 3 % 71 + 1)
+    {
+        h.update(data + offset, (length - offset < piece) ? length - offset : piece);
+    }
+    h.finalize(result);
+}
+
+/**
+ * Checks that every single-stream backend the host supports
+ * agrees with compute_hash_constexpr, which does not go through
+ * the backends, through compute_hash, the low-level API and the
+ * hasher, and that they give the digests of FIPS 180-2.
+ */
+int main()
+{
+    constexpr u64 const max_length = 300;
+    bool ok = true;
+
+    //A multi-block message, and every length around the padding boundaries of the first few blocks
+    static u8 data[64 * 1024 + 17];
+    for (u64 i = 0; i < sizeof(data); i++) data[i] = static_cast<u8>(i * 167 + (i >> 9));
+
+    static char const two_blocks[] = "abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq";
+
+    struct named_backend
+    {
+        sha256::backend backend;
+        char const*     name;
+    };
+    named_backend const backends[]
+    {
+        { sha256::backend::scalar, "scalar" },
+        { sha256::backend::ssse3,  "ssse3"  },
+        { sha256::backend::avx2,   "avx2"   },
+        { sha256::backend::shani,  "shani"  }
+    };
+
+    //Hashes the message of the given length every way
+    auto const check_length = [&](u64 length) noexcept
+    {
+        auto const expected = sha256::compute_hash_constexpr(data, length);
+
+        u8 result[sha256::digest_length];
+        sha256::compute_hash(data, length, result);
+        ok &= check(std::memcmp(result, expected.bytes, sizeof(result)) == 0, "compute_hash");
+
+        hash_with_context(data, length, result);
+        ok &= check(std::memcmp(result, expected.bytes, sizeof(result)) == 0, "transform_blocks");
+
+        hash_with_hasher(data, length, result);
+        ok &= check(std::memcmp(result, expected.bytes, sizeof(result)) == 0, "hasher");
+    };
+
+    for (auto const& b : backends)
+    {
+        if (!sha256::set_backend(b.backend)) continue;
+
+        //The known answers, "abc" and the two block message
+        u8 result[sha256::digest_length];
+        sha256::compute_hash(reinterpret_cast<u8 const*>("abc"), 3, result);
+        ok &= check(matches_hex(result, "ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad"), "the digest of \"abc\"");
+        sha256::compute_hash(reinterpret_cast<u8 const*>(two_blocks), sizeof(two_blocks) - 1, result);
+        ok &= check(matches_hex(result, "248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1"), "the digest of the two block message");
+
+        for (u64 length = 0; length <= max_length; length++) check_length(length);
+        check_length(sizeof(data));
+
+        std::printf("backend %s: %s\n", b.name, ok ? "ok" : "failed");
+    }
+
+    sha256::set_backend(sha256::backend::automatic);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
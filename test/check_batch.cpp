@@ -0,0 +1,66 @@
+#include "check.h"
+
+#include <cstdlib>
+
+using namespace bkh;
+
+/**
+ * Checks that every lane of compute_hash_batch matches
+ * compute_hash, on every batch backend the host supports, for
+ * batches that leave lanes idle and messages of every length
+ * around the block boundaries.
+ */
+int main()
+{
+    constexpr u64 const message_count = 37;
+    constexpr u64 const prefix_length = 2 * sha256::block_length;
+    bool ok = true;
+
+    //Lengths from empty to several blocks, including both sides of every padding boundary
+    static u8 data[prefix_length + message_count * 19];
+    for (u64 i = 0; i < sizeof(data); i++) data[i] = static_cast<u8>(i * 131 + (i >> 8));
+
+    //The prefix shared by the messages hashed from a midstate
+    sha256::hasher h;
+    h.init();
+    h.update(data, prefix_length);
+    sha256::midstate prefix;
+    ok &= check(h.save_midstate(&prefix), "save_midstate");
+
+    sha256::batch_backend const backends[]{ sha256::batch_backend::serial, sha256::batch_backend::avx2, sha256::batch_backend::avx512 };
+    for (auto const backend : backends)
+    {
+        if (!sha256::set_batch_backend(backend)) continue;
+
+        for (u64 count = 1; count <= message_count; count += 6)
+        {
+            sha256::message messages[message_count];
+            u8 results[message_count][sha256::digest_length];
+            for (u64 i = 0; i < count; i++) messages[i] = { data + prefix_length, i * 19, results[i] };
+
+            //From the start
+            sha256::compute_hash_batch(messages, count);
+            for (u64 i = 0; i < count; i++)
+            {
+                u8 expected[sha256::digest_length];
+                sha256::compute_hash(messages[i].data, messages[i].length, expected);
+                ok &= check(std::memcmp(results[i], expected, sizeof(expected)) == 0, "compute_hash_batch");
+            }
+
+            //From the midstate of the prefix
+            for (u64 i = 0; i < count; i++) messages[i].data = data + prefix_length;
+            sha256::compute_hash_batch(prefix, messages, count);
+            for (u64 i = 0; i < count; i++)
+            {
+                u8 expected[sha256::digest_length];
+                sha256::compute_hash(data, prefix_length + messages[i].length, expected);
+                ok &= check(std::memcmp(results[i], expected, sizeof(expected)) == 0, "compute_hash_batch from a midstate");
+            }
+        }
+
+        std::printf("batch with %d lanes: %s\n", sha256::get_lane_count(), ok ? "ok" : "failed");
+    }
+
+    sha256::set_batch_backend(sha256::batch_backend::automatic);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
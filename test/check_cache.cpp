@@ -0,0 +1,154 @@
+#include "check.h"
+#include "../src/sha256_cache.h"
+
+#include <cstdlib>
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace bkh;
+
+static sha256_cache::identity make_identity(u64 inode) noexcept
+{
+    sha256_cache::identity id{};
+    id.device   = 1;
+    id.inode    = inode;
+    id.size     = 3;
+    id.mtime_ns = 1000000000ull;
+    id.ctime_ns = 1000000000ull;
+    return id;
+}
+
+/**
+ * Leaves the entry of the file claimed, as if the process writing
+ * it had died. Follows the layout in sha256_cache.cpp: a 64 byte
+ * header and entries of 96 bytes, with the sequence number first
+ * and the device and inode at offsets 8 and 16.
+ */
+static bool claim_entry(char const* path, u64 inode) noexcept
+{
+    int const f = open(path, O_RDWR);
+    struct stat info;
+    if (f < 0 || fstat(f, &info) != 0) return false;
+
+    auto const size = static_cast<u64>(info.st_size);
+    void* const m   = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, f, 0);
+    close(f);
+    if (m == MAP_FAILED) return false;
+
+    bool found = false;
+    for (u64 offset = 64; offset + 96 <= size && !found; offset += 96)
+    {
+        u8* const e = static_cast<u8*>(m) + offset;
+        u64 device, ino;
+        std::memcpy(&device, e + 8,  sizeof(device));
+        std::memcpy(&ino,    e + 16, sizeof(ino));
+        if (device != 1 || ino != inode) continue;
+
+        u32 sequence;
+        std::memcpy(&sequence, e, sizeof(sequence));
+        sequence |= 1;
+        std::memcpy(e, &sequence, sizeof(sequence));
+        found = true;
+    }
+
+    munmap(m, size);
+    return found;
+}
+
+/**
+ * Checks that the cache can be open in several processes at
+ * once, that the entries stored by one are seen by the others,
+ * and that an entry left claimed by a process that died while
+ * another had the cache open is released again.
+ */
+int main()
+{
+    char path[]{ "/tmp/check_cache.XXXXXX" };
+    int const f = mkstemp(path);
+    if (f < 0)
+    {
+        std::perror("mkstemp");
+        return EXIT_FAILURE;
+    }
+    close(f);
+    unlink(path);
+
+    u8 first[sha256::digest_length];
+    u8 second[sha256::digest_length];
+    sha256::compute_hash(reinterpret_cast<u8 const*>("abc"), 3, first);
+    sha256::compute_hash(reinterpret_cast<u8 const*>("def"), 3, second);
+
+    //Open it in this process, and keep it open while the child uses it
+    sha256_cache cache;
+    bool ok = check(cache.open(path, 1024), "open in the parent");
+    if (!ok) return EXIT_FAILURE;
+    cache.store(make_identity(1), first, sha256_file::mode::read);
+
+    pid_t const child = fork();
+    if (child == 0)
+    {
+        //Opening must not wait for the parent to close it
+        alarm(5);
+
+        sha256_cache shared;
+        if (!shared.open(path, 1024)) _exit(1);
+
+        u8 digest[sha256::digest_length];
+        if (!shared.lookup(make_identity(1), digest, nullptr))         _exit(2);
+        if (std::memcmp(digest, first, sizeof(digest)) != 0)            _exit(3);
+        shared.store(make_identity(2), second, sha256_file::mode::read);
+        shared.close();
+        _exit(0);
+    }
+
+    int status = 0;
+    ok &= check(child > 0 && waitpid(child, &status, 0) == child, "fork the child");
+    ok &= check(WIFEXITED(status) && WEXITSTATUS(status) == 0, "open and look up in the child while the parent has it open");
+
+    u8 digest[sha256::digest_length];
+    ok &= check(cache.lookup(make_identity(2), digest, nullptr), "see the entry stored by the child");
+    ok &= check(std::memcmp(digest, second, sizeof(digest)) == 0, "the entry stored by the child");
+    cache.close();
+
+    //Both entries must survive it being closed by everyone
+    sha256_cache reopened;
+    ok &= check(reopened.open(path, 1024), "reopen");
+    ok &= check(reopened.lookup(make_identity(1), digest, nullptr), "the entries after reopening");
+    reopened.close();
+
+    //Kill a process in the middle of writing an entry, while this one has it open
+    ok &= check(cache.open(path, 1024), "open before the crash");
+    pid_t const victim = fork();
+    if (victim == 0)
+    {
+        alarm(5);
+
+        sha256_cache shared;
+        if (!shared.open(path, 1024)) _exit(1);
+        shared.store(make_identity(3), first, sha256_file::mode::read);
+        if (!claim_entry(path, 3)) _exit(2);
+        raise(SIGKILL);
+        _exit(3);
+    }
+
+    status = 0;
+    ok &= check(victim > 0 && waitpid(victim, &status, 0) == victim, "fork the process to kill");
+    ok &= check(WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL, "kill the process while it writes");
+    cache.close();
+
+    //The entry must be usable again once everyone has closed it
+    ok &= check(reopened.open(path, 1024), "reopen after the crash");
+    reopened.store(make_identity(3), second, sha256_file::mode::read);
+    ok &= check(reopened.lookup(make_identity(3), digest, nullptr), "store over the entry of the killed process");
+    ok &= check(std::memcmp(digest, second, sizeof(digest)) == 0, "the entry stored over the one of the killed process");
+    reopened.close();
+
+    unlink(path);
+    if (ok) std::printf("cache: ok\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,95 @@
+#include "check.h"
+
+#include <cstdlib>
+
+using namespace bkh;
+
+/**
+ * The checkpoint of 64 bytes of 'a' followed by "bc", pinning the
+ * format documented in sha256.h: the header, the state after the
+ * first block, the length, the two buffered bytes and the check.
+ */
+static char const pinned_checkpoint[] =
+    "5348435001020000"
+    "df5bb81ce81e0626fb45a8944fd40f31b25e6816d6d499c1ab90492900635e66"
+    "0000000000000042"
+    "6263"
+    "db4814cb63b349b0";
+
+/**
+ * Checks that a hash resumed from a checkpoint gives the digest
+ * of the whole message, at every number of buffered bytes, that
+ * damaged checkpoints are rejected, and that the format does not
+ * change.
+ */
+int main()
+{
+    bool ok = true;
+
+    static u8 data[3 * sha256::block_length + 5];
+    for (u64 i = 0; i < sizeof(data); i++) data[i] = static_cast<u8>(i * 29 + 7);
+
+    //Every number of buffered bytes, after zero and after two blocks
+    for (u64 cut = 0; cut < 3 * sha256::block_length; cut++)
+    {
+        sha256::hasher h;
+        h.init();
+        h.update(data, cut);
+
+        u8 checkpoint[sha256::hasher::max_checkpoint_length + 1];
+        u64 const length = h.save_checkpoint(checkpoint);
+        ok &= check(length == 56 + cut % sha256::block_length, "the length of the checkpoint");
+
+        sha256::hasher resumed;
+        resumed.init();
+        ok &= check(resumed.restore_checkpoint(checkpoint, length), "restore_checkpoint");
+        resumed.update(data + cut, sizeof(data) - cut);
+
+        u8 result[sha256::digest_length], expected[sha256::digest_length];
+        resumed.finalize(result);
+        sha256::compute_hash(data, sizeof(data), expected);
+        ok &= check(std::memcmp(result, expected, sizeof(result)) == 0, "the digest after resuming");
+
+        //Any flipped bit must be caught
+        u64 const bit = (cut * 37) % (length * 8);
+        checkpoint[bit / 8] ^= static_cast<u8>(1 << (bit % 8));
+        ok &= check(!resumed.restore_checkpoint(checkpoint, length), "a checkpoint with a flipped bit");
+        checkpoint[bit / 8] ^= static_cast<u8>(1 << (bit % 8));
+
+        //As must a checkpoint that is cut short or has bytes added
+        checkpoint[length] = 0;
+        ok &= check(!resumed.restore_checkpoint(checkpoint, length - 1), "a truncated checkpoint");
+        ok &= check(!resumed.restore_checkpoint(checkpoint, length + 1), "an over-long checkpoint");
+    }
+
+    //The format is pinned
+    {
+        u8 message[sha256::block_length + 2];
+        std::memset(message, 'a', sha256::block_length);
+        message[sha256::block_length + 0] = 'b';
+        message[sha256::block_length + 1] = 'c';
+
+        sha256::hasher h;
+        h.init();
+        h.update(message, sizeof(message));
+
+        u8 checkpoint[sha256::hasher::max_checkpoint_length];
+        u8 expected[sha256::hasher::max_checkpoint_length];
+        u64 const length          = h.save_checkpoint(checkpoint);
+        u64 const expected_length = from_hex(pinned_checkpoint, expected);
+        ok &= check(length == expected_length && std::memcmp(checkpoint, expected, length) == 0, "the pinned checkpoint");
+
+        //And restores to the digest of the message
+        sha256::hasher resumed;
+        resumed.init();
+        ok &= check(resumed.restore_checkpoint(expected, expected_length), "restore the pinned checkpoint");
+
+        u8 result[sha256::digest_length], digest[sha256::digest_length];
+        resumed.finalize(result);
+        sha256::compute_hash(message, sizeof(message), digest);
+        ok &= check(std::memcmp(result, digest, sizeof(result)) == 0, "the digest of the pinned checkpoint");
+    }
+
+    if (ok) std::printf("checkpoint: ok\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,130 @@
+#include "check.h"
+#include "../src/sha256_hmac.h"
+
+#include <cstdlib>
+
+using namespace bkh;
+
+/**
+ * The test cases of RFC 4231, section 4.
+ */
+struct test_case
+{
+    char const* key;
+    char const* data;
+    char const* tag;
+    u64         tag_length;
+};
+
+static test_case const test_cases[]
+{
+    //Test Case 1
+    {
+        "0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b0b",
+        "4869205468657265",
+        "b0344c61d8db38535ca8afceaf0bf12b881dc200c9833da726e9376c2e32cff7", 32
+    },
+    //Test Case 2, a key shorter than the digest
+    {
+        "4a656665",
+        "7768617420646f2079612077616e7420666f72206e6f7468696e673f",
+        "5bdcc146bf60754e6a042426089575c75a003f089d2739839dec58b964ec3843", 32
+    },
+    //Test Case 3, 50 bytes of data
+    {
+        "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa",
+        "dddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddddd",
+        "773ea91e36800e46854db8ebd09181a72959098b3ef8c122d9635514ced565fe", 32
+    },
+    //Test Case 4
+    {
+        "0102030405060708090a0b0c0d0e0f10111213141516171819",
+        "cdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcdcd",
+        "82558a389a443c0ea4cc819899f2083a85f0faa3e578f8077a2e3ff46729665b", 32
+    },
+    //Test Case 5, truncated to 128 bits
+    {
+        "0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c0c",
+        "546573742057697468205472756e636174696f6e",
+        "a3b6167473100ee06e0c796c2955552b", 16
+    },
+    //Test Case 6, a key larger than a block
+    {
+        "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa",
+        "54657374205573696e67204c6172676572205468616e20426c6f636b2d53697a65204b6579202d2048617368204b6579204669727374",
+        "60e431591ee0b67f0d8a26aacbf5b77f8e0bc6213728c5140546040f0ee37f54", 32
+    },
+    //Test Case 7, a key and data larger than a block
+    {
+        "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa",
+        "5468697320697320612074657374207573696e672061206c6172676572207468616e20626c6f636b2d73697a65206b657920616e642061206c6172676572207468616e20626c6f636b2d73697a6520646174612e20546865206b6579206e6565647320746f20626520686173686564206265666f7265206265696e6720757365642062792074686520484d414320616c676f726974686d2e",
+        "9b09ffa71b942fcb27635fbcd5b0e944bfdc63644f0713938a7f51535c3a35e2", 32
+    }
+};
+
+/**
+ * Checks the HMAC against the test vectors of RFC 4231, through
+ * the one-shot, keyed, incremental and batched interfaces.
+ */
+int main()
+{
+    bool ok = true;
+
+    for (auto const& t : test_cases)
+    {
+        u8 key[160], data[160], expected[hmac_sha256::tag_length];
+        u64 const key_length  = from_hex(t.key, key);
+        u64 const data_length = from_hex(t.data, data);
+        from_hex(t.tag, expected);
+
+        u8 tag[hmac_sha256::tag_length];
+        hmac_sha256::compute_hmac(key, key_length, data, data_length, tag);
+        ok &= check(std::memcmp(tag, expected, t.tag_length) == 0, "compute_hmac");
+
+        hmac_sha256 mac;
+        mac.init(key, key_length);
+        mac.compute(data, data_length, tag);
+        ok &= check(std::memcmp(tag, expected, t.tag_length) == 0, "compute");
+
+        //The data fed in two uneven parts
+        sha256::hasher h;
+        mac.begin(&h);
+        h.update(data, data_length / 3);
+        h.update(data + data_length / 3, data_length - data_length / 3);
+        mac.finalize(&h, tag);
+        ok &= check(std::memcmp(tag, expected, t.tag_length) == 0, "begin and finalize");
+
+        //Only the full tags can be verified
+        if (t.tag_length == hmac_sha256::tag_length)
+        {
+            ok &= check(mac.verify(data, data_length, expected), "verify");
+            expected[7] ^= 1;
+            ok &= check(!mac.verify(data, data_length, expected), "verify of a wrong tag");
+        }
+        mac.clear_state();
+    }
+
+    //Test Cases 6 and 7 share their key, so they can be computed as a batch
+    {
+        u8 key[160], data[2][160], tags[2][hmac_sha256::tag_length];
+        u64 const key_length = from_hex(test_cases[5].key, key);
+
+        sha256::message messages[2];
+        for (int i = 0; i < 2; i++)
+        {
+            messages[i].data   = data[i];
+            messages[i].length = from_hex(test_cases[5 + i].data, data[i]);
+            messages[i].result = tags[i];
+        }
+
+        hmac_sha256 mac;
+        mac.init(key, key_length);
+        mac.compute_batch(messages, 2);
+        ok &= check(matches_hex(tags[0], test_cases[5].tag), "compute_batch of Test Case 6");
+        ok &= check(matches_hex(tags[1], test_cases[6].tag), "compute_batch of Test Case 7");
+        mac.clear_state();
+    }
+
+    if (ok) std::printf("hmac: ok\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,124 @@
+#include "check.h"
+#include "../src/sha256_merkle.h"
+
+#include <cstdlib>
+
+using namespace bkh;
+
+/**
+ * The leaves and roots of the RFC 6962 test vectors used by
+ * Certificate Transparency, where roots[n - 1] is the root of
+ * the tree of the first n leaves.
+ */
+static char const* const leaves[]
+{
+    "", "00", "10", "2021", "3031", "40414243", "5051525354555657", "606162636465666768696a6b6c6d6e6f"
+};
+
+static char const* const roots[]
+{
+    "6e340b9cffb37a989ca544e6bb780a2c78901d3fb33738768511a30617afa01d",
+    "fac54203e7cc696cf0dfcb42c92a1d9dbaf70ad9e621f4bd8d98662f00e3c125",
+    "aeb6bcfe274b70a14fb067a5e5578264db0fa9b51af5e0ba159158f329e06e77",
+    "d37ee418976dd95753c1c73862b9398fa2a2cf9b4ff0fdfe8b30cd95209614b7",
+    "4e3bbb1f7b478dcfe71fb631631519a3bca12c9aefca1612bfce4c13a86264d4",
+    "76e67dadbcdf1e10e1b74ddc608abd2f98dfb16fbce75277b5232a127f2087ef",
+    "ddb89be403809e325750d3d263cd78929c2942b7942a34b77e122c9594a74c8c",
+    "5dc9da79a70659a9ad559cb701ded9a2ab9d823aad2f4960cfe370eff4604328"
+};
+
+/**
+ * Audit paths from the same test vectors.
+ */
+struct audit_path
+{
+    u64         index;
+    u64         tree_size;
+    u64         length;
+    char const* digests[3];
+};
+
+static audit_path const audit_paths[]
+{
+    { 0, 8, 3, {
+        "96a296d224f285c67bee93c30f8a309157f0daa35dc5b87e410b78630a09cfc7",
+        "5f083f0a1a33ca076a95279832580db3e0ef4584bdff1f54c8a360f50de3031e",
+        "6b47aaf29ee3c2af9af889bc1fb9254dabd31177f16232dd6aab035ca39bf6e4" } },
+    { 5, 8, 3, {
+        "bc1a0643b12e4d2d7c77918f44e0f4f79a838b6cf9ec5b5c283e1f4d88599e6b",
+        "ca854ea128ed050b41b35ffc1b87b8eb2bde461e9e3b5596ece6b9d5975a0ae0",
+        "d37ee418976dd95753c1c73862b9398fa2a2cf9b4ff0fdfe8b30cd95209614b7" } },
+    { 2, 3, 1, {
+        "fac54203e7cc696cf0dfcb42c92a1d9dbaf70ad9e621f4bd8d98662f00e3c125" } },
+    { 1, 5, 3, {
+        "6e340b9cffb37a989ca544e6bb780a2c78901d3fb33738768511a30617afa01d",
+        "5f083f0a1a33ca076a95279832580db3e0ef4584bdff1f54c8a360f50de3031e",
+        "bc1a0643b12e4d2d7c77918f44e0f4f79a838b6cf9ec5b5c283e1f4d88599e6b" } }
+};
+
+/**
+ * Checks the roots and inclusion proofs of the Merkle tree
+ * against the RFC 6962 test vectors.
+ */
+int main()
+{
+    constexpr u64 const leaf_count = sizeof(leaves) / sizeof(leaves[0]);
+    bool ok = true;
+
+    static u8 storage[4096];
+    ok &= check(sha256_merkle::storage_size(leaf_count) <= sizeof(storage), "storage_size");
+
+    //The root of the empty tree is the digest of nothing
+    sha256_merkle tree;
+    ok &= check(tree.init(storage, sizeof(storage), leaf_count), "init");
+
+    u8 root[sha256::digest_length];
+    tree.get_root(root);
+    ok &= check(matches_hex(root, "e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855"), "the root of the empty tree");
+
+    //Check the root after every leaf appended
+    for (u64 n = 0; n < leaf_count; n++)
+    {
+        u8 data[16];
+        u64 const length = from_hex(leaves[n], data);
+        ok &= check(tree.append(data, length), "append");
+
+        tree.get_root(root);
+        ok &= check(matches_hex(root, roots[n]), "the root after appending");
+    }
+
+    //Check the audit paths, and that they verify against the roots
+    for (auto const& p : audit_paths)
+    {
+        sha256_merkle partial;
+        ok &= check(partial.init(storage, sizeof(storage), p.tree_size), "init");
+        for (u64 n = 0; n < p.tree_size; n++)
+        {
+            u8 data[16];
+            u64 const length = from_hex(leaves[n], data);
+            partial.append(data, length);
+        }
+
+        u8 proof[sha256::digest_length * 64];
+        u64 proof_length = 0;
+        ok &= check(partial.max_proof_length() <= 64, "max_proof_length");
+        ok &= check(partial.get_proof(p.index, proof, &proof_length), "get_proof");
+        ok &= check(proof_length == p.length, "the length of the audit path");
+        for (u64 i = 0; i < proof_length && i < p.length; i++)
+        {
+            ok &= check(matches_hex(proof + i * sha256::digest_length, p.digests[i]), "the audit path");
+        }
+
+        u8 leaf_digest[sha256::digest_length];
+        from_hex(roots[p.tree_size - 1], root);
+        partial.get_leaf_digest(p.index, leaf_digest);
+        ok &= check(sha256_merkle::verify_proof(leaf_digest, p.index, p.tree_size, proof, proof_length, root), "verify_proof");
+
+        //A single flipped bit must make it fail
+        proof[0] ^= 1;
+        ok &= check(!sha256_merkle::verify_proof(leaf_digest, p.index, p.tree_size, proof, proof_length, root), "verify_proof of a wrong path");
+    }
+
+    if (ok) std::printf("merkle: ok\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,80 @@
+#include "check.h"
+#include "../src/sha256_pbkdf2.h"
+
+#include <cstdlib>
+
+using namespace bkh;
+
+/**
+ * The PBKDF2-HMAC-SHA256 test vectors of RFC 7914, section 11.
+ */
+struct test_vector
+{
+    char const* password;
+    char const* salt;
+    u64         iterations;
+    char const* key;
+};
+
+static test_vector const test_vectors[]
+{
+    {
+        "passwd", "salt", 1,
+        "55ac046e56e3089fec1691c22544b605f94185216dde0465e68b9d57c20dacbc"
+        "49ca9cccf179b645991664b39d77ef317c71b845b1e30bd509112041d3a19783"
+    },
+    {
+        "Password", "NaCl", 80000,
+        "4ddcd8f60b98be21830cee5ef22701f9641a4418d04c0414aeff08876b34ab56"
+        "a1d425a1225833549adb841b51c9b3176a272bdebba1d078478f62b397f33c8d"
+    }
+};
+
+/**
+ * Checks the key derivation against the test vectors, one at a
+ * time and several at once, such that they share the lanes.
+ */
+int main()
+{
+    constexpr u64 const key_length = 64;
+    bool ok = true;
+
+    for (auto const& t : test_vectors)
+    {
+        u8 key[key_length];
+        ok &= check(pbkdf2_sha256::derive_key(
+            reinterpret_cast<u8 const*>(t.password), std::strlen(t.password),
+            reinterpret_cast<u8 const*>(t.salt),     std::strlen(t.salt),
+            t.iterations, key, key_length
+        ), "derive_key");
+        ok &= check(matches_hex(key, t.key), "derive_key against the test vector");
+    }
+
+    //Shorter keys are prefixes of the longer ones, odd lengths end mid-block
+    constexpr int const derivation_count = 6;
+    u64 const lengths[derivation_count]{ 64, 64, 20, 33, 1, 40 };
+    u8 keys[derivation_count][key_length];
+
+    pbkdf2_sha256::derivation derivations[derivation_count];
+    for (int i = 0; i < derivation_count; i++)
+    {
+        auto const& t = test_vectors[i % 2];
+        derivations[i] =
+        {
+            reinterpret_cast<u8 const*>(t.password), std::strlen(t.password),
+            reinterpret_cast<u8 const*>(t.salt),     std::strlen(t.salt),
+            t.iterations, keys[i], lengths[i]
+        };
+    }
+
+    ok &= check(pbkdf2_sha256::derive_keys(derivations, derivation_count), "derive_keys");
+    for (int i = 0; i < derivation_count; i++)
+    {
+        u8 expected[key_length];
+        from_hex(test_vectors[i % 2].key, expected);
+        ok &= check(std::memcmp(keys[i], expected, lengths[i]) == 0, "derive_keys against the test vectors");
+    }
+
+    if (ok) std::printf("pbkdf2: ok\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}